@@ -0,0 +1,463 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <charconv>
+#include <algorithm>
+#include <exception>
+#include <filesystem>
+#include <stdexcept>
+#include <thread>
+#include <gflags/gflags.h>
+
+namespace fs = std::filesystem;
+
+// --- Command-line Flag Definitions ---
+DEFINE_string(output_directory, "", "Directory to write points.txt, categories.txt and groups.txt into.");
+DEFINE_int64(points, 1000000, "Number of points to generate.");
+DEFINE_uint64(seed, 42, "Random seed; the same seed and flags always produce the same files.");
+DEFINE_double(extent, 1000.0, "Points lie in [0, extent] x [0, extent].");
+DEFINE_string(distribution, "uniform", "Placement of group centers: uniform, clustered or grid.");
+DEFINE_int32(clusters, 16, "Number of clusters for --distribution=clustered.");
+DEFINE_double(cluster_spread, 0.03, "Standard deviation of a cluster as a fraction of the extent.");
+DEFINE_int32(categories, 10, "Number of distinct categories.");
+DEFINE_double(category_skew, 0.0, "Zipf exponent of the category frequencies; 0 makes all categories equally likely.");
+DEFINE_double(group_size, 8.0, "Mean number of points per group.");
+DEFINE_string(group_size_distribution, "fixed", "Group sizes: fixed, uniform (1 to 2*mean-1) or geometric.");
+DEFINE_double(group_radius, 2.0, "Points of a group lie within this distance of its center on each axis.");
+DEFINE_double(straddle_fraction, 0.1, "Fraction of groups centered on a query boundary line, so they straddle crop edges.");
+DEFINE_double(boundary_spacing, 100.0, "Spacing of the boundary lines; generated query crops have their edges on them.");
+DEFINE_int32(decimals, 4, "Decimal places written per coordinate.");
+DEFINE_int32(queries, 0, "Number of random query files to write into <output_directory>/queries.");
+DEFINE_int32(query_depth, 3, "Maximum AND/OR nesting depth of the generated queries.");
+DEFINE_int32(threads, 0, "Generator threads; 0 uses every hardware thread.");
+
+namespace {
+
+// splitmix64: tiny, fast, and produces the same stream on every platform,
+// unlike the std distributions.
+class Random {
+public:
+    explicit Random(uint64_t seed) : state_(seed) {}
+
+    // Independent stream for (seed, stream, index)
+    static Random stream(uint64_t seed, uint64_t stream, uint64_t index) {
+        Random mixer(seed ^ (stream * 0x9E3779B97F4A7C15ULL));
+        mixer.state_ += index * 0xD1B54A32D192ED03ULL;
+        return Random(mixer.next());
+    }
+
+    uint64_t next() {
+        uint64_t z = (state_ += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [0, 1)
+    double uniform() {
+        return static_cast<double>(next() >> 11) * 0x1.0p-53;
+    }
+
+    double uniform(double lo, double hi) {
+        return lo + (hi - lo) * uniform();
+    }
+
+    uint64_t below(uint64_t n) {
+        return n == 0 ? 0 : next() % n;
+    }
+
+    // Standard normal (Box-Muller)
+    double normal() {
+        const double u1 = 1.0 - uniform();
+        const double u2 = uniform();
+        return std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * M_PI * u2);
+    }
+
+private:
+    uint64_t state_;
+};
+
+enum Stream : uint64_t {
+    kGroupSizes = 1,
+    kPoints = 2,
+    kClusterCenters = 3,
+    kQueries = 4
+};
+
+struct GeneratorConfig {
+    int64_t points;
+    uint64_t seed;
+    double extent;
+    std::string distribution;
+    std::vector<std::pair<double, double>> cluster_centers;
+    double cluster_sigma;
+    std::vector<double> category_cdf;
+    double group_size;
+    std::string group_size_distribution;
+    double group_radius;
+    double straddle_fraction;
+    double boundary_spacing;
+    int decimals;
+};
+
+int64_t next_group_size(Random& rng, const GeneratorConfig& config) {
+    const double mean = std::max(config.group_size, 1.0);
+    if (config.group_size_distribution == "uniform") {
+        const int64_t max_size = std::max<int64_t>(1, std::llround(2.0 * mean - 1.0));
+        return 1 + static_cast<int64_t>(rng.below(static_cast<uint64_t>(max_size)));
+    }
+    if (config.group_size_distribution == "geometric") {
+        // Number of trials until the first success with p = 1 / mean
+        if (mean <= 1.0) return 1;
+        const double p = 1.0 / mean;
+        return 1 + static_cast<int64_t>(std::floor(std::log(1.0 - rng.uniform()) / std::log(1.0 - p)));
+    }
+    return std::max<int64_t>(1, std::llround(mean));
+}
+
+std::vector<double> zipf_cdf(int categories, double skew) {
+    std::vector<double> cdf(static_cast<size_t>(std::max(categories, 1)));
+    double total = 0.0;
+    for (size_t k = 0; k < cdf.size(); ++k) {
+        total += 1.0 / std::pow(static_cast<double>(k + 1), skew);
+        cdf[k] = total;
+    }
+    for (double& c : cdf) {
+        c /= total;
+    }
+    return cdf;
+}
+
+int next_category(Random& rng, const GeneratorConfig& config) {
+    const double u = rng.uniform();
+    auto it = std::upper_bound(config.category_cdf.begin(), config.category_cdf.end(), u);
+    return static_cast<int>(std::min<size_t>(it - config.category_cdf.begin(), config.category_cdf.size() - 1));
+}
+
+double clamp_coord(double v, const GeneratorConfig& config) {
+    return std::min(std::max(v, 0.0), config.extent);
+}
+
+std::pair<double, double> group_center(Random& rng, const GeneratorConfig& config, int64_t group_id, int64_t total_groups) {
+    double x, y;
+    if (config.distribution == "clustered") {
+        const auto& cluster = config.cluster_centers[rng.below(config.cluster_centers.size())];
+        x = cluster.first + rng.normal() * config.cluster_sigma;
+        y = cluster.second + rng.normal() * config.cluster_sigma;
+    } else if (config.distribution == "grid") {
+        const int64_t side = std::max<int64_t>(1, static_cast<int64_t>(std::ceil(std::sqrt(static_cast<double>(total_groups)))));
+        const double cell = config.extent / static_cast<double>(side);
+        x = (static_cast<double>(group_id % side) + 0.5) * cell;
+        y = (static_cast<double>(group_id / side) + 0.5) * cell;
+    } else {
+        x = rng.uniform(0.0, config.extent);
+        y = rng.uniform(0.0, config.extent);
+    }
+
+    // Move straddling groups onto the nearest boundary line on one axis
+    if (config.boundary_spacing > 0.0 && rng.uniform() < config.straddle_fraction) {
+        double& axis = (rng.next() & 1) ? x : y;
+        axis = std::round(axis / config.boundary_spacing) * config.boundary_spacing;
+    }
+    return {clamp_coord(x, config), clamp_coord(y, config)};
+}
+
+// Output of one chunk of points, formatted and ready to be appended
+struct ChunkOutput {
+    std::string points;
+    std::string categories;
+    std::string groups;
+};
+
+void append_number(std::string& out, double value, int decimals) {
+    char buffer[64];
+    auto res = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::fixed, decimals);
+    if (res.ec != std::errc()) {
+        throw std::runtime_error("Cannot format " + std::to_string(value) + " with " + std::to_string(decimals) +
+                                 " decimals");
+    }
+    out.append(buffer, res.ptr);
+}
+
+void append_number(std::string& out, int64_t value) {
+    char buffer[24];
+    auto res = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, res.ptr);
+}
+
+// Groups never span chunks, so a chunk can be generated from its index
+// alone. The first pass only counts groups; group ids are then numbered
+// consecutively across chunks from the prefix sums of those counts.
+int64_t count_groups(const GeneratorConfig& config, int64_t chunk, int64_t chunk_points) {
+    Random sizes = Random::stream(config.seed, kGroupSizes, static_cast<uint64_t>(chunk));
+    int64_t groups = 0;
+    for (int64_t done = 0; done < chunk_points; ++groups) {
+        done += next_group_size(sizes, config);
+    }
+    return groups;
+}
+
+void generate_chunk(const GeneratorConfig& config, int64_t chunk, int64_t chunk_points,
+                    int64_t first_group, int64_t total_groups, ChunkOutput& out) {
+    Random sizes = Random::stream(config.seed, kGroupSizes, static_cast<uint64_t>(chunk));
+    Random rng = Random::stream(config.seed, kPoints, static_cast<uint64_t>(chunk));
+
+    out.points.clear();
+    out.categories.clear();
+    out.groups.clear();
+    out.points.reserve(static_cast<size_t>(chunk_points) * static_cast<size_t>(2 * (config.decimals + 7)));
+    out.categories.reserve(static_cast<size_t>(chunk_points) * 4);
+    out.groups.reserve(static_cast<size_t>(chunk_points) * 10);
+
+    int64_t group_id = first_group;
+    for (int64_t done = 0; done < chunk_points; ++group_id) {
+        const int64_t size = std::min(next_group_size(sizes, config), chunk_points - done);
+        const auto center = group_center(rng, config, group_id, total_groups);
+
+        for (int64_t i = 0; i < size; ++i) {
+            const double x = clamp_coord(center.first + rng.uniform(-config.group_radius, config.group_radius), config);
+            const double y = clamp_coord(center.second + rng.uniform(-config.group_radius, config.group_radius), config);
+
+            append_number(out.points, x, config.decimals);
+            out.points.push_back(' ');
+            append_number(out.points, y, config.decimals);
+            out.points.push_back('\n');
+            append_number(out.categories, next_category(rng, config));
+            out.categories.push_back('\n');
+            append_number(out.groups, group_id);
+            out.groups.push_back('\n');
+        }
+        done += size;
+    }
+}
+
+class OutputFile {
+public:
+    explicit OutputFile(const fs::path& path) : file_(std::fopen(path.string().c_str(), "wb")), path_(path) {
+        if (!file_) {
+            throw std::runtime_error("Cannot open file: " + path.string());
+        }
+    }
+    ~OutputFile() {
+        if (file_) std::fclose(file_);
+    }
+
+    void write(const std::string& data) {
+        if (std::fwrite(data.data(), 1, data.size(), file_) != data.size()) {
+            throw std::runtime_error("Cannot write file: " + path_.string());
+        }
+    }
+
+    void close() {
+        if (std::fclose(file_) != 0) {
+            file_ = nullptr;
+            throw std::runtime_error("Cannot write file: " + path_.string());
+        }
+        file_ = nullptr;
+    }
+
+private:
+    std::FILE* file_;
+    fs::path path_;
+};
+
+std::string rect_json(double x_min, double y_min, double x_max, double y_max, int decimals) {
+    std::string out = "{ \"p_min\": { \"x\": ";
+    append_number(out, x_min, decimals);
+    out += ", \"y\": ";
+    append_number(out, y_min, decimals);
+    out += " }, \"p_max\": { \"x\": ";
+    append_number(out, x_max, decimals);
+    out += ", \"y\": ";
+    append_number(out, y_max, decimals);
+    out += " } }";
+    return out;
+}
+
+// Crop whose edges lie on boundary lines, so straddling groups sit on them
+std::string random_crop(Random& rng, const GeneratorConfig& config, int64_t total_groups) {
+    const double spacing = config.boundary_spacing > 0.0 ? config.boundary_spacing : config.extent / 10.0;
+    const int64_t lines = std::max<int64_t>(1, static_cast<int64_t>(config.extent / spacing));
+    auto edge = [&](int64_t line) { return std::min(static_cast<double>(line) * spacing, config.extent); };
+
+    const int64_t x0 = static_cast<int64_t>(rng.below(static_cast<uint64_t>(lines)));
+    const int64_t y0 = static_cast<int64_t>(rng.below(static_cast<uint64_t>(lines)));
+    const int64_t w = 1 + static_cast<int64_t>(rng.below(static_cast<uint64_t>(std::max<int64_t>(1, lines / 3))));
+    const int64_t h = 1 + static_cast<int64_t>(rng.below(static_cast<uint64_t>(std::max<int64_t>(1, lines / 3))));
+
+    std::string crop = "{ \"operator_crop\": { \"region\": " +
+                       rect_json(edge(x0), edge(y0), edge(x0 + w), edge(y0 + h), config.decimals);
+    if (rng.uniform() < 0.3) {
+        crop += ", \"category\": " + std::to_string(next_category(rng, config));
+    }
+    if (rng.uniform() < 0.2 && total_groups > 0) {
+        crop += ", \"one_of_groups\": [";
+        const int count = 1 + static_cast<int>(rng.below(16));
+        for (int i = 0; i < count; ++i) {
+            if (i > 0) crop += ", ";
+            crop += std::to_string(rng.below(static_cast<uint64_t>(total_groups)));
+        }
+        crop += "]";
+    }
+    if (rng.uniform() < 0.3) {
+        crop += ", \"proper\": true";
+    }
+    return crop + " } }";
+}
+
+std::string random_operator(Random& rng, const GeneratorConfig& config, int64_t total_groups, int depth) {
+    if (depth <= 0 || rng.uniform() < 0.4) {
+        return random_crop(rng, config, total_groups);
+    }
+
+    const int operands = 2 + static_cast<int>(rng.below(3));
+    std::string op = std::string("{ \"") + ((rng.next() & 1) ? "operator_and" : "operator_or") + "\": [";
+    for (int i = 0; i < operands; ++i) {
+        op += (i > 0) ? ", " : " ";
+        op += random_operator(rng, config, total_groups, depth - 1);
+    }
+    return op + " ] }";
+}
+
+void write_queries(const fs::path& dir, const GeneratorConfig& config, int64_t total_groups, int count, int depth) {
+    fs::create_directories(dir);
+
+    for (int q = 0; q < count; ++q) {
+        Random rng = Random::stream(config.seed, kQueries, static_cast<uint64_t>(q));
+
+        // Valid region covers most of the extent, with boundary-aligned edges
+        const double margin = config.boundary_spacing > 0.0 ? config.boundary_spacing : 0.0;
+        std::string query = "{\n  \"valid_region\": " +
+                            rect_json(rng.uniform() < 0.5 ? 0.0 : margin, 0.0, config.extent,
+                                      rng.uniform() < 0.5 ? config.extent : config.extent - margin, config.decimals) +
+                            ",\n  \"query\": " + random_operator(rng, config, total_groups, depth) + "\n}\n";
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "query_%04d.json", q);
+        OutputFile file(dir / name);
+        file.write(query);
+        file.close();
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+    // Validate required --output_directory flag
+    if (FLAGS_output_directory.empty()) {
+        std::cerr << "Error: --output_directory is a required argument." << std::endl;
+        return 1;
+    }
+    if (FLAGS_distribution != "uniform" && FLAGS_distribution != "clustered" && FLAGS_distribution != "grid") {
+        std::cerr << "Error: --distribution must be uniform, clustered or grid." << std::endl;
+        return 1;
+    }
+    if (FLAGS_group_size_distribution != "fixed" && FLAGS_group_size_distribution != "uniform" &&
+        FLAGS_group_size_distribution != "geometric") {
+        std::cerr << "Error: --group_size_distribution must be fixed, uniform or geometric." << std::endl;
+        return 1;
+    }
+    if (FLAGS_points < 0 || FLAGS_extent <= 0.0 || FLAGS_categories < 1 || FLAGS_clusters < 1 || FLAGS_decimals < 0 ||
+        FLAGS_decimals > 17) {
+        std::cerr << "Error: --points must be non-negative; --extent, --categories, --clusters must be positive; "
+                     "--decimals must be 0 to 17." << std::endl;
+        return 1;
+    }
+
+    try {
+        GeneratorConfig config;
+        config.points = FLAGS_points;
+        config.seed = FLAGS_seed;
+        config.extent = FLAGS_extent;
+        config.distribution = FLAGS_distribution;
+        config.cluster_sigma = FLAGS_cluster_spread * FLAGS_extent;
+        config.category_cdf = zipf_cdf(FLAGS_categories, FLAGS_category_skew);
+        config.group_size = FLAGS_group_size;
+        config.group_size_distribution = FLAGS_group_size_distribution;
+        config.group_radius = FLAGS_group_radius;
+        config.straddle_fraction = FLAGS_straddle_fraction;
+        config.boundary_spacing = FLAGS_boundary_spacing;
+        config.decimals = FLAGS_decimals;
+
+        Random centers = Random::stream(config.seed, kClusterCenters, 0);
+        for (int c = 0; c < FLAGS_clusters; ++c) {
+            const double x = centers.uniform(0.0, config.extent);
+            const double y = centers.uniform(0.0, config.extent);
+            config.cluster_centers.emplace_back(x, y);
+        }
+
+        // Fixed chunk size: the output must not depend on the thread count
+        const int64_t chunk_size = 1 << 20;
+        const int64_t chunks = (config.points + chunk_size - 1) / chunk_size;
+        const size_t threads = FLAGS_threads > 0
+            ? static_cast<size_t>(FLAGS_threads)
+            : std::max<size_t>(1, std::thread::hardware_concurrency());
+        auto points_in = [&](int64_t chunk) { return std::min(chunk_size, config.points - chunk * chunk_size); };
+
+        std::vector<int64_t> first_group(static_cast<size_t>(chunks) + 1, 0);
+        for (int64_t chunk = 0; chunk < chunks; ++chunk) {
+            first_group[static_cast<size_t>(chunk) + 1] = first_group[static_cast<size_t>(chunk)] + count_groups(config, chunk, points_in(chunk));
+        }
+        const int64_t total_groups = first_group.back();
+
+        const fs::path dir(FLAGS_output_directory);
+        fs::create_directories(dir);
+        OutputFile points_file(dir / "points.txt");
+        OutputFile categories_file(dir / "categories.txt");
+        OutputFile groups_file(dir / "groups.txt");
+
+        // Generate one wave of chunks in parallel, then append them in order
+        std::vector<ChunkOutput> wave(threads);
+        for (int64_t base = 0; base < chunks; base += static_cast<int64_t>(threads)) {
+            const size_t wave_size = static_cast<size_t>(std::min<int64_t>(static_cast<int64_t>(threads), chunks - base));
+            std::vector<std::thread> workers;
+            std::vector<std::exception_ptr> errors(wave_size);
+            for (size_t w = 0; w < wave_size; ++w) {
+                const int64_t chunk = base + static_cast<int64_t>(w);
+                workers.emplace_back([&, chunk, w] {
+                    try {
+                        generate_chunk(config, chunk, points_in(chunk), first_group[static_cast<size_t>(chunk)], total_groups, wave[w]);
+                    } catch (...) {
+                        errors[w] = std::current_exception();
+                    }
+                });
+            }
+            for (auto& worker : workers) {
+                worker.join();
+            }
+            for (const auto& error : errors) {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+            }
+            for (size_t w = 0; w < wave_size; ++w) {
+                points_file.write(wave[w].points);
+                categories_file.write(wave[w].categories);
+                groups_file.write(wave[w].groups);
+            }
+        }
+
+        points_file.close();
+        categories_file.close();
+        groups_file.close();
+
+        std::cout << "Generated " << config.points << " points in " << total_groups << " groups into " << dir << std::endl;
+
+        if (FLAGS_queries > 0) {
+            write_queries(dir / "queries", config, total_groups, FLAGS_queries, FLAGS_query_depth);
+            std::cout << "Wrote " << FLAGS_queries << " queries to " << (dir / "queries") << std::endl;
+        }
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
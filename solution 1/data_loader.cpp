@@ -4,21 +4,363 @@
 #include <string>
 #include <vector>
 #include <set>
-#include <filesystem>
-#include <gflags/gflags.h>
+#include <map>
+#include <numeric>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+#include <charconv>
+#include <optional>
+#include <random>
 #include <pqxx/pqxx>
 
-namespace fs = std::filesystem;
+#include "data_loader.h"
 
-struct Point {
-    double x, y;
-};
+namespace loader {
 
-struct RegionData {
-    Point coord;
-    int category;
-    int group_id;
-};
+Quantization compute_quantization(const std::vector<RegionData>& regions, double scale) {
+    Quantization quant;
+    if (scale <= 0.0 || regions.empty()) {
+        return quant;
+    }
+
+    double min_x = regions[0].coord.x, max_x = regions[0].coord.x;
+    double min_y = regions[0].coord.y, max_y = regions[0].coord.y;
+    for (const auto& region : regions) {
+        min_x = std::min(min_x, region.coord.x);
+        max_x = std::max(max_x, region.coord.x);
+        min_y = std::min(min_y, region.coord.y);
+        max_y = std::max(max_y, region.coord.y);
+    }
+
+    // The offset is the dataset minimum snapped to the grid, so every
+    // quantized value is non-negative.
+    quant.scale = scale;
+    quant.offset_x = std::floor(min_x / scale) * scale;
+    quant.offset_y = std::floor(min_y / scale) * scale;
+
+    const double max_steps = static_cast<double>(std::numeric_limits<int32_t>::max());
+    if ((max_x - quant.offset_x) / scale > max_steps || (max_y - quant.offset_y) / scale > max_steps) {
+        throw std::runtime_error("Coordinate range does not fit into int32 at scale " + std::to_string(scale));
+    }
+
+    return quant;
+}
+
+int32_t quantize(double value, double offset, double scale) {
+    return static_cast<int32_t>(std::llround((value - offset) / scale));
+}
+
+std::string format_double(double value) {
+    std::ostringstream oss;
+    oss.precision(std::numeric_limits<double>::max_digits10);
+    oss << value;
+    return oss.str();
+}
+
+namespace {
+
+// Inner edges that split the values into about parts runs of equal size.
+// Edges are strictly increasing, so a heavily repeated value merges parts.
+std::vector<double> quantile_edges(std::vector<double>& values, int parts) {
+    std::vector<double> edges;
+    if (values.empty()) {
+        return edges;
+    }
+    std::sort(values.begin(), values.end());
+    for (int k = 1; k < parts; ++k) {
+        const double edge = values[values.size() * static_cast<size_t>(k) / static_cast<size_t>(parts)];
+        if (edges.empty() || edge > edges.back()) {
+            edges.push_back(edge);
+        }
+    }
+    return edges;
+}
+
+// FROM (lo) TO (hi) of the i-th of the ranges the edges split a column into
+std::string range_bounds(const std::vector<double>& edges, size_t i) {
+    return "FROM (" + (i == 0 ? std::string("MINVALUE") : format_double(edges[i - 1])) + ") TO (" +
+           (i == edges.size() ? std::string("MAXVALUE") : format_double(edges[i])) + ")";
+}
+
+// The partitioned inspection_region and its partitions. A primary key of a
+// partitioned table has to contain the partition key, so it is (id, key);
+// the loader numbers the rows itself, which keeps id unique.
+void create_partitioned_region_table(pqxx::work& txn, const Partitioning& partitioning) {
+    const std::string x = partitioning.quantized ? "qx" : "coord_x";
+    const std::string y = partitioning.quantized ? "qy" : "coord_y";
+    const bool tiles = partitioning.layout == PartitionLayout::Tiles;
+
+    txn.exec(
+        "CREATE TABLE inspection_region ("
+        "id BIGINT NOT NULL, group_id BIGINT, coord_x FLOAT, coord_y FLOAT, category INTEGER, qx INTEGER, qy INTEGER, "
+        "PRIMARY KEY (id, " + (tiles ? y + ", " + x : std::string("category")) + ")) "
+        "PARTITION BY " + (tiles ? "RANGE (" + y + ")" : std::string("LIST (category)")));
+
+    if (!tiles) {
+        for (size_t i = 0; i < partitioning.categories.size(); ++i) {
+            txn.exec("CREATE TABLE inspection_region_c" + std::to_string(i) + " PARTITION OF inspection_region "
+                     "FOR VALUES IN (" + std::to_string(partitioning.categories[i]) + ")");
+        }
+        txn.exec("CREATE TABLE inspection_region_other PARTITION OF inspection_region DEFAULT");
+        return;
+    }
+
+    static const std::vector<double> kNoEdges;
+    for (size_t band = 0; band <= partitioning.y_edges.size(); ++band) {
+        const std::string band_table = "inspection_region_b" + std::to_string(band);
+        txn.exec("CREATE TABLE " + band_table + " PARTITION OF inspection_region " +
+                 range_bounds(partitioning.y_edges, band) + " PARTITION BY RANGE (" + x + ")");
+
+        const std::vector<double>& x_edges = band < partitioning.x_edges.size() ? partitioning.x_edges[band] : kNoEdges;
+        for (size_t tile = 0; tile <= x_edges.size(); ++tile) {
+            txn.exec("CREATE TABLE " + band_table + "_t" + std::to_string(tile) + " PARTITION OF " + band_table + " " +
+                     range_bounds(x_edges, tile));
+        }
+    }
+}
+
+// Throws unless every region's coordinates are within the int32 range of
+// quant's grid, as load time checks for the loaded regions
+void check_quantizable(const std::vector<RegionData>& regions, const Quantization& quant) {
+    const double lowest = static_cast<double>(std::numeric_limits<int32_t>::min());
+    const double highest = static_cast<double>(std::numeric_limits<int32_t>::max());
+    for (const auto& region : regions) {
+        const double steps_x = std::round((region.coord.x - quant.offset_x) / quant.scale);
+        const double steps_y = std::round((region.coord.y - quant.offset_y) / quant.scale);
+        if (!(steps_x >= lowest && steps_x <= highest && steps_y >= lowest && steps_y <= highest)) {
+            throw std::runtime_error("Point (" + format_double(region.coord.x) + ", " + format_double(region.coord.y) +
+                                     ") does not fit into int32 at scale " + format_double(quant.scale) +
+                                     " from offset (" + format_double(quant.offset_x) + ", " +
+                                     format_double(quant.offset_y) + ")");
+        }
+    }
+}
+
+// Inserts the regions with ids from first_id on, and the groups they need.
+// sample_keys is per region, or empty to leave sample_key NULL.
+void insert_regions(pqxx::work& txn, const std::vector<RegionData>& regions, const Quantization& quant,
+                    long long first_id, const std::vector<float>& sample_keys) {
+    // Collect unique groups
+    std::set<int> unique_groups;
+    for (const auto& region : regions) {
+        unique_groups.insert(region.group_id);
+    }
+    
+    // Insert groups
+    for (int group_id : unique_groups) {
+        txn.exec_params(
+            "INSERT INTO inspection_group (id) VALUES ($1) ON CONFLICT (id) DO NOTHING",
+            group_id
+        );
+    }
+    
+    // Insert regions
+    for (size_t i = 0; i < regions.size(); ++i) {
+        const auto& region = regions[i];
+        const long long id = first_id + static_cast<long long>(i);
+        const std::optional<float> sample_key =
+            sample_keys.empty() ? std::nullopt : std::optional<float>(sample_keys[i]);
+        if (quant.enabled()) {
+            // Quantized rows only carry the integer coordinates; the FLOAT
+            // columns stay NULL so the row does not pay for both.
+            txn.exec_params(
+                "INSERT INTO inspection_region (id, group_id, qx, qy, category, sample_key) "
+                "VALUES ($1, $2, $3, $4, $5, $6)",
+                id,
+                region.group_id,
+                quantize(region.coord.x, quant.offset_x, quant.scale),
+                quantize(region.coord.y, quant.offset_y, quant.scale),
+                region.category,
+                sample_key
+            );
+        } else {
+            txn.exec_params(
+                "INSERT INTO inspection_region (id, group_id, coord_x, coord_y, category, sample_key) "
+                "VALUES ($1, $2, $3, $4, $5, $6)",
+                id,
+                region.group_id,
+                region.coord.x,
+                region.coord.y,
+                region.category,
+                sample_key
+            );
+        }
+    }
+}
+
+// Comma-separated list for an IN (...), NULL when empty
+template <typename T>
+std::string sql_list(const std::set<T>& values) {
+    std::string list;
+    for (const T& value : values) {
+        list += (list.empty() ? "" : ", ") + std::to_string(value);
+    }
+    return list.empty() ? "NULL" : list;
+}
+
+// (Re)computes the postings of the groups in inspection_region that match
+// the condition on group_id, e.g. "IS NOT NULL"
+void insert_group_postings(pqxx::work& txn, const std::string& group_condition) {
+    txn.exec("DELETE FROM group_posting WHERE group_id " + group_condition);
+    // Consecutive ids of a group share id - (rank of the id in the group),
+    // which numbers the runs
+    txn.exec(
+        "INSERT INTO group_posting (group_id, first_id, last_id) "
+        "SELECT group_id, MIN(id), MAX(id) "
+        "FROM (SELECT id, group_id, id - ROW_NUMBER() OVER (PARTITION BY group_id ORDER BY id) AS run "
+        "      FROM inspection_region WHERE group_id " + group_condition + ") runs "
+        "GROUP BY group_id, run");
+}
+
+} // namespace
+
+PartitionLayout parse_partition_layout(const std::string& name) {
+    if (name == "none") return PartitionLayout::None;
+    if (name == "tiles") return PartitionLayout::Tiles;
+    if (name == "category") return PartitionLayout::Category;
+    throw std::runtime_error("Unknown partition layout: " + name + " (expected none, tiles or category)");
+}
+
+Partitioning compute_partitioning(const std::vector<RegionData>& regions, const Quantization& quant,
+                                  PartitionLayout layout, int tiles_per_side) {
+    Partitioning partitioning;
+    partitioning.layout = layout;
+    partitioning.quantized = quant.enabled();
+
+    if (layout == PartitionLayout::Category) {
+        std::set<int> categories;
+        for (const auto& region : regions) {
+            categories.insert(region.category);
+        }
+        partitioning.categories.assign(categories.begin(), categories.end());
+    } else if (layout == PartitionLayout::Tiles) {
+        if (tiles_per_side < 1) {
+            throw std::runtime_error("tiles_per_side must be at least 1");
+        }
+        // Edges are placed in the domain of the columns the rows are stored in
+        auto stored = [&quant](double value, double offset) {
+            return quant.enabled() ? static_cast<double>(quantize(value, offset, quant.scale)) : value;
+        };
+        std::vector<double> ys;
+        ys.reserve(regions.size());
+        for (const auto& region : regions) {
+            ys.push_back(stored(region.coord.y, quant.offset_y));
+        }
+        partitioning.y_edges = quantile_edges(ys, tiles_per_side);
+
+        std::vector<std::vector<double>> band_xs(partitioning.y_edges.size() + 1);
+        for (const auto& region : regions) {
+            const double y = stored(region.coord.y, quant.offset_y);
+            const size_t band = static_cast<size_t>(
+                std::upper_bound(partitioning.y_edges.begin(), partitioning.y_edges.end(), y) - partitioning.y_edges.begin());
+            band_xs[band].push_back(stored(region.coord.x, quant.offset_x));
+        }
+        for (auto& xs : band_xs) {
+            partitioning.x_edges.push_back(quantile_edges(xs, tiles_per_side));
+        }
+    }
+    return partitioning;
+}
+
+DatasetStatistics compute_statistics(const std::vector<RegionData>& regions, const Quantization& quant, int grid_size) {
+    if (grid_size < 1) {
+        throw std::runtime_error("grid_size must be at least 1");
+    }
+    DatasetStatistics statistics;
+
+    // The coordinates the query engine reads back
+    auto visible = [&quant](double value, double offset) {
+        return quant.enabled() ? offset + static_cast<double>(quantize(value, offset, quant.scale)) * quant.scale : value;
+    };
+    std::vector<Point> points;
+    points.reserve(regions.size());
+    for (const auto& region : regions) {
+        points.push_back({visible(region.coord.x, quant.offset_x), visible(region.coord.y, quant.offset_y)});
+        ++statistics.category_points[region.category];
+    }
+
+    std::vector<size_t> order(points.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&points](size_t a, size_t b) { return points[a].y < points[b].y; });
+
+    // Within a cell the sample keys are the points' ranks in a fixed random
+    // order, spread evenly over [0, 1)
+    statistics.sample_keys.assign(regions.size(), 0.0f);
+    std::mt19937 shuffle(0x5eed);
+    std::vector<size_t> ranks;
+
+    const size_t parts = static_cast<size_t>(grid_size);
+    for (size_t band = 0; band < parts; ++band) {
+        const auto band_begin = order.begin() + static_cast<std::ptrdiff_t>(order.size() * band / parts);
+        const auto band_end = order.begin() + static_cast<std::ptrdiff_t>(order.size() * (band + 1) / parts);
+        std::sort(band_begin, band_end, [&points](size_t a, size_t b) { return points[a].x < points[b].x; });
+
+        const size_t band_size = static_cast<size_t>(band_end - band_begin);
+        for (size_t c = 0; c < parts; ++c) {
+            const auto begin = band_begin + static_cast<std::ptrdiff_t>(band_size * c / parts);
+            const auto end = band_begin + static_cast<std::ptrdiff_t>(band_size * (c + 1) / parts);
+            if (begin == end) {
+                continue;
+            }
+            const Point& first = points[*begin];
+            StatisticsCell cell{first.x, first.y, first.x, first.y, static_cast<long long>(end - begin)};
+            for (auto it = begin; it != end; ++it) {
+                const Point& p = points[*it];
+                cell.x_min = std::min(cell.x_min, p.x);
+                cell.y_min = std::min(cell.y_min, p.y);
+                cell.x_max = std::max(cell.x_max, p.x);
+                cell.y_max = std::max(cell.y_max, p.y);
+            }
+            statistics.cells.push_back(cell);
+
+            ranks.resize(static_cast<size_t>(end - begin));
+            std::iota(ranks.begin(), ranks.end(), 0);
+            std::shuffle(ranks.begin(), ranks.end(), shuffle);
+            for (auto it = begin; it != end; ++it) {
+                const size_t rank = ranks[static_cast<size_t>(it - begin)];
+                statistics.sample_keys[*it] = static_cast<float>((rank + 0.5) / static_cast<double>(ranks.size()));
+            }
+        }
+    }
+
+    // Bounding box and size of every group, then their mean per size
+    struct GroupBox {
+        long long points = 0;
+        double x_min = 0.0, y_min = 0.0, x_max = 0.0, y_max = 0.0;
+    };
+    std::map<int, GroupBox> groups;
+    for (size_t i = 0; i < regions.size(); ++i) {
+        GroupBox& box = groups[regions[i].group_id];
+        const Point& p = points[i];
+        if (box.points++ == 0) {
+            box.x_min = box.x_max = p.x;
+            box.y_min = box.y_max = p.y;
+        } else {
+            box.x_min = std::min(box.x_min, p.x);
+            box.y_min = std::min(box.y_min, p.y);
+            box.x_max = std::max(box.x_max, p.x);
+            box.y_max = std::max(box.y_max, p.y);
+        }
+    }
+    std::map<long long, GroupSizeStatistics> sizes;
+    for (const auto& entry : groups) {
+        const GroupBox& box = entry.second;
+        GroupSizeStatistics& size = sizes[box.points];
+        size.size = static_cast<int>(box.points);
+        ++size.groups;
+        size.mean_width += box.x_max - box.x_min;
+        size.mean_height += box.y_max - box.y_min;
+    }
+    for (auto& entry : sizes) {
+        GroupSizeStatistics size = entry.second;
+        size.mean_width /= static_cast<double>(size.groups);
+        size.mean_height /= static_cast<double>(size.groups);
+        statistics.group_sizes.push_back(size);
+    }
+    return statistics;
+}
 
 std::vector<Point> read_points(const std::string& filepath) {
     std::vector<Point> points;
@@ -60,7 +402,38 @@ std::vector<int> read_integers(const std::string& filepath) {
     return values;
 }
 
-void create_schema(pqxx::connection& conn) {
+std::vector<long long> read_ids(const std::string& filepath) {
+    std::vector<long long> ids;
+    std::ifstream file(filepath);
+    
+    if (!file.is_open()) {
+        throw std::runtime_error("Cannot open file: " + filepath);
+    }
+    
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(file, line)) {
+        ++line_number;
+        const size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == std::string::npos) {
+            continue;
+        }
+        const size_t end = line.find_last_not_of(" \t\r") + 1;
+        long long id = 0;
+        const char* first = line.data() + begin;
+        const char* last = line.data() + end;
+        const std::from_chars_result res = std::from_chars(first, last, id);
+        if (res.ec != std::errc() || res.ptr != last) {
+            throw std::runtime_error("Not a region id on line " + std::to_string(line_number) + " of " + filepath +
+                                     ": " + line.substr(begin, end - begin));
+        }
+        ids.push_back(id);
+    }
+    
+    return ids;
+}
+
+void create_schema(pqxx::connection& conn, const Partitioning& partitioning) {
     pqxx::work txn(conn);
     
     // Create tables
@@ -71,18 +444,138 @@ void create_schema(pqxx::connection& conn) {
         )
     )");
     
-    txn.exec(R"(
-        CREATE TABLE IF NOT EXISTS inspection_region (
-            id BIGINT NOT NULL,
-            group_id BIGINT,
-            PRIMARY KEY (id)
-        )
-    )");
+    // A table cannot be partitioned in place, and the partition bounds
+    // depend on the data, so a partitioned layout always starts over
+    pqxx::result kind = txn.exec("SELECT relkind = 'p' FROM pg_class WHERE oid = to_regclass('inspection_region')");
+    const bool partitioned = !kind.empty() && kind[0][0].as<bool>();
+    if (partitioning.layout != PartitionLayout::None || partitioned) {
+        txn.exec("DROP TABLE IF EXISTS inspection_region CASCADE");
+    }
+    
+    if (partitioning.layout != PartitionLayout::None) {
+        create_partitioned_region_table(txn, partitioning);
+    } else {
+        txn.exec(R"(
+            CREATE TABLE IF NOT EXISTS inspection_region (
+                id BIGINT NOT NULL,
+                group_id BIGINT,
+                PRIMARY KEY (id)
+            )
+        )");
+    }
     
     // Add columns if they don't exist
     txn.exec("ALTER TABLE inspection_region ADD COLUMN IF NOT EXISTS coord_x FLOAT");
     txn.exec("ALTER TABLE inspection_region ADD COLUMN IF NOT EXISTS coord_y FLOAT");
     txn.exec("ALTER TABLE inspection_region ADD COLUMN IF NOT EXISTS category INTEGER");
+    txn.exec("ALTER TABLE inspection_region ADD COLUMN IF NOT EXISTS qx INTEGER");
+    txn.exec("ALTER TABLE inspection_region ADD COLUMN IF NOT EXISTS qy INTEGER");
+    txn.exec("ALTER TABLE inspection_region ADD COLUMN IF NOT EXISTS sample_key REAL");
+
+    // Proper crops look up every point of a group
+    txn.exec("CREATE INDEX IF NOT EXISTS idx_inspection_region_group ON inspection_region (group_id)");
+
+    // Paged queries walk the points in (y, x) order from a cursor. Only one
+    // pair of coordinate columns is filled, so each index skips the NULLs.
+    txn.exec("CREATE INDEX IF NOT EXISTS idx_inspection_region_yx ON inspection_region (coord_y, coord_x, id) "
+             "WHERE coord_y IS NOT NULL");
+    txn.exec("CREATE INDEX IF NOT EXISTS idx_inspection_region_qyx ON inspection_region (qy, qx, id) "
+             "WHERE qy IS NOT NULL");
+
+    // Approximate queries read the rows whose sample_key is below the
+    // sampled fraction
+    txn.exec("CREATE INDEX IF NOT EXISTS idx_inspection_region_sample ON inspection_region (sample_key) "
+             "WHERE sample_key IS NOT NULL");
+
+    // Per-dataset settings the query engine needs to interpret the data
+    txn.exec(R"(
+        CREATE TABLE IF NOT EXISTS dataset_metadata (
+            key TEXT NOT NULL,
+            value TEXT NOT NULL,
+            PRIMARY KEY (key)
+        )
+    )");
+    
+    // Change log for query subscriptions: a row image per inserted ('I') or
+    // deleted ('D') region, an update being both, and one 'R' entry when
+    // load_data replaces the dataset. Every change also notifies the
+    // region_changes channel once per transaction.
+    txn.exec(R"(
+        CREATE TABLE IF NOT EXISTS region_change (
+            seq BIGSERIAL NOT NULL,
+            op CHAR(1) NOT NULL,
+            id BIGINT,
+            group_id BIGINT,
+            coord_x FLOAT,
+            coord_y FLOAT,
+            qx INTEGER,
+            qy INTEGER,
+            PRIMARY KEY (seq)
+        )
+    )");
+    txn.exec(R"(
+        CREATE OR REPLACE FUNCTION log_region_change() RETURNS trigger AS $$
+        BEGIN
+            IF current_setting('inspection.log_changes', true) = 'off' THEN
+                RETURN NULL;
+            END IF;
+            -- Writers log one transaction at a time, so sequence numbers
+            -- are handed out in commit order and a reader that has seen
+            -- seq n has seen everything before it
+            PERFORM pg_advisory_xact_lock(hashtext('region_change'));
+            IF TG_OP IN ('UPDATE', 'DELETE') THEN
+                INSERT INTO region_change (op, id, group_id, coord_x, coord_y, qx, qy)
+                VALUES ('D', OLD.id, OLD.group_id, OLD.coord_x, OLD.coord_y, OLD.qx, OLD.qy);
+            END IF;
+            IF TG_OP IN ('UPDATE', 'INSERT') THEN
+                INSERT INTO region_change (op, id, group_id, coord_x, coord_y, qx, qy)
+                VALUES ('I', NEW.id, NEW.group_id, NEW.coord_x, NEW.coord_y, NEW.qx, NEW.qy);
+            END IF;
+            PERFORM pg_notify('region_changes', '');
+            RETURN NULL;
+        END
+        $$ LANGUAGE plpgsql
+    )");
+    txn.exec("DROP TRIGGER IF EXISTS region_change_log ON inspection_region");
+    txn.exec("CREATE TRIGGER region_change_log AFTER INSERT OR UPDATE OR DELETE ON inspection_region "
+             "FOR EACH ROW EXECUTE FUNCTION log_region_change()");
+
+    // Group postings written by build_group_postings
+    txn.exec(R"(
+        CREATE TABLE IF NOT EXISTS group_posting (
+            group_id BIGINT NOT NULL,
+            first_id BIGINT NOT NULL,
+            last_id BIGINT NOT NULL,
+            PRIMARY KEY (group_id, first_id)
+        )
+    )");
+
+    // Statistics catalog written by load_data; see DatasetStatistics
+    txn.exec(R"(
+        CREATE TABLE IF NOT EXISTS statistics_cell (
+            x_min FLOAT NOT NULL,
+            y_min FLOAT NOT NULL,
+            x_max FLOAT NOT NULL,
+            y_max FLOAT NOT NULL,
+            points BIGINT NOT NULL
+        )
+    )");
+    txn.exec(R"(
+        CREATE TABLE IF NOT EXISTS statistics_category (
+            category INTEGER NOT NULL,
+            points BIGINT NOT NULL,
+            PRIMARY KEY (category)
+        )
+    )");
+    txn.exec(R"(
+        CREATE TABLE IF NOT EXISTS statistics_group (
+            size INTEGER NOT NULL,
+            group_count BIGINT NOT NULL,
+            mean_width FLOAT NOT NULL,
+            mean_height FLOAT NOT NULL,
+            PRIMARY KEY (size)
+        )
+    )");
     
     // Add foreign key if it doesn't exist
     try {
@@ -107,110 +600,169 @@ void create_schema(pqxx::connection& conn) {
     std::cout << "Schema created successfully." << std::endl;
 }
 
-void load_data(pqxx::connection& conn, const std::vector<RegionData>& regions) {
+void store_quantization(pqxx::work& txn, const Quantization& quant) {
+    txn.exec("DELETE FROM dataset_metadata WHERE key LIKE 'quantization.%'");
+    if (!quant.enabled()) {
+        return;
+    }
+
+    const std::pair<const char*, double> entries[] = {
+        {"quantization.scale", quant.scale},
+        {"quantization.offset_x", quant.offset_x},
+        {"quantization.offset_y", quant.offset_y},
+    };
+    for (const auto& entry : entries) {
+        txn.exec_params(
+            "INSERT INTO dataset_metadata (key, value) VALUES ($1, $2)",
+            std::string(entry.first),
+            format_double(entry.second)
+        );
+    }
+}
+
+void build_group_postings(pqxx::work& txn) {
+    insert_group_postings(txn, "IS NOT NULL");
+    txn.exec("CLUSTER group_posting USING group_posting_pkey");
+
+    txn.exec("DELETE FROM dataset_metadata WHERE key = 'group_postings'");
+    txn.exec("INSERT INTO dataset_metadata (key, value) VALUES ('group_postings', 'id_ranges')");
+}
+
+void store_statistics(pqxx::work& txn, const DatasetStatistics& statistics) {
+    txn.exec("DELETE FROM statistics_cell");
+    txn.exec("DELETE FROM statistics_category");
+    txn.exec("DELETE FROM statistics_group");
+
+    // One multi-row INSERT per table; a catalog is at most a few thousand rows
+    auto insert = [&txn](const std::string& table, const std::vector<std::string>& rows) {
+        if (rows.empty()) {
+            return;
+        }
+        std::string sql = "INSERT INTO " + table + " VALUES ";
+        for (size_t i = 0; i < rows.size(); ++i) {
+            sql += (i ? ", (" : "(") + rows[i] + ")";
+        }
+        txn.exec(sql);
+    };
+
+    std::vector<std::string> rows;
+    for (const auto& cell : statistics.cells) {
+        rows.push_back(format_double(cell.x_min) + ", " + format_double(cell.y_min) + ", " +
+                       format_double(cell.x_max) + ", " + format_double(cell.y_max) + ", " + std::to_string(cell.points));
+    }
+    insert("statistics_cell (x_min, y_min, x_max, y_max, points)", rows);
+
+    rows.clear();
+    for (const auto& entry : statistics.category_points) {
+        rows.push_back(std::to_string(entry.first) + ", " + std::to_string(entry.second));
+    }
+    insert("statistics_category (category, points)", rows);
+
+    rows.clear();
+    for (const auto& size : statistics.group_sizes) {
+        rows.push_back(std::to_string(size.size) + ", " + std::to_string(size.groups) + ", " +
+                       format_double(size.mean_width) + ", " + format_double(size.mean_height));
+    }
+    insert("statistics_group (size, group_count, mean_width, mean_height)", rows);
+
+    txn.exec("DELETE FROM dataset_metadata WHERE key = 'sample_keys'");
+    if (!statistics.sample_keys.empty()) {
+        txn.exec("INSERT INTO dataset_metadata (key, value) VALUES ('sample_keys', 'stratified')");
+    }
+}
+
+void load_data(pqxx::connection& conn, const std::vector<RegionData>& regions, const Quantization& quant,
+               int statistics_grid) {
     pqxx::work txn(conn);
     
+    // A replaced dataset is one 'R' entry in the change log rather than a
+    // row image per region
+    txn.exec("SET LOCAL inspection.log_changes = 'off'");
+    
     // Clear existing data
     txn.exec("DELETE FROM inspection_region");
     txn.exec("DELETE FROM inspection_group");
     
-    // Collect unique groups
-    std::set<int> unique_groups;
-    for (const auto& region : regions) {
-        unique_groups.insert(region.group_id);
-    }
+    const DatasetStatistics statistics = compute_statistics(regions, quant, statistics_grid);
+    insert_regions(txn, regions, quant, 0, statistics.sample_keys);
+
+    store_quantization(txn, quant);
+    build_group_postings(txn);
+    store_statistics(txn, statistics);
     
-    // Insert groups
-    for (int group_id : unique_groups) {
-        txn.exec_params(
-            "INSERT INTO inspection_group (id) VALUES ($1) ON CONFLICT (id) DO NOTHING",
-            group_id
-        );
-    }
-    
-    // Insert regions
-    for (size_t i = 0; i < regions.size(); ++i) {
-        const auto& region = regions[i];
-        txn.exec_params(
-            "INSERT INTO inspection_region (id, group_id, coord_x, coord_y, category) "
-            "VALUES ($1, $2, $3, $4, $5)",
-            static_cast<long long>(i),
-            region.group_id,
-            region.coord.x,
-            region.coord.y,
-            region.category
-        );
-    }
+    txn.exec("SELECT pg_advisory_xact_lock(hashtext('region_change'))");
+    txn.exec("DELETE FROM region_change");
+    txn.exec("INSERT INTO region_change (op) VALUES ('R')");
+    txn.exec("NOTIFY region_changes");
     
     txn.commit();
     std::cout << "Loaded " << regions.size() << " regions into database." << std::endl;
 }
 
-// --- Command-line Flag Definitions ---
-DEFINE_string(data_directory, "", "Path to the directory containing data files (points.txt, categories.txt, groups.txt).");
-
-int main(int argc, char* argv[]) {
-    gflags::ParseCommandLineFlags(&argc, &argv, true);
-    const std::filesystem::path data_dir(FLAGS_data_directory);
-
-    // Validate required --data_directory flag
-    if (FLAGS_data_directory.empty()) {
-        std::cerr << "Error: --data_directory is a required argument." << std::endl;
-        return 1;
+Quantization read_quantization(pqxx::work& txn) {
+    Quantization quant;
+    for (const auto& row : txn.exec("SELECT key, value FROM dataset_metadata WHERE key LIKE 'quantization.%'")) {
+        const std::string key = row[0].as<std::string>();
+        const double value = std::stod(row[1].as<std::string>());
+        if (key == "quantization.scale") quant.scale = value;
+        else if (key == "quantization.offset_x") quant.offset_x = value;
+        else if (key == "quantization.offset_y") quant.offset_y = value;
     }
+    return quant;
+}
 
-    std::cout << "Data directory: " << data_dir << std::endl;
+long long append_data(pqxx::connection& conn, const std::vector<RegionData>& regions) {
+    pqxx::work txn(conn);
+    
+    // Taken before reading MAX(id), so concurrent appends number their rows
+    // one after the other; the change log trigger takes the same lock
+    txn.exec("SELECT pg_advisory_xact_lock(hashtext('region_change'))");
+    
+    // Appends reuse the stored fixed-point grid, so old and new rows compare
+    // alike, and must fit into it
+    const Quantization quant = read_quantization(txn);
+    if (quant.enabled()) {
+        check_quantizable(regions, quant);
+    }
+    const long long first_id = txn.exec("SELECT COALESCE(MAX(id) + 1, 0) FROM inspection_region")[0][0].as<long long>();
+    // Appended rows are sampled uniformly rather than per cell
+    std::mt19937 random(static_cast<std::mt19937::result_type>(first_id));
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::vector<float> sample_keys(regions.size());
+    for (float& key : sample_keys) {
+        key = uniform(random);
+    }
+    insert_regions(txn, regions, quant, first_id, sample_keys);
+    
+    std::set<int> groups;
+    for (const auto& region : regions) {
+        groups.insert(region.group_id);
+    }
+    insert_group_postings(txn, "IN (" + sql_list(groups) + ")");
+    
+    txn.commit();
+    std::cout << "Appended " << regions.size() << " regions from id " << first_id << "." << std::endl;
+    return first_id;
+}
 
-    try {
-        // Read data files
-        fs::path points_file = fs::path(data_dir) / "points.txt";
-        fs::path categories_file = fs::path(data_dir) / "categories.txt";
-        fs::path groups_file = fs::path(data_dir) / "groups.txt";
-        
-        std::cout << "Reading points from: " << points_file << std::endl;
-        auto points = read_points(points_file.string());
-        
-        std::cout << "Reading categories from: " << categories_file << std::endl;
-        auto categories = read_integers(categories_file.string());
-        
-        std::cout << "Reading groups from: " << groups_file << std::endl;
-        auto groups = read_integers(groups_file.string());
-        
-        // Validate data consistency
-        if (points.size() != categories.size() || points.size() != groups.size()) {
-            throw std::runtime_error("Data file sizes don't match!");
-        }
-        
-        std::cout << "Read " << points.size() << " regions." << std::endl;
-        
-        // Combine data
-        std::vector<RegionData> regions;
-        for (size_t i = 0; i < points.size(); ++i) {
-            regions.push_back({points[i], categories[i], groups[i]});
-        }
-        
-        // Connect to PostgreSQL
-        // Modify connection string as needed
-        pqxx::connection conn("dbname=inspection_db user=postgres password=postgres host=localhost port=5432");
-        
-        if (!conn.is_open()) {
-            throw std::runtime_error("Cannot connect to database");
-        }
-        
-        std::cout << "Connected to database: " << conn.dbname() << std::endl;
-        
-        // Create schema
-        create_schema(conn);
-        
-        // Load data
-        load_data(conn, regions);
-        
-        std::cout << "Data loading completed successfully!" << std::endl;
-        
-    } catch (const std::exception& e) {
-        std::cerr << "Error: " << e.what() << std::endl;
-        return 1;
+void delete_regions(pqxx::connection& conn, const std::vector<long long>& ids) {
+    pqxx::work txn(conn);
+    
+    const std::set<long long> unique_ids(ids.begin(), ids.end());
+    std::set<long long> groups;
+    for (const auto& row : txn.exec("DELETE FROM inspection_region WHERE id IN (" + sql_list(unique_ids) + ") "
+                                    "RETURNING group_id")) {
+        if (!row[0].is_null()) groups.insert(row[0].as<long long>());
     }
     
-    return 0;
+    // Groups left without regions go too
+    const std::string group_list = sql_list(groups);
+    txn.exec("DELETE FROM inspection_group g WHERE g.id IN (" + group_list + ") "
+             "AND NOT EXISTS (SELECT 1 FROM inspection_region r WHERE r.group_id = g.id)");
+    insert_group_postings(txn, "IN (" + group_list + ")");
+    
+    txn.commit();
+    std::cout << "Deleted " << unique_ids.size() << " regions." << std::endl;
 }
+
+} // namespace loader
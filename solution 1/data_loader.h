@@ -0,0 +1,134 @@
+#ifndef DATA_LOADER_H
+#define DATA_LOADER_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <pqxx/pqxx>
+
+// The loader has its own Point type, so its API lives in a namespace to
+// stay apart from the query engine's when both are linked together.
+namespace loader {
+
+struct Point {
+    double x, y;
+};
+
+struct RegionData {
+    Point coord;
+    int category;
+    int group_id;
+};
+
+// Fixed-point representation of the coordinates: coord = offset + q * scale,
+// with q stored as a 32-bit integer. Disabled when scale is 0.
+struct Quantization {
+    double scale = 0.0;
+    double offset_x = 0.0;
+    double offset_y = 0.0;
+
+    bool enabled() const { return scale > 0.0; }
+};
+
+Quantization compute_quantization(const std::vector<RegionData>& regions, double scale);
+int32_t quantize(double value, double offset, double scale);
+
+// Physical layout of inspection_region. Tiles range-partitions the table on
+// the stored y column into bands, and each band on the stored x column into
+// tiles (qy / qx when quantized), so the coordinate ranges of a crop prune
+// the tiles it does not touch. Category list-partitions on category, with a
+// default partition for categories unseen at load time.
+enum class PartitionLayout { None, Tiles, Category };
+
+struct Partitioning {
+    PartitionLayout layout = PartitionLayout::None;
+    bool quantized = false;
+    // Tiles: inner edges of the bands, and of the tiles of each band, in the
+    // domain of the stored columns
+    std::vector<double> y_edges;
+    std::vector<std::vector<double>> x_edges;
+    // Category: the categories that get a partition of their own
+    std::vector<int> categories;
+};
+
+// "none", "tiles" or "category"; throws std::runtime_error otherwise
+PartitionLayout parse_partition_layout(const std::string& name);
+// A layout for the data: tile edges are quantiles, so each of the
+// tiles_per_side bands and each band's tiles hold about the same number of
+// points
+Partitioning compute_partitioning(const std::vector<RegionData>& regions, const Quantization& quant,
+                                  PartitionLayout layout, int tiles_per_side);
+
+// Summary of the data the query engine estimates result sizes from without
+// scanning the table, in the coordinates queries see (dequantized when the
+// data is quantized)
+struct StatisticsCell {
+    // Bounding box of the cell's points
+    double x_min, y_min, x_max, y_max;
+    long long points;
+};
+
+struct GroupSizeStatistics {
+    int size;
+    long long groups;
+    // Mean bounding box of the groups of this size
+    double mean_width, mean_height;
+};
+
+struct DatasetStatistics {
+    // Equi-depth grid: bands of about equal count in y, each split into
+    // cells of about equal count in x, so dense areas get small cells
+    std::vector<StatisticsCell> cells;
+    std::map<int, long long> category_points;
+    std::vector<GroupSizeStatistics> group_sizes;
+    // Per region, in input order: keys in [0, 1) such that every cell has
+    // about the same share of its points below any threshold, so the rows
+    // with sample_key < f are a sample of f stratified by the grid
+    std::vector<float> sample_keys;
+};
+
+// grid_size bands of grid_size cells each
+DatasetStatistics compute_statistics(const std::vector<RegionData>& regions, const Quantization& quant, int grid_size);
+
+// One "x y" pair per line / one number per line; unparsable lines are skipped
+std::vector<Point> read_points(const std::string& filepath);
+std::vector<int> read_integers(const std::string& filepath);
+// One region id per line, read as a 64-bit integer; blank lines are skipped
+// and anything else throws std::runtime_error rather than being truncated
+std::vector<long long> read_ids(const std::string& filepath);
+
+// Creates the tables that do not exist yet. A partitioned layout, or
+// switching back from one, recreates inspection_region empty.
+void create_schema(pqxx::connection& conn, const Partitioning& partitioning = Partitioning());
+void store_quantization(pqxx::work& txn, const Quantization& quant);
+// Rebuilds group_posting from the rows in inspection_region: every group's
+// ids as runs of consecutive ids, clustered by group, so a group's points
+// are found with one index range scan per run. Records in dataset_metadata
+// that the postings are current.
+void build_group_postings(pqxx::work& txn);
+// Replaces the contents of statistics_cell, statistics_category and
+// statistics_group; empty statistics leave the dataset without a catalog.
+// Records in dataset_metadata whether the rows carry sample keys.
+void store_statistics(pqxx::work& txn, const DatasetStatistics& statistics);
+// Replaces the contents of inspection_region and inspection_group, the group
+// postings, and the statistics catalog with one computed on a
+// statistics_grid x statistics_grid grid. Subscribers see a single 'R'
+// (replaced) entry in the change log.
+void load_data(pqxx::connection& conn, const std::vector<RegionData>& regions, const Quantization& quant,
+               int statistics_grid = 32);
+
+// The quantization stored with the current dataset
+Quantization read_quantization(pqxx::work& txn);
+// Adds regions with ids after the largest existing one, in the dataset's
+// stored quantization, and returns the first new id. Each row is logged for
+// subscribers; the statistics catalog is left as it was. Concurrent appends
+// take turns. Throws std::runtime_error, adding nothing, if a region does
+// not fit into the int32 range of the stored quantization.
+long long append_data(pqxx::connection& conn, const std::vector<RegionData>& regions);
+// Deletes the regions with these ids and the groups left without regions
+void delete_regions(pqxx::connection& conn, const std::vector<long long>& ids);
+
+} // namespace loader
+
+#endif // DATA_LOADER_H
@@ -0,0 +1,116 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <gflags/gflags.h>
+#include <pqxx/pqxx>
+
+#include "data_loader.h"
+
+namespace fs = std::filesystem;
+
+using loader::Partitioning;
+using loader::Quantization;
+using loader::RegionData;
+
+// --- Command-line Flag Definitions ---
+DEFINE_string(data_directory, "", "Path to the directory containing data files (points.txt, categories.txt, groups.txt).");
+DEFINE_double(quantize_scale, 0.0, "Store coordinates as int32 fixed-point with this step size (0 keeps FLOAT coordinates).");
+DEFINE_string(partition, "none", "Partition inspection_region into spatial 'tiles', one partition per 'category', or 'none'.");
+DEFINE_int32(partition_tiles, 8, "Bands per table and tiles per band of --partition=tiles.");
+DEFINE_int32(statistics_grid, 32, "Bands and cells per band of the statistics catalog's density grid.");
+DEFINE_bool(append, false, "Add the regions to the loaded dataset instead of replacing it.");
+DEFINE_string(delete_ids, "", "Path to a file of region ids to delete from the loaded dataset; no data files are read.");
+
+int main(int argc, char* argv[]) {
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    const std::filesystem::path data_dir(FLAGS_data_directory);
+
+    if (!FLAGS_delete_ids.empty()) {
+        try {
+            const std::vector<long long> ids = loader::read_ids(FLAGS_delete_ids);
+            pqxx::connection conn("dbname=inspection_db user=postgres password=postgres host=localhost port=5432");
+            loader::delete_regions(conn, ids);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // Validate required --data_directory flag
+    if (FLAGS_data_directory.empty()) {
+        std::cerr << "Error: --data_directory is a required argument." << std::endl;
+        return 1;
+    }
+
+    std::cout << "Data directory: " << data_dir << std::endl;
+
+    try {
+        // Read data files
+        fs::path points_file = fs::path(data_dir) / "points.txt";
+        fs::path categories_file = fs::path(data_dir) / "categories.txt";
+        fs::path groups_file = fs::path(data_dir) / "groups.txt";
+        
+        std::cout << "Reading points from: " << points_file << std::endl;
+        auto points = loader::read_points(points_file.string());
+        
+        std::cout << "Reading categories from: " << categories_file << std::endl;
+        auto categories = loader::read_integers(categories_file.string());
+        
+        std::cout << "Reading groups from: " << groups_file << std::endl;
+        auto groups = loader::read_integers(groups_file.string());
+        
+        // Validate data consistency
+        if (points.size() != categories.size() || points.size() != groups.size()) {
+            throw std::runtime_error("Data file sizes don't match!");
+        }
+        
+        std::cout << "Read " << points.size() << " regions." << std::endl;
+        
+        // Combine data
+        std::vector<RegionData> regions;
+        for (size_t i = 0; i < points.size(); ++i) {
+            regions.push_back({points[i], categories[i], groups[i]});
+        }
+        
+        // Connect to PostgreSQL
+        // Modify connection string as needed
+        pqxx::connection conn("dbname=inspection_db user=postgres password=postgres host=localhost port=5432");
+        
+        if (!conn.is_open()) {
+            throw std::runtime_error("Cannot connect to database");
+        }
+        
+        std::cout << "Connected to database: " << conn.dbname() << std::endl;
+        
+        // Appended regions join the existing dataset and its schema
+        if (FLAGS_append) {
+            loader::append_data(conn, regions);
+            std::cout << "Data loading completed successfully!" << std::endl;
+            return 0;
+        }
+        
+        // Quantize coordinates if requested
+        Quantization quant = loader::compute_quantization(regions, FLAGS_quantize_scale);
+        if (quant.enabled()) {
+            std::cout << "Quantizing coordinates with scale " << quant.scale << std::endl;
+        }
+        
+        // Create schema; partition bounds are derived from the stored coordinates
+        Partitioning partitioning = loader::compute_partitioning(
+            regions, quant, loader::parse_partition_layout(FLAGS_partition), FLAGS_partition_tiles);
+        loader::create_schema(conn, partitioning);
+
+        // Load data
+        loader::load_data(conn, regions, quant, FLAGS_statistics_grid);
+        
+        std::cout << "Data loading completed successfully!" << std::endl;
+        
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    
+    return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// Database the benchmarks may wipe and reload. Override with the
+// QUERY_ENGINE_BENCH_DB environment variable.
+inline std::string bench_connection_string() {
+    const char* env = std::getenv("QUERY_ENGINE_BENCH_DB");
+    return env ? env : "dbname=inspection_bench_db user=postgres password=postgres host=localhost port=5432";
+}
+
+// Swallows std::cout for its lifetime, to keep progress messages of the
+// code under test out of the benchmark report.
+class SilenceStdout {
+public:
+    SilenceStdout() : saved_(std::cout.rdbuf(nullptr)) {}
+    ~SilenceStdout() {
+        std::cout.rdbuf(saved_);
+        std::cout.clear();
+    }
+
+    SilenceStdout(const SilenceStdout&) = delete;
+    SilenceStdout& operator=(const SilenceStdout&) = delete;
+
+private:
+    std::streambuf* saved_;
+};
+
+#endif // BENCH_COMMON_H
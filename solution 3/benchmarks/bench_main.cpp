@@ -0,0 +1,32 @@
+#include <cstring>
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+
+// Same as benchmark_main, except results are also written as JSON to
+// query_engine_bench.json unless --benchmark_out is given, so every run
+// can be compared with tools/compare.py from Google Benchmark.
+int main(int argc, char* argv[]) {
+    std::vector<char*> args(argv, argv + argc);
+
+    bool has_output = false;
+    for (char* arg : args) {
+        has_output = has_output || std::strncmp(arg, "--benchmark_out=", 16) == 0;
+    }
+
+    std::string output_arg = "--benchmark_out=query_engine_bench.json";
+    std::string format_arg = "--benchmark_out_format=json";
+    if (!has_output) {
+        args.push_back(&output_arg[0]);
+        args.push_back(&format_arg[0]);
+    }
+
+    int count = static_cast<int>(args.size());
+    benchmark::Initialize(&count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(count, args.data())) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
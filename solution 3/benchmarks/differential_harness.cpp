@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+#include <gflags/gflags.h>
+#include <pqxx/pqxx>
+
+#include "batch_runner.h"
+#include "bench_common.h"
+#include "quantization.h"
+#include "query_engine.h"
+#include "random_query.h"
+
+// --- Command-line Flag Definitions ---
+DEFINE_int32(queries, 200, "Number of random queries to run.");
+DEFINE_uint64(seed, 1, "Seed of the random queries.");
+DEFINE_int32(max_depth, 4, "Maximum AND/OR nesting depth of the random queries.");
+DEFINE_int32(threads, 4, "Worker threads of the parallel strategies.");
+DEFINE_int32(crop_tiles, 4, "Crop tiles of the tiled parallel strategy.");
+DEFINE_string(failures_dir, "diff_failures", "Directory for the query files of mismatching queries.");
+
+namespace {
+
+struct Variant {
+    std::string name;
+    EngineOptions options;
+    std::unique_ptr<QueryEngine> engine;
+    std::vector<double> latencies_ms;
+    size_t mismatches = 0;
+    size_t errors = 0;
+};
+
+// Every point of the dataset, as the engine would return it
+std::vector<Point> load_points(const std::string& conn_string) {
+    pqxx::connection conn(conn_string);
+    pqxx::work txn(conn);
+
+    std::map<std::string, std::string> metadata;
+    if (txn.exec("SELECT to_regclass('dataset_metadata') IS NOT NULL")[0][0].as<bool>()) {
+        for (const auto& row : txn.exec("SELECT key, value FROM dataset_metadata")) {
+            metadata[row[0].as<std::string>()] = row[1].as<std::string>();
+        }
+    }
+    const Quantization quant = Quantization::from_metadata(metadata);
+
+    std::vector<Point> points;
+    const char* sql = quant.enabled
+        ? "SELECT id, qx, qy, category, group_id FROM inspection_region"
+        : "SELECT id, coord_x, coord_y, category, group_id FROM inspection_region";
+    for (const auto& row : txn.exec(sql)) {
+        Point p;
+        p.id = row[0].as<long long>();
+        p.x = quant.enabled ? quant.dequantize_x(row[1].as<int32_t>()) : row[1].as<double>();
+        p.y = quant.enabled ? quant.dequantize_y(row[2].as<int32_t>()) : row[2].as<double>();
+        p.category = row[3].as<int>();
+        p.group_id = row[4].as<int>();
+        points.push_back(p);
+    }
+    txn.commit();
+    return points;
+}
+
+RandomQueryOptions options_for(const std::vector<Point>& points) {
+    RandomQueryOptions options;
+    options.max_depth = FLAGS_max_depth;
+    if (points.empty()) {
+        return options;
+    }
+
+    options.extent = {points[0].x, points[0].y, points[0].x, points[0].y};
+    int max_category = 0, max_group = 0;
+    for (const Point& p : points) {
+        options.extent.x_min = std::min(options.extent.x_min, p.x);
+        options.extent.y_min = std::min(options.extent.y_min, p.y);
+        options.extent.x_max = std::max(options.extent.x_max, p.x);
+        options.extent.y_max = std::max(options.extent.y_max, p.y);
+        max_category = std::max(max_category, p.category);
+        max_group = std::max(max_group, p.group_id);
+    }
+    options.categories = max_category + 1;
+    options.groups = max_group + 1;
+    return options;
+}
+
+void print_table(const std::vector<Variant>& variants) {
+    const double baseline = variants.front().latencies_ms.empty()
+        ? 0.0
+        : std::accumulate(variants.front().latencies_ms.begin(), variants.front().latencies_ms.end(), 0.0);
+
+    std::printf("%-18s %8s %10s %7s %9s %9s %9s %9s %9s\n",
+                "strategy", "queries", "mismatch", "errors", "mean ms", "p50 ms", "p90 ms", "max ms", "speedup");
+    for (const Variant& v : variants) {
+        std::vector<double> sorted = v.latencies_ms;
+        std::sort(sorted.begin(), sorted.end());
+        const double total = std::accumulate(sorted.begin(), sorted.end(), 0.0);
+        const double mean = sorted.empty() ? 0.0 : total / static_cast<double>(sorted.size());
+
+        std::printf("%-18s %8zu %10zu %7zu %9.3f %9.3f %9.3f %9.3f %8.2fx\n",
+                    v.name.c_str(), sorted.size(), v.mismatches, v.errors, mean,
+                    percentile(sorted, 50), percentile(sorted, 90), sorted.empty() ? 0.0 : sorted.back(),
+                    total > 0.0 ? baseline / total : 0.0);
+    }
+}
+
+} // namespace
+
+// Runs random queries through every execution strategy on the dataset in
+// QUERY_ENGINE_BENCH_DB, checks each result against a brute-force
+// evaluation over all points and prints a latency table. Exits with 1 if
+// any strategy disagrees.
+int main(int argc, char* argv[]) {
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+    try {
+        const std::string conn_string = bench_connection_string();
+        const std::vector<Point> points = load_points(conn_string);
+        std::cout << "Loaded " << points.size() << " points for the reference evaluation." << std::endl;
+
+        std::vector<Variant> variants;
+        for (ExecutionStrategy strategy : all_strategies()) {
+            Variant v;
+            v.name = strategy_name(strategy);
+            v.options.strategy = strategy;
+            v.options.threads = static_cast<size_t>(FLAGS_threads);
+            variants.push_back(std::move(v));
+        }
+        Variant tiled;
+        tiled.name = "parallel+tiles";
+        tiled.options.strategy = ExecutionStrategy::Parallel;
+        tiled.options.threads = static_cast<size_t>(FLAGS_threads);
+        tiled.options.crop_tiles = static_cast<size_t>(FLAGS_crop_tiles);
+        variants.push_back(std::move(tiled));
+        // The cost model's pick per query, to compare against the fixed ones
+        Variant adaptive;
+        adaptive.name = "auto";
+        adaptive.options.threads = static_cast<size_t>(FLAGS_threads);
+        variants.push_back(std::move(adaptive));
+
+        for (Variant& v : variants) {
+            v.engine = std::make_unique<QueryEngine>(conn_string, v.options);
+        }
+
+        std::mt19937_64 rng(FLAGS_seed);
+        const RandomQueryOptions query_options = options_for(points);
+        size_t failed_queries = 0;
+
+        for (int q = 0; q < FLAGS_queries; ++q) {
+            const json query = random_query(rng, query_options);
+            const std::set<long long> expected = reference_evaluate(points, query);
+            bool failed = false;
+
+            // Rotate the order so no strategy always runs on a cold cache
+            for (size_t k = 0; k < variants.size(); ++k) {
+                Variant& v = variants[(static_cast<size_t>(q) + k) % variants.size()];
+                try {
+                    const auto start = std::chrono::steady_clock::now();
+                    std::vector<Point> result = v.engine->execute_query(query);
+                    v.latencies_ms.push_back(
+                        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+                    std::set<long long> ids;
+                    for (const Point& p : result) ids.insert(p.id);
+                    if (ids != expected) {
+                        ++v.mismatches;
+                        failed = true;
+                        std::cerr << "Query " << q << ": " << v.name << " returned " << ids.size()
+                                  << " points, expected " << expected.size() << std::endl;
+                    }
+                } catch (const std::exception& e) {
+                    ++v.errors;
+                    failed = true;
+                    std::cerr << "Query " << q << ": " << v.name << " failed: " << e.what() << std::endl;
+                }
+            }
+
+            if (failed) {
+                ++failed_queries;
+                std::filesystem::create_directories(FLAGS_failures_dir);
+                std::ofstream(std::filesystem::path(FLAGS_failures_dir) / ("query_" + std::to_string(q) + ".json"))
+                    << query.dump(2) << std::endl;
+            }
+        }
+
+        print_table(variants);
+
+        if (failed_queries > 0) {
+            std::cerr << failed_queries << " queries disagreed; see " << FLAGS_failures_dir << std::endl;
+            return 1;
+        }
+        std::cout << "All strategies agree on " << FLAGS_queries << " queries." << std::endl;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,235 @@
+#include <memory>
+#include <string>
+#include <utility>
+#include <benchmark/benchmark.h>
+#include <nlohmann/json.hpp>
+#include <pqxx/pqxx>
+
+#include "bench_common.h"
+#include "data_loader.h"
+#include "query_engine.h"
+
+using json = nlohmann::json;
+
+namespace {
+
+constexpr double kExtent = 1000.0;
+constexpr int kGroupSize = 8;
+constexpr int kCategories = 10;
+constexpr int kTilesPerSide = 8;
+
+// What compute_partitioning derives for the benchmark data: its coordinates
+// are uniform, so the quantile edges are about equally spaced
+loader::Partitioning bench_partitioning(loader::PartitionLayout layout) {
+    loader::Partitioning partitioning;
+    partitioning.layout = layout;
+    if (layout == loader::PartitionLayout::Tiles) {
+        for (int k = 1; k < kTilesPerSide; ++k) {
+            partitioning.y_edges.push_back(kExtent * k / kTilesPerSide);
+        }
+        partitioning.x_edges.assign(kTilesPerSide, partitioning.y_edges);
+    } else if (layout == loader::PartitionLayout::Category) {
+        for (int c = 0; c < kCategories; ++c) {
+            partitioning.categories.push_back(c);
+        }
+    }
+    return partitioning;
+}
+
+// Loads n points into the benchmark database unless it already holds that
+// dataset in that layout. Group members lie within a few units of each
+// other, so proper crops select a meaningful share of the points.
+void ensure_dataset(size_t n, loader::PartitionLayout layout = loader::PartitionLayout::None) {
+    static std::pair<size_t, loader::PartitionLayout> loaded{0, loader::PartitionLayout::None};
+    if (loaded == std::make_pair(n, layout)) {
+        return;
+    }
+
+    pqxx::connection conn(bench_connection_string());
+    {
+        SilenceStdout quiet;
+        loader::create_schema(conn, bench_partitioning(layout));
+    }
+
+    pqxx::work txn(conn);
+    txn.exec("DELETE FROM inspection_region");
+    txn.exec("DELETE FROM inspection_group");
+    loader::store_quantization(txn, loader::Quantization());
+    // The rows are generated on the server, so there is no catalog; the
+    // engine falls back to the planner statistics of the ANALYZE below
+    loader::store_statistics(txn, loader::DatasetStatistics());
+    txn.exec("SELECT setseed(0.5)");
+
+    const std::string groups = std::to_string((n + kGroupSize - 1) / kGroupSize);
+    txn.exec("INSERT INTO inspection_group (id) SELECT g FROM generate_series(0, " + groups + " - 1) g");
+    txn.exec(
+        "INSERT INTO inspection_region (id, group_id, coord_x, coord_y, category) "
+        "SELECT i, c.g, c.x + random() * 5, c.y + random() * 5, floor(random() * " + std::to_string(kCategories) + ")::int "
+        "FROM generate_series(0, " + std::to_string(n) + " - 1) i "
+        "JOIN (SELECT g, random() * " + std::to_string(kExtent) + " AS x, random() * " + std::to_string(kExtent) + " AS y "
+        "      FROM generate_series(0, " + groups + " - 1) g) c ON c.g = i / " + std::to_string(kGroupSize));
+    loader::build_group_postings(txn);
+    txn.commit();
+
+    pqxx::nontransaction maintenance(conn);
+    maintenance.exec("ANALYZE inspection_region");
+    loaded = {n, layout};
+}
+
+json rect(double x_min, double y_min, double x_max, double y_max) {
+    return {{"p_min", {{"x", x_min}, {"y", y_min}}}, {"p_max", {{"x", x_max}, {"y", y_max}}}};
+}
+
+json query(const json& operator_tree) {
+    return {{"valid_region", rect(0, 0, kExtent, kExtent)}, {"query", operator_tree}};
+}
+
+// Crop covering 4% of the dataset, shifted per leaf so operands differ
+json crop(int leaf, bool with_category, bool with_groups, bool proper) {
+    const double x = 100.0 + 20.0 * leaf;
+    json op = {{"region", rect(x, 100.0, x + 200.0, 300.0)}};
+    if (with_category) {
+        op["category"] = 3;
+    }
+    if (with_groups) {
+        json groups = json::array();
+        for (int g = 0; g < 2000; g += 20) {
+            groups.push_back(g);
+        }
+        op["one_of_groups"] = groups;
+    }
+    if (proper) {
+        op["proper"] = true;
+    }
+    return {{"operator_crop", op}};
+}
+
+// Complete binary tree alternating AND and OR by level
+json tree(int depth, int& next_leaf) {
+    if (depth == 0) {
+        return crop(next_leaf++, false, false, false);
+    }
+    json operands = {tree(depth - 1, next_leaf), tree(depth - 1, next_leaf)};
+    return {{depth % 2 ? "operator_and" : "operator_or", operands}};
+}
+
+class EngineBench : public benchmark::Fixture {
+public:
+    void SetUp(benchmark::State& state) override {
+        try {
+            ensure_dataset(static_cast<size_t>(state.range(0)), layout(state));
+            EngineOptions options;
+            options.threads = static_cast<size_t>(state.range(2));
+            configure(state, options);
+            engine_ = std::make_unique<QueryEngine>(bench_connection_string(), options);
+        } catch (const std::exception& e) {
+            state.SkipWithError(e.what());
+        }
+    }
+
+    void TearDown(benchmark::State&) override {
+        engine_.reset();
+    }
+
+protected:
+    std::unique_ptr<QueryEngine> engine_;
+
+    virtual loader::PartitionLayout layout(const benchmark::State&) const {
+        return loader::PartitionLayout::None;
+    }
+
+    virtual void configure(const benchmark::State&, EngineOptions&) const {
+    }
+
+    void run(benchmark::State& state, const json& q) {
+        if (!engine_) {
+            return;
+        }
+        size_t points = 0;
+        for (auto _ : state) {
+            points = engine_->execute_query(q).size();
+        }
+        state.counters["points"] = static_cast<double>(points);
+    }
+};
+
+// Args: points, filters (bit 0 category, bit 1 one_of_groups), threads
+BENCHMARK_DEFINE_F(EngineBench, Crop)(benchmark::State& state) {
+    const int filters = static_cast<int>(state.range(1));
+    run(state, query(crop(0, filters & 1, filters & 2, false)));
+}
+BENCHMARK_REGISTER_F(EngineBench, Crop)
+    ->ArgNames({"points", "filters", "threads"})
+    ->ArgsProduct({{10000, 100000, 1000000}, {0, 1, 2, 3}, {1}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Args: points, filters, threads
+BENCHMARK_DEFINE_F(EngineBench, ProperCrop)(benchmark::State& state) {
+    const int filters = static_cast<int>(state.range(1));
+    run(state, query(crop(0, filters & 1, filters & 2, true)));
+}
+BENCHMARK_REGISTER_F(EngineBench, ProperCrop)
+    ->ArgNames({"points", "filters", "threads"})
+    ->ArgsProduct({{10000, 100000, 1000000}, {0, 3}, {1}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Args: points, depth, threads; 2^depth crops
+BENCHMARK_DEFINE_F(EngineBench, DeepTree)(benchmark::State& state) {
+    int next_leaf = 0;
+    run(state, query(tree(static_cast<int>(state.range(1)), next_leaf)));
+}
+BENCHMARK_REGISTER_F(EngineBench, DeepTree)
+    ->ArgNames({"points", "depth", "threads"})
+    ->ArgsProduct({{10000, 100000, 1000000}, {2, 4, 6}, {1, 8}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Range(1) is the layout: 0 none, 1 spatial tiles, 2 category partitions
+class PartitionBench : public EngineBench {
+protected:
+    loader::PartitionLayout layout(const benchmark::State& state) const override {
+        static const loader::PartitionLayout kLayouts[] = {
+            loader::PartitionLayout::None, loader::PartitionLayout::Tiles, loader::PartitionLayout::Category};
+        return kLayouts[state.range(1)];
+    }
+};
+
+// Args: points, layout, threads. A crop over 0.25% of the area in one of
+// the 10 categories: tiles prune by region, category partitions by the filter
+BENCHMARK_DEFINE_F(PartitionBench, SelectiveCrop)(benchmark::State& state) {
+    json op = {{"region", rect(420.0, 420.0, 470.0, 470.0)}, {"category", 3}};
+    run(state, query({{"operator_crop", op}}));
+}
+BENCHMARK_REGISTER_F(PartitionBench, SelectiveCrop)
+    ->ArgNames({"points", "layout", "threads"})
+    ->ArgsProduct({{100000, 1000000}, {0, 1, 2}, {1}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Range(1) turns the group postings off (0) or on (1)
+class PostingsBench : public EngineBench {
+protected:
+    void configure(const benchmark::State& state, EngineOptions& options) const override {
+        options.strategy = ExecutionStrategy::Pipelined;
+        options.group_postings = state.range(1) != 0;
+    }
+};
+
+// Args: points, postings, threads. Five groups anywhere in the dataset, with
+// and without the proper check; with postings the time should not grow with
+// the number of points.
+BENCHMARK_DEFINE_F(PostingsBench, FewGroups)(benchmark::State& state) {
+    json op = {{"region", rect(0.0, 0.0, kExtent, kExtent)}, {"one_of_groups", {3, 1001, 5002, 9000, 12345}}};
+    json proper = op;
+    proper["proper"] = true;
+    run(state, query({{"operator_or", {{{"operator_crop", op}}, {{"operator_crop", proper}}}}}));
+}
+BENCHMARK_REGISTER_F(PostingsBench, FewGroups)
+    ->ArgNames({"points", "postings", "threads"})
+    ->ArgsProduct({{100000, 1000000}, {0, 1}, {1}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+} // namespace
@@ -0,0 +1,106 @@
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+
+#include "bench_common.h"
+#include "data_loader.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Input files are written once per size and reused by every run
+const fs::path& input_file(const std::string& kind, size_t n) {
+    static std::map<std::pair<std::string, size_t>, fs::path> files;
+
+    auto it = files.find({kind, n});
+    if (it != files.end()) {
+        return it->second;
+    }
+
+    const fs::path dir = fs::temp_directory_path() / "query_engine_bench";
+    fs::create_directories(dir);
+    const fs::path path = dir / (kind + "_" + std::to_string(n) + ".txt");
+
+    std::mt19937_64 rng(n);
+    std::uniform_real_distribution<double> coord(0.0, 1000.0);
+    std::ofstream out(path);
+    out.precision(17);
+    for (size_t i = 0; i < n; ++i) {
+        if (kind == "points") {
+            out << coord(rng) << " " << coord(rng) << "\n";
+        } else {
+            out << (rng() % 1000) << "\n";
+        }
+    }
+
+    return files.emplace(std::make_pair(kind, n), path).first->second;
+}
+
+std::vector<loader::RegionData> make_regions(size_t n) {
+    std::mt19937_64 rng(n);
+    std::uniform_real_distribution<double> coord(0.0, 1000.0);
+    std::vector<loader::RegionData> regions(n);
+    for (size_t i = 0; i < n; ++i) {
+        regions[i] = {{coord(rng), coord(rng)}, static_cast<int>(rng() % 10), static_cast<int>(i / 8)};
+    }
+    return regions;
+}
+
+void BM_ReadPoints(benchmark::State& state) {
+    const size_t n = static_cast<size_t>(state.range(0));
+    const fs::path& path = input_file("points", n);
+
+    for (auto _ : state) {
+        std::vector<loader::Point> points = loader::read_points(path.string());
+        benchmark::DoNotOptimize(points.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(fs::file_size(path)));
+}
+BENCHMARK(BM_ReadPoints)->RangeMultiplier(10)->Range(10000, 1000000)->Unit(benchmark::kMillisecond);
+
+void BM_ReadIntegers(benchmark::State& state) {
+    const size_t n = static_cast<size_t>(state.range(0));
+    const fs::path& path = input_file("integers", n);
+
+    for (auto _ : state) {
+        std::vector<int> values = loader::read_integers(path.string());
+        benchmark::DoNotOptimize(values.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(fs::file_size(path)));
+}
+BENCHMARK(BM_ReadIntegers)->RangeMultiplier(10)->Range(10000, 1000000)->Unit(benchmark::kMillisecond);
+
+// Range(1): quantization scale in thousandths, 0 for FLOAT coordinates
+void BM_LoadData(benchmark::State& state) {
+    const size_t n = static_cast<size_t>(state.range(0));
+    const std::vector<loader::RegionData> regions = make_regions(n);
+    const loader::Quantization quant = loader::compute_quantization(regions, static_cast<double>(state.range(1)) / 1000.0);
+
+    try {
+        pqxx::connection conn(bench_connection_string());
+        SilenceStdout quiet;
+        loader::create_schema(conn);
+
+        for (auto _ : state) {
+            loader::load_data(conn, regions, quant);
+        }
+    } catch (const std::exception& e) {
+        state.SkipWithError(e.what());
+        return;
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+}
+BENCHMARK(BM_LoadData)
+    ->ArgNames({"points", "scale_milli"})
+    ->ArgsProduct({{1000, 10000}, {0, 1}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+} // namespace
@@ -0,0 +1,110 @@
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <nlohmann/json.hpp>
+
+#include "query_plan.h"
+#include "statistics_catalog.h"
+
+namespace {
+
+// Operand k holds n consecutive ids starting at k * n / (2 * count): all
+// operands share at least half their ids, like overlapping crops do.
+std::vector<IdSet> make_operands(size_t n, size_t count) {
+    std::vector<IdSet> operands(count);
+    for (size_t k = 0; k < count; ++k) {
+        const long long first = static_cast<long long>(k * n / (2 * count));
+        for (long long id = first; id < first + static_cast<long long>(n); ++id) {
+            operands[k].insert(operands[k].end(), id);
+        }
+    }
+    return operands;
+}
+
+void combine_benchmark(benchmark::State& state, NodeType type) {
+    const size_t n = static_cast<size_t>(state.range(0));
+    const size_t count = static_cast<size_t>(state.range(1));
+    const std::vector<IdSet> prototype = make_operands(n, count);
+
+    size_t result_size = 0;
+    for (auto _ : state) {
+        // combine_results consumes its operands; they live in an arena of
+        // their own, as in a query
+        state.PauseTiming();
+        auto arena = std::make_unique<QueryArena>(false);
+        IdSets operands(prototype.begin(), prototype.end(), arena.get());
+        state.ResumeTiming();
+
+        IdSet result = combine_results(type, operands);
+        result_size = result.size();
+        benchmark::DoNotOptimize(result_size);
+
+        state.PauseTiming();
+        operands.clear();
+        result.clear();
+        arena.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n * count));
+    state.counters["result_rows"] = static_cast<double>(result_size);
+}
+
+void BM_CombineAnd(benchmark::State& state) {
+    combine_benchmark(state, NodeType::And);
+}
+BENCHMARK(BM_CombineAnd)
+    ->ArgNames({"rows", "operands"})
+    ->ArgsProduct({{1000, 100000, 1000000}, {2, 8}})
+    ->Unit(benchmark::kMillisecond);
+
+void BM_CombineOr(benchmark::State& state) {
+    combine_benchmark(state, NodeType::Or);
+}
+BENCHMARK(BM_CombineOr)
+    ->ArgNames({"rows", "operands"})
+    ->ArgsProduct({{1000, 100000, 1000000}, {2, 8}})
+    ->Unit(benchmark::kMillisecond);
+
+// A grid_size x grid_size catalog over [0, 1000]^2 with 1000 points per cell
+StatisticsCatalog make_catalog(int grid_size) {
+    std::vector<StatisticsCatalog::Cell> cells;
+    const double step = 1000.0 / grid_size;
+    for (int y = 0; y < grid_size; ++y) {
+        for (int x = 0; x < grid_size; ++x) {
+            cells.push_back({{x * step, y * step, (x + 1) * step, (y + 1) * step}, 1000.0});
+        }
+    }
+    const double rows = 1000.0 * grid_size * grid_size;
+    return StatisticsCatalog(std::move(cells), {{0, rows / 2}, {1, rows / 2}}, {{8, rows / 8, 5.0, 5.0}});
+}
+
+// An OR of leaves / 2 ANDs of two overlapping crops, one of them proper
+void BM_CatalogEstimate(benchmark::State& state) {
+    const StatisticsCatalog catalog = make_catalog(static_cast<int>(state.range(0)));
+    const int pairs = static_cast<int>(state.range(1)) / 2;
+    json operands = json::array();
+    for (int k = 0; k < pairs; ++k) {
+        auto crop = [](double lo, double hi, bool proper) {
+            return json{{"operator_crop", {{"region", {{"p_min", {{"x", lo}, {"y", lo}}}, {"p_max", {{"x", hi}, {"y", hi}}}}},
+                                           {"proper", proper}}}};
+        };
+        operands.push_back({{"operator_and", {crop(k * 50.0, k * 50.0 + 300.0, false), crop(k * 50.0 + 100.0, k * 50.0 + 400.0, true)}}});
+    }
+    const Rectangle valid{0.0, 0.0, 1000.0, 1000.0};
+    const std::unique_ptr<QueryNode> plan = optimize_plan(parse_query({{"operator_or", operands}}), valid);
+
+    double rows = 0.0;
+    for (auto _ : state) {
+        rows = catalog.result_rows(*plan, valid);
+        benchmark::DoNotOptimize(rows);
+    }
+    state.counters["estimated_rows"] = rows;
+}
+BENCHMARK(BM_CatalogEstimate)
+    ->ArgNames({"grid", "leaves"})
+    ->ArgsProduct({{8, 32, 64}, {2, 16}})
+    ->Unit(benchmark::kMicrosecond);
+
+} // namespace
@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+
+#include "batch_runner.h"
+#include "profile.h"
+#include "query_plan.h"
+#include "thread_pool.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+json read_query_file(const fs::path& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Cannot open query file: " + path.string());
+    }
+
+    json query_json;
+    file >> query_json;
+    return query_json;
+}
+
+std::string extension_for(OutputFormat format) {
+    switch (format) {
+        case OutputFormat::Csv: return ".csv";
+        case OutputFormat::Binary64: return ".f64";
+        case OutputFormat::Binary32: return ".f32";
+        case OutputFormat::Text: break;
+    }
+    return ".txt";
+}
+
+// query with the error of the one that failed to load, prefixed with its
+// line when it came from a .jsonl or list file
+BatchQuery load_query(std::string name, size_t line, const std::function<json()>& read) {
+    BatchQuery query;
+    query.name = std::move(name);
+    query.line = line;
+    try {
+        query.query = read();
+    } catch (const std::exception& e) {
+        query.error = (line > 0 ? "line " + std::to_string(line) + ": " : std::string()) + e.what();
+    }
+    return query;
+}
+
+struct QueryOutcome {
+    size_t points = 0;
+    double latency_ms = 0.0;
+    std::string error;
+};
+
+} // namespace
+
+std::vector<BatchQuery> load_batch(const std::string& source) {
+    const fs::path source_path(source);
+    std::vector<BatchQuery> queries;
+
+    if (fs::is_directory(source_path)) {
+        std::vector<fs::path> files;
+        for (const auto& entry : fs::directory_iterator(source_path)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".json") {
+                files.push_back(entry.path());
+            }
+        }
+        std::sort(files.begin(), files.end());
+
+        for (const auto& file : files) {
+            queries.push_back(load_query(file.stem().string(), 0, [&file] { return read_query_file(file); }));
+        }
+        return queries;
+    }
+
+    std::ifstream file(source_path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Cannot open batch source: " + source);
+    }
+
+    const bool json_lines = source_path.extension() == ".jsonl";
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(file, line)) {
+        ++line_number;
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+
+        if (json_lines) {
+            std::ostringstream name;
+            name << "query_" << std::setw(6) << std::setfill('0') << line_number;
+            queries.push_back(load_query(name.str(), line_number, [&line] { return json::parse(line); }));
+        } else {
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            fs::path query_path(line);
+            if (query_path.is_relative()) {
+                query_path = source_path.parent_path() / query_path;
+            }
+            queries.push_back(load_query(query_path.stem().string(), line_number,
+                                         [&query_path] { return read_query_file(query_path); }));
+        }
+    }
+
+    return queries;
+}
+
+double percentile(const std::vector<double>& sorted_values, double p) {
+    if (sorted_values.empty()) {
+        return 0.0;
+    }
+
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * static_cast<double>(sorted_values.size())));
+    rank = std::min(std::max<size_t>(rank, 1), sorted_values.size());
+    return sorted_values[rank - 1];
+}
+
+json run_batch(QueryEngine& engine, const std::vector<BatchQuery>& queries, const BatchOptions& options) {
+    fs::create_directories(options.output_directory);
+
+    std::vector<QueryOutcome> outcomes(queries.size());
+
+    auto run_one = [&](size_t i) {
+        const fs::path output_path = fs::path(options.output_directory) / (queries[i].name + extension_for(options.format));
+        const auto start = std::chrono::steady_clock::now();
+        if (!queries[i].error.empty()) {
+            outcomes[i].error = queries[i].error;
+            return;
+        }
+
+        try {
+            ProfileNode profile;
+            const json& query = queries[i].query;
+            if (query.contains("query") && is_aggregate(query["query"])) {
+                // Aggregates write their summary; they return no points
+                const json summary = engine.execute_aggregate(query, options.profile ? &profile : nullptr);
+                write_json_file((fs::path(options.output_directory) / (queries[i].name + ".json")).string(), summary);
+            } else {
+                OutputWriter out(output_path.string(), options.format, options.precision);
+                engine.execute_query_stream(query, [&out](const std::vector<Point>& chunk) {
+                    out.write(chunk);
+                }, 10000, options.profile ? &profile : nullptr);
+                out.close();
+                outcomes[i].points = out.points_written();
+            }
+
+            if (options.profile) {
+                write_json_file((fs::path(options.output_directory) / (queries[i].name + ".profile.json")).string(),
+                                profile.to_json());
+            }
+        } catch (const std::exception& e) {
+            outcomes[i].error = e.what();
+        }
+
+        outcomes[i].latency_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    const auto batch_start = std::chrono::steady_clock::now();
+
+    if (options.parallelism > 1) {
+        ThreadPool pool(options.parallelism);
+        TaskGroup group(pool);
+        for (size_t i = 0; i < queries.size(); ++i) {
+            group.run([&run_one, i] { run_one(i); });
+        }
+        group.wait();
+    } else {
+        for (size_t i = 0; i < queries.size(); ++i) {
+            run_one(i);
+        }
+    }
+
+    const double wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - batch_start).count();
+
+    // Summarize
+    json results = json::array();
+    std::vector<double> latencies;
+    size_t failed = 0;
+    size_t total_points = 0;
+
+    for (size_t i = 0; i < queries.size(); ++i) {
+        json result = {
+            {"name", queries[i].name},
+            {"points", outcomes[i].points},
+            {"latency_ms", outcomes[i].latency_ms}
+        };
+        if (queries[i].line > 0) {
+            result["line"] = queries[i].line;
+        }
+        if (!outcomes[i].error.empty()) {
+            result["error"] = outcomes[i].error;
+            ++failed;
+        } else {
+            latencies.push_back(outcomes[i].latency_ms);
+            total_points += outcomes[i].points;
+        }
+        results.push_back(result);
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    const double mean = latencies.empty()
+        ? 0.0 : std::accumulate(latencies.begin(), latencies.end(), 0.0) / static_cast<double>(latencies.size());
+
+    json summary = {
+        {"queries", queries.size()},
+        {"succeeded", queries.size() - failed},
+        {"failed", failed},
+        {"total_points", total_points},
+        {"parallelism", options.parallelism},
+        {"wall_ms", wall_ms},
+        {"latency_ms", {
+            {"min", latencies.empty() ? 0.0 : latencies.front()},
+            {"mean", mean},
+            {"p50", percentile(latencies, 50)},
+            {"p90", percentile(latencies, 90)},
+            {"p99", percentile(latencies, 99)},
+            {"max", latencies.empty() ? 0.0 : latencies.back()}
+        }},
+        {"results", results}
+    };
+
+    write_json_file((fs::path(options.output_directory) / "summary.json").string(), summary);
+
+    return summary;
+}
@@ -0,0 +1,49 @@
+#ifndef BATCH_RUNNER_H
+#define BATCH_RUNNER_H
+
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "output_writer.h"
+#include "query_engine.h"
+
+using json = nlohmann::json;
+
+struct BatchQuery {
+    std::string name;  // used for the per-query output file
+    json query;
+    // Line in the .jsonl or list file, 0 for a query from a directory
+    size_t line = 0;
+    // Why the query could not be read; run_batch reports it as failed
+    std::string error;
+};
+
+// Reads the queries of a batch from
+// - a directory: every *.json file in it, in name order
+// - a .jsonl file: one query document per line
+// - any other file: one query file path per line (relative to the list)
+// A query that cannot be read or parsed is returned with its error, so the
+// rest of the batch still runs. Throws std::runtime_error only if source
+// itself cannot be opened.
+std::vector<BatchQuery> load_batch(const std::string& source);
+
+struct BatchOptions {
+    std::string output_directory = "batch_output";
+    OutputFormat format = OutputFormat::Text;
+    int precision = 6;
+    // Queries executed concurrently on the shared engine
+    size_t parallelism = 1;
+    // Also write <name>.profile.json with the execution statistics
+    bool profile = false;
+};
+
+// Runs every query on the same engine, writes <name>.<ext> per query and
+// summary.json into the output directory and returns the summary. Failed
+// queries are reported in the summary instead of aborting the batch.
+json run_batch(QueryEngine& engine, const std::vector<BatchQuery>& queries, const BatchOptions& options);
+
+// Nearest-rank percentile (0-100) of an ascending list of values
+double percentile(const std::vector<double>& sorted_values, double p);
+
+#endif // BATCH_RUNNER_H
@@ -0,0 +1,178 @@
+#include <stdexcept>
+#include <utility>
+
+#include "connection_pool.h"
+
+ConnectionPool::Lease::Lease(ConnectionPool* pool, std::unique_ptr<Entry> entry)
+    : pool_(pool), entry_(std::move(entry)) {
+}
+
+ConnectionPool::Lease::Lease(Lease&& other) noexcept
+    : pool_(other.pool_), entry_(std::move(other.entry_)) {
+    other.pool_ = nullptr;
+}
+
+ConnectionPool::Lease& ConnectionPool::Lease::operator=(Lease&& other) noexcept {
+    if (this != &other) {
+        release();
+        pool_ = other.pool_;
+        entry_ = std::move(other.entry_);
+        other.pool_ = nullptr;
+    }
+    return *this;
+}
+
+ConnectionPool::Lease::~Lease() {
+    release();
+}
+
+void ConnectionPool::Lease::release() {
+    if (pool_ && entry_) {
+        pool_->give_back(std::move(entry_));
+    }
+    pool_ = nullptr;
+}
+
+ConnectionPool::ConnectionPool(const std::string& connection_string, const ConnectionPoolOptions& options)
+    : connection_string_(connection_string), options_(options) {
+    if (options_.max_connections == 0) {
+        options_.max_connections = 1;
+    }
+    if (options_.min_connections > options_.max_connections) {
+        options_.min_connections = options_.max_connections;
+    }
+
+    // Warm up; connection failures surface here rather than on first query
+    for (size_t i = 0; i < options_.min_connections; ++i) {
+        idle_.push_back(open_entry());
+        ++open_;
+    }
+}
+
+std::unique_ptr<ConnectionPool::Entry> ConnectionPool::open_entry() {
+    auto entry = std::make_unique<Entry>();
+    entry->conn = std::make_unique<pqxx::connection>(connection_string_);
+    if (!entry->conn->is_open()) {
+        throw std::runtime_error("Cannot connect to database");
+    }
+    entry->last_used = std::chrono::steady_clock::now();
+    return entry;
+}
+
+bool ConnectionPool::healthy(Entry& entry) {
+    if (!entry.conn->is_open()) {
+        return false;
+    }
+
+    if (std::chrono::steady_clock::now() - entry.last_used < options_.health_check_after) {
+        return true;
+    }
+
+    // Long idle connections may have been dropped by the server or a proxy
+    try {
+        pqxx::nontransaction probe(*entry.conn);
+        probe.exec("SELECT 1");
+        return true;
+    } catch (const pqxx::broken_connection&) {
+        return false;
+    }
+}
+
+void ConnectionPool::prepare_statements(Entry& entry) {
+    std::map<std::string, std::string> statements;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        statements = statements_;
+    }
+
+    for (const auto& statement : statements) {
+        if (entry.prepared.insert(statement.first).second) {
+            entry.conn->prepare(statement.first, statement.second);
+        }
+    }
+}
+
+ConnectionPool::Lease ConnectionPool::acquire() {
+    return acquire(true);
+}
+
+ConnectionPool::Lease ConnectionPool::try_acquire() {
+    return acquire(false);
+}
+
+ConnectionPool::Lease ConnectionPool::acquire(bool wait) {
+    const auto deadline = std::chrono::steady_clock::now() + options_.acquire_timeout;
+
+    std::unique_ptr<Entry> entry;
+    bool open_new = false;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (idle_.empty() && open_ >= options_.max_connections) {
+            if (!wait) {
+                return Lease();
+            }
+            if (returned_.wait_until(lock, deadline) == std::cv_status::timeout &&
+                idle_.empty() && open_ >= options_.max_connections) {
+                throw std::runtime_error("Timed out waiting for a database connection");
+            }
+        }
+
+        if (!idle_.empty()) {
+            entry = std::move(idle_.back());
+            idle_.pop_back();
+        } else {
+            // Reserve the slot before connecting outside the lock
+            ++open_;
+            open_new = true;
+        }
+    }
+
+    try {
+        if (open_new) {
+            entry = open_entry();
+        } else if (!healthy(*entry)) {
+            // Replace the dead connection and keep its slot
+            entry = open_entry();
+        }
+        prepare_statements(*entry);
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --open_;
+        returned_.notify_one();
+        throw;
+    }
+
+    return Lease(this, std::move(entry));
+}
+
+void ConnectionPool::give_back(std::unique_ptr<Entry> entry) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (entry->conn->is_open()) {
+        entry->last_used = std::chrono::steady_clock::now();
+        idle_.push_back(std::move(entry));
+    } else {
+        --open_;
+    }
+    returned_.notify_one();
+}
+
+void ConnectionPool::prepare(const std::string& name, const std::string& sql) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto existing = statements_.find(name);
+    if (existing != statements_.end() && existing->second != sql) {
+        throw std::runtime_error("Prepared statement registered twice with different SQL: " + name);
+    }
+    statements_[name] = sql;
+}
+
+size_t ConnectionPool::open_connections() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return open_;
+}
+
+size_t ConnectionPool::idle_connections() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return idle_.size();
+}
@@ -0,0 +1,95 @@
+#ifndef CONNECTION_POOL_H
+#define CONNECTION_POOL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include <pqxx/pqxx>
+
+struct ConnectionPoolOptions {
+    // Connections opened up front so the first queries do not pay for them
+    size_t min_connections = 1;
+    // Hard cap; acquire() waits for a returned connection beyond this
+    size_t max_connections = 8;
+    // How long acquire() waits before giving up
+    std::chrono::milliseconds acquire_timeout{5000};
+    // Idle connections older than this are probed with SELECT 1 before reuse
+    std::chrono::milliseconds health_check_after{30000};
+};
+
+// Thread-safe pool of warm PostgreSQL connections. Statements registered with
+// prepare() are prepared on every connection before it is handed out.
+class ConnectionPool {
+private:
+    struct Entry {
+        std::unique_ptr<pqxx::connection> conn;
+        std::set<std::string> prepared;
+        std::chrono::steady_clock::time_point last_used;
+    };
+
+public:
+    // Exclusive use of one pooled connection; returns it on destruction
+    class Lease {
+    public:
+        Lease() = default;
+        Lease(Lease&& other) noexcept;
+        Lease& operator=(Lease&& other) noexcept;
+        ~Lease();
+
+        explicit operator bool() const { return entry_ != nullptr; }
+        pqxx::connection& operator*() const { return *entry_->conn; }
+        pqxx::connection* operator->() const { return entry_->conn.get(); }
+
+    private:
+        friend class ConnectionPool;
+        Lease(ConnectionPool* pool, std::unique_ptr<Entry> entry);
+        void release();
+
+        ConnectionPool* pool_ = nullptr;
+        std::unique_ptr<Entry> entry_;
+    };
+
+    explicit ConnectionPool(const std::string& connection_string,
+                            const ConnectionPoolOptions& options = ConnectionPoolOptions());
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    // Blocks up to acquire_timeout; throws std::runtime_error on timeout
+    Lease acquire();
+    // Returns an empty lease instead of waiting when the pool is exhausted
+    Lease try_acquire();
+
+    // Registers a statement to be prepared on every pooled connection. Names
+    // must be unique per SQL text.
+    void prepare(const std::string& name, const std::string& sql);
+
+    size_t open_connections() const;
+    size_t idle_connections() const;
+    // For connections that must stay outside the pool, e.g. to LISTEN
+    const std::string& connection_string() const { return connection_string_; }
+
+private:
+    std::string connection_string_;
+    ConnectionPoolOptions options_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable returned_;
+    std::vector<std::unique_ptr<Entry>> idle_;
+    size_t open_ = 0;
+    std::map<std::string, std::string> statements_;
+
+    Lease acquire(bool wait);
+    std::unique_ptr<Entry> open_entry();
+    bool healthy(Entry& entry);
+    void prepare_statements(Entry& entry);
+    void give_back(std::unique_ptr<Entry> entry);
+};
+
+#endif // CONNECTION_POOL_H
@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "cost_model.h"
+#include "statistics_catalog.h"
+
+namespace {
+
+constexpr double kRoundTrip = 200.0;     // per round-trip to the server
+constexpr double kStatement = 30.0;      // parse and plan one statement
+constexpr double kScanRow = 0.05;        // server scans one row
+constexpr double kIndexLevel = 1.0;      // descend one level of the position index
+constexpr double kFullScanShare = 0.5;   // share of the rows past which a statement scans the table
+constexpr double kProperProbe = 0.1;     // server checks one group member
+constexpr double kServerSetRow = 0.1;    // INTERSECT / UNION of one row
+constexpr double kTransferId = 0.3;      // send one id and insert it into a set
+constexpr double kTransferRow = 0.8;     // send one full row
+constexpr double kEvalRow = 0.01;        // test one row against one crop in-process
+constexpr double kClientSetRow = 0.15;   // combine one id on the client
+constexpr double kTask = 50.0;           // hand one operand to a worker
+
+// Fraction of [lo, hi] that [a, b] covers
+double overlap(double lo, double hi, double a, double b) {
+    const double from = std::max(lo, a);
+    const double to = std::min(hi, b);
+    if (to < from) {
+        return 0.0;
+    }
+    return hi > lo ? (to - from) / (hi - lo) : 1.0;
+}
+
+Rectangle intersect(const Rectangle& a, const Rectangle& b) {
+    return {std::max(a.x_min, b.x_min), std::max(a.y_min, b.y_min),
+            std::min(a.x_max, b.x_max), std::min(a.y_max, b.y_max)};
+}
+
+} // namespace
+
+bool array_range(const std::string& values, double& lo, double& hi) {
+    if (values.size() < 3 || values.front() != '{' || values.back() != '}') {
+        return false;
+    }
+
+    bool found = false;
+    const char* p = values.c_str() + 1;
+    const char* end = values.c_str() + values.size() - 1;
+    while (p < end) {
+        char* next = nullptr;
+        const double value = std::strtod(p, &next);
+        if (next == p) {
+            return false;
+        }
+        lo = found ? std::min(lo, value) : value;
+        hi = found ? std::max(hi, value) : value;
+        found = true;
+        p = (*next == ',') ? next + 1 : next;
+    }
+    return found;
+}
+
+CostModel::CostModel(const TableStatistics& statistics, size_t threads, const StatisticsCatalog* catalog)
+    : statistics_(statistics), threads_(threads), catalog_(catalog) {
+}
+
+double CostModel::area_fraction(const Rectangle& region) const {
+    const Rectangle& e = statistics_.extent;
+    return overlap(e.x_min, e.x_max, region.x_min, region.x_max) *
+           overlap(e.y_min, e.y_max, region.y_min, region.y_max);
+}
+
+double CostModel::region_rows(const Rectangle& region, const Rectangle& valid_region) const {
+    if (catalog_) {
+        CropSpec scan;
+        scan.region = region;
+        return catalog_->crop_rows(scan, valid_region);
+    }
+    return statistics_.rows * area_fraction(intersect(region, valid_region));
+}
+
+double CostModel::scan_cost(double rows) const {
+    const double n = statistics_.rows;
+    if (rows >= kFullScanShare * n) {
+        return n * kScanRow;
+    }
+    return std::log2(std::max(n, 2.0)) * kIndexLevel + rows * kScanRow;
+}
+
+double CostModel::crop_rows(const CropSpec& crop, const Rectangle& valid_region) const {
+    if (catalog_) {
+        return catalog_->crop_rows(crop, valid_region);
+    }
+    double rows = statistics_.rows * area_fraction(intersect(crop.region, valid_region)) * crop.shape.coverage();
+    if (crop.has_category) {
+        rows /= std::max(statistics_.categories, 1.0);
+    }
+    if (crop.has_groups) {
+        rows *= std::min(1.0, static_cast<double>(crop.groups.size()) / std::max(statistics_.groups, 1.0));
+    }
+    return rows;
+}
+
+double CostModel::result_rows(const QueryNode& node, const Rectangle& valid_region) const {
+    if (catalog_) {
+        return catalog_->result_rows(node, valid_region);
+    }
+    if (node.type == NodeType::Crop) {
+        return crop_rows(node.crop, valid_region);
+    }
+    if (node.children.empty()) {
+        return 0.0;
+    }
+    // A difference returns at most its first operand
+    if (node.type == NodeType::Difference) {
+        return result_rows(*node.children.front(), valid_region);
+    }
+
+    double rows = (node.type == NodeType::And) ? statistics_.rows : 0.0;
+    for (const auto& child : node.children) {
+        const double child_rows = result_rows(*child, valid_region);
+        rows = (node.type == NodeType::And) ? std::min(rows, child_rows) : rows + child_rows;
+    }
+    return std::min(rows, statistics_.rows);
+}
+
+std::vector<StrategyCost> CostModel::estimate(const QueryNode& plan, const Rectangle& valid_region) const {
+    std::vector<const QueryNode*> leaves;
+    collect_leaves(plan, leaves);
+
+    const double leaf_count = static_cast<double>(leaves.size());
+    const double result = result_rows(plan, valid_region);
+
+    // Work every per-crop statement does on the server, and the rows the
+    // crops return between them. The position index reads the rows under a
+    // crop's rectangle; the category, groups and shape only filter them
+    double server = 0.0;
+    double leaf_rows = 0.0;
+    bool has_proper = false;
+    for (const QueryNode* leaf : leaves) {
+        const double rows = crop_rows(leaf->crop, valid_region);
+        server += kStatement + scan_cost(region_rows(leaf->crop.region, valid_region));
+        if (leaf->crop.proper) {
+            server += rows * statistics_.mean_group_size() * kProperProbe;
+            has_proper = true;
+        }
+        leaf_rows += rows;
+    }
+    Rectangle bbox{0.0, 0.0, 0.0, 0.0};
+    double snapshot_rows = 0.0;
+    if (plan_bounds(plan, bbox)) {
+        snapshot_rows = region_rows(bbox, valid_region);
+    }
+
+    // Rows that go through an AND / OR, on the client or the server; a lone
+    // crop is returned as it is
+    const double combined_rows = leaves.size() > 1 ? leaf_rows : 0.0;
+
+    std::vector<StrategyCost> costs;
+    costs.push_back({ExecutionStrategy::Pipelined,
+                     kRoundTrip + server + leaf_rows * kTransferId + combined_rows * kClientSetRow});
+    costs.push_back({ExecutionStrategy::Pushdown,
+                     kRoundTrip + server + combined_rows * kServerSetRow + result * kTransferId});
+
+    // One scan for the rows under the crops, the group bounds of proper
+    // crops, then every crop tested in memory
+    double in_process = kRoundTrip + kStatement + scan_cost(snapshot_rows) + snapshot_rows * kTransferRow +
+                        leaf_count * snapshot_rows * kEvalRow + result * kClientSetRow;
+    if (has_proper) {
+        in_process += kStatement + snapshot_rows * statistics_.mean_group_size() * kProperProbe;
+    }
+    costs.push_back({ExecutionStrategy::InProcess, in_process});
+
+    if (threads_ > 1 && leaves.size() > 1) {
+        const double lanes = std::min(static_cast<double>(threads_), leaf_count);
+        costs.push_back({ExecutionStrategy::Parallel,
+                         kRoundTrip + (server + leaf_rows * kTransferId) / lanes + leaf_count * kTask +
+                         combined_rows * kClientSetRow});
+    }
+    costs.push_back({ExecutionStrategy::Sequential,
+                     leaf_count * kRoundTrip + server + leaf_rows * kTransferId + combined_rows * kClientSetRow});
+
+    std::stable_sort(costs.begin(), costs.end(), [](const StrategyCost& a, const StrategyCost& b) {
+        return a.cost_us < b.cost_us;
+    });
+    return costs;
+}
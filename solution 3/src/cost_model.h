@@ -0,0 +1,54 @@
+#ifndef COST_MODEL_H
+#define COST_MODEL_H
+
+#include <string>
+#include <vector>
+
+#include "query_plan.h"
+
+class StatisticsCatalog;
+
+// Smallest and largest element of a numeric pg_stats array in text form,
+// e.g. histogram_bounds or most_common_vals "{0.5,12,99.25}". Returns false
+// for an empty or malformed array.
+bool array_range(const std::string& values, double& lo, double& hi);
+
+struct StrategyCost {
+    ExecutionStrategy strategy;
+    double cost_us;
+};
+
+// Estimates what each execution strategy would cost for a plan, assuming
+// every crop statement reads the rows under its rectangle through the
+// position index, or scans the table when that is most of it. Row counts
+// come from the statistics catalog when there is one, and otherwise assume
+// points are spread uniformly over the extent. The constants are rough microsecond figures for
+// a local server; only their ratios matter for the choice.
+class CostModel {
+public:
+    // catalog, if given, must outlive the model
+    CostModel(const TableStatistics& statistics, size_t threads, const StatisticsCatalog* catalog = nullptr);
+
+    // Points a crop selects within the valid region; a polygon or circle
+    // selects its share of its bounding box
+    double crop_rows(const CropSpec& crop, const Rectangle& valid_region) const;
+    // Points an optimized plan selects
+    double result_rows(const QueryNode& node, const Rectangle& valid_region) const;
+
+    // Every applicable strategy with its cost, cheapest first; ties keep the
+    // order Pipelined, Pushdown, InProcess, Parallel, Sequential
+    std::vector<StrategyCost> estimate(const QueryNode& plan, const Rectangle& valid_region) const;
+
+private:
+    TableStatistics statistics_;
+    size_t threads_;
+    const StatisticsCatalog* catalog_;
+
+    double area_fraction(const Rectangle& region) const;
+    // Points under a rectangle within the valid region, before any filter
+    double region_rows(const Rectangle& region, const Rectangle& valid_region) const;
+    // Server work to read rows points through the index, or the whole table
+    double scan_cost(double rows) const;
+};
+
+#endif // COST_MODEL_H
@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+#include "crop_shape.h"
+
+namespace {
+
+// One polygon edge in the form the crossing test uses; horizontal edges
+// never cross a ray and are left out
+struct Edge {
+    double x0, y0, y1, dx, dy;
+};
+
+std::vector<Edge> crossing_edges(const std::vector<double>& xs, const std::vector<double>& ys) {
+    std::vector<Edge> edges;
+    const size_t n = xs.size();
+    for (size_t i = 0, j = n - 1; i < n; j = i++) {
+        if (ys[i] == ys[j]) continue;
+        edges.push_back({xs[i], ys[i], ys[j], xs[j] - xs[i], ys[j] - ys[i]});
+    }
+    return edges;
+}
+
+} // namespace
+
+const char* shape_name(CropShape::Kind kind) {
+    switch (kind) {
+    case CropShape::Kind::Polygon: return "polygon";
+    case CropShape::Kind::Circle: return "circle";
+    default: return "rectangle";
+    }
+}
+
+Rectangle CropShape::bounds() const {
+    if (kind == Kind::Circle) {
+        return {center_x - radius, center_y - radius, center_x + radius, center_y + radius};
+    }
+    if (xs.empty()) {
+        return {0.0, 0.0, -1.0, -1.0};
+    }
+    return {*std::min_element(xs.begin(), xs.end()), *std::min_element(ys.begin(), ys.end()),
+            *std::max_element(xs.begin(), xs.end()), *std::max_element(ys.begin(), ys.end())};
+}
+
+double CropShape::coverage() const {
+    if (kind == Kind::Circle) {
+        return std::atan(1.0);   // pi / 4
+    }
+    if (kind == Kind::Rectangle) {
+        return 1.0;
+    }
+
+    // Shoelace area over the bounding box
+    const Rectangle box = bounds();
+    const double box_area = (box.x_max - box.x_min) * (box.y_max - box.y_min);
+    double area = 0.0;
+    for (size_t i = 0, j = xs.size() - 1; i < xs.size(); j = i++) {
+        area += xs[j] * ys[i] - xs[i] * ys[j];
+    }
+    return box_area > 0.0 ? std::min(1.0, std::abs(area) / 2.0 / box_area) : 0.0;
+}
+
+bool CropShape::contains(double x, double y) const {
+    uint8_t inside = 0;
+    contains(&x, &y, 1, &inside);
+    return inside != 0;
+}
+
+void CropShape::contains(const double* x, const double* y, size_t n, uint8_t* inside) const {
+    if (kind == Kind::Rectangle) {
+        std::fill(inside, inside + n, uint8_t{1});
+        return;
+    }
+
+    if (kind == Kind::Circle) {
+        const double r2 = radius * radius;
+        for (size_t i = 0; i < n; ++i) {
+            const double dx = x[i] - center_x;
+            const double dy = y[i] - center_y;
+            inside[i] = (dx * dx + dy * dy) <= r2;
+        }
+        return;
+    }
+
+    std::fill(inside, inside + n, uint8_t{0});
+    for (const Edge& e : crossing_edges(xs, ys)) {
+        for (size_t i = 0; i < n; ++i) {
+            const bool spans = (y[i] < e.y0) != (y[i] < e.y1);
+            const bool left = x[i] < e.dx * (y[i] - e.y0) / e.dy + e.x0;
+            inside[i] ^= static_cast<uint8_t>(spans & left);
+        }
+    }
+}
+
+std::string CropShape::sql_predicate(const std::string& x, const std::string& y) const {
+    std::ostringstream sql;
+    sql.precision(std::numeric_limits<double>::max_digits10);
+
+    if (kind == Kind::Rectangle) {
+        return "TRUE";
+    }
+    if (kind == Kind::Circle) {
+        sql << "((" << x << " - " << center_x << ") * (" << x << " - " << center_x << ") + ("
+            << y << " - " << center_y << ") * (" << y << " - " << center_y << ") <= " << radius * radius << ")";
+        return sql.str();
+    }
+
+    const std::vector<Edge> edges = crossing_edges(xs, ys);
+    if (edges.empty()) {
+        return "FALSE";
+    }
+    sql << "((";
+    for (size_t k = 0; k < edges.size(); ++k) {
+        const Edge& e = edges[k];
+        if (k > 0) sql << " + ";
+        sql << "CASE WHEN (" << y << " < " << e.y0 << ") <> (" << y << " < " << e.y1 << ") AND "
+            << x << " < " << e.dx << " * (" << y << " - " << e.y0 << ") / " << e.dy << " + " << e.x0
+            << " THEN 1 ELSE 0 END";
+    }
+    sql << ") % 2 = 1)";
+    return sql.str();
+}
@@ -0,0 +1,46 @@
+#ifndef CROP_SHAPE_H
+#define CROP_SHAPE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "query_engine.h"
+
+// Outline of a crop that is not an axis-aligned rectangle. The crop's region
+// is the shape's bounding box, which every execution path already filters
+// by (and which the indexes serve); the exact test then runs only on the
+// points inside it.
+//
+// The SQL and C++ tests evaluate the same double-precision expressions in the
+// same order, so they agree on every point, including those on an edge.
+// Polygons use the even-odd rule: a point on an edge may fall either way, but
+// the same way in SQL, in-process and in the reference evaluator.
+struct CropShape {
+    enum class Kind {
+        Rectangle,   // the region itself, no further test
+        Polygon,
+        Circle
+    };
+
+    Kind kind = Kind::Rectangle;
+    std::vector<double> xs, ys;   // Polygon vertices, implicitly closed
+    double center_x = 0.0, center_y = 0.0, radius = 0.0;
+
+    Rectangle bounds() const;
+    // Fraction of the bounding box the shape covers, for row estimates
+    double coverage() const;
+
+    bool contains(double x, double y) const;
+    // inside[i] = contains(x[i], y[i]); the loop over points is innermost so
+    // it vectorizes
+    void contains(const double* x, const double* y, size_t n, uint8_t* inside) const;
+
+    // The same test as SQL over the given coordinate expressions
+    std::string sql_predicate(const std::string& x, const std::string& y) const;
+};
+
+const char* shape_name(CropShape::Kind kind);
+
+#endif // CROP_SHAPE_H
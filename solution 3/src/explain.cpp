@@ -0,0 +1,90 @@
+#include <sstream>
+
+#include "explain.h"
+
+namespace {
+
+std::string format_region(const json& region) {
+    std::ostringstream out;
+    out << "[" << region[0].get<double>() << ", " << region[1].get<double>() << "] - ["
+        << region[2].get<double>() << ", " << region[3].get<double>() << "]";
+    return out.str();
+}
+
+void format_node(const json& node, int depth, std::ostringstream& out) {
+    const std::string indent(static_cast<size_t>(depth) * 4, ' ');
+    const std::string detail_indent = indent + "      ";
+    const std::string op = node["operator"].get<std::string>();
+
+    out << indent << (depth > 0 ? "->  " : "");
+    if (op == "crop") {
+        out << "CROP #" << node["leaf_index"].get<size_t>() << " ";
+        if (node.contains("shape")) out << node["shape"].get<std::string>() << " in ";
+        out << format_region(node["region"]);
+        if (node.contains("category")) out << " category=" << node["category"].get<int>();
+        if (node.contains("groups")) out << " groups=" << node["groups"].dump();
+        if (node.value("proper", false)) out << " proper";
+    } else {
+        out << (op == "and" ? "AND" : op == "difference" ? "EXCEPT" : "OR") << " (" << node["children"].size() << " operands)";
+    }
+
+    out << "  (estimated rows=" << static_cast<long long>(node["estimated_rows"].get<double>());
+    if (node.contains("catalog_rows")) {
+        out << ", catalog rows=" << static_cast<long long>(node["catalog_rows"].get<double>());
+    }
+    if (node.contains("actual_rows")) {
+        out << ", actual rows=" << node["actual_rows"].get<size_t>()
+            << ", time=" << node["wall_ms"].get<double>() << " ms";
+    }
+    out << ")" << (node.value("pipelined", false) ? " pipelined" : "") << "\n";
+
+    if (op == "crop") {
+        for (const auto& scan : node["scans"]) {
+            out << detail_indent << scan["node_type"].get<std::string>() << " on " << scan["relation"].get<std::string>();
+            if (scan.contains("index")) out << " using " << scan["index"].get<std::string>();
+            out << "\n";
+        }
+        if (node.contains("buffers")) {
+            out << detail_indent << "Buffers: shared hit=" << node["buffers"]["shared_hit"].get<long long>()
+                << " read=" << node["buffers"]["shared_read"].get<long long>()
+                << ", server time=" << node["server_ms"].get<double>() << " ms\n";
+        }
+        out << detail_indent << "SQL: " << node["sql"].get<std::string>() << "\n";
+    } else {
+        for (const auto& child : node["children"]) {
+            format_node(child, depth + 1, out);
+        }
+    }
+}
+
+} // namespace
+
+std::string format_explain(const json& explain) {
+    std::ostringstream out;
+    out << "Valid region " << format_region(explain["valid_region"])
+        << ", threads=" << explain["threads"].get<size_t>()
+        << ", crop_tiles=" << explain["crop_tiles"].get<size_t>()
+        << (explain["quantized"].get<bool>() ? ", quantized coordinates" : "")
+        << (explain.value("partitioned", false) ? ", partitioned table" : "") << "\n";
+    out << "Strategy " << explain["strategy"].get<std::string>() << " ("
+        << explain["strategy_source"].get<std::string>() << ")";
+    if (explain.contains("estimated_cost_us")) {
+        out << ", estimated cost from " << explain.value("statistics_source", "pg_stats") << ":";
+        for (const auto& [name, cost] : explain["estimated_cost_us"].items()) {
+            out << " " << name << "=" << static_cast<long long>(cost.get<double>()) << "us";
+        }
+    }
+    out << "\n";
+
+    format_node(explain["plan"], 0, out);
+
+    if (explain.contains("aggregate_sql")) {
+        out << "Aggregate SQL: " << explain["aggregate_sql"].get<std::string>() << "\n";
+    }
+
+    if (explain.contains("sql_statements")) {
+        out << "SQL statements: " << explain["sql_statements"].get<size_t>()
+            << ", round-trips: " << explain["sql_round_trips"].get<size_t>() << "\n";
+    }
+    return out.str();
+}
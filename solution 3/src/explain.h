@@ -0,0 +1,13 @@
+#ifndef EXPLAIN_H
+#define EXPLAIN_H
+
+#include <string>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+// Renders the result of QueryEngine::explain as an indented, EXPLAIN
+// ANALYZE-like text tree, one operator per line followed by its details.
+std::string format_explain(const json& explain);
+
+#endif // EXPLAIN_H
@@ -1,55 +1,281 @@
 #include <iostream>
 #include <fstream>
 #include <filesystem>
+#include <memory>
+#include <chrono>
+#include <csignal>
 #include <gflags/gflags.h>
 #include <nlohmann/json.hpp>
 
+#include "batch_runner.h"
+#include "connection_pool.h"
+#include "explain.h"
+#include "output_writer.h"
+#include "profile.h"
 #include "query_engine.h"
+#include "query_plan.h"
+#include "query_server.h"
+#include "subscription.h"
 
 using json = nlohmann::json;
 
 // --- Command-line Flag Definitions ---
 DEFINE_string(query, "", "JSON query file.");
+DEFINE_string(batch, "", "Run many queries: a directory of *.json files, a .jsonl file, or a file listing query paths.");
+DEFINE_string(batch_output_dir, "batch_output", "Directory for per-query outputs and summary.json in batch mode.");
+DEFINE_int32(batch_parallel, 1, "Queries executed concurrently in batch mode.");
+DEFINE_string(serve, "", "Run as a daemon answering framed JSON queries on this Unix socket path.");
+DEFINE_int32(serve_max_connections, 16, "Client connections served concurrently in server mode.");
+DEFINE_string(output, "output.txt", "Output file, or - for stdout.");
+DEFINE_string(output_format, "text", "Output format: text, csv, f64 (packed float64 pairs) or f32 (packed float32 pairs).");
+DEFINE_int32(output_precision, 6, "Significant digits for text and csv output; 0 writes the shortest exact form.");
+DEFINE_string(explain, "", "Print the plan of --query instead of its results: 'plan' for estimates, 'analyze' to also run it.");
+DEFINE_bool(subscribe, false, "Keep --query's result up to date: print it, then one JSON line per change to it, until interrupted.");
+DEFINE_bool(profile, false, "Write per-operator execution statistics as JSON next to the results.");
+DEFINE_string(strategy, "auto", "Execution strategy: auto (chosen per query from table statistics), sequential, pipelined, parallel, pushdown or in_process.");
+DEFINE_int32(threads, 1, "Worker threads for evaluating query subtrees in parallel.");
+DEFINE_int32(crop_tiles, 1, "Split each crop into this many bands evaluated in parallel (needs --threads > 1).");
+
+static const char* kConnectionString = "dbname=inspection_db user=postgres password=postgres host=localhost port=5432";
+
+// Cursor of the page after one that ended with last, or null when the page
+// was not full and so was the last one
+static json next_page(const json& query_json, size_t points, const Point& last) {
+    const PageSpec page = parse_page(query_json);
+    if (!page.has_limit || points == 0 || points < page.limit) {
+        return nullptr;
+    }
+    return {{"y", last.y}, {"x", last.x}, {"id", last.id}};
+}
+
+static volatile std::sig_atomic_t g_unsubscribed = 0;
+
+static void handle_unsubscribe_signal(int) {
+    g_unsubscribed = 1;
+}
+
+// One JSON line per refresh that changed the result: {"reloaded", "added":
+// [{"id", "x", "y"}, ...], "removed": [id, ...]}
+static int run_subscription(QueryEngine& engine, const json& query_json) {
+    QuerySubscription subscription(engine, query_json);
+    std::signal(SIGINT, handle_unsubscribe_signal);
+    std::signal(SIGTERM, handle_unsubscribe_signal);
+
+    std::cerr << "Subscribed; waiting for changes." << std::endl;
+    while (!g_unsubscribed) {
+        const ResultDelta delta = subscription.wait(std::chrono::milliseconds(1000));
+        if (delta.empty()) {
+            continue;
+        }
+        json added = json::array();
+        for (const auto& point : delta.added) {
+            added.push_back({{"id", point.id}, {"x", point.x}, {"y", point.y}});
+        }
+        std::cout << json{{"reloaded", delta.reloaded}, {"added", added}, {"removed", delta.removed}}.dump()
+                  << std::endl;
+    }
+    std::cerr << "Unsubscribed. " << subscription.result().size() << " points in the result." << std::endl;
+    return 0;
+}
+
+static int run_query(QueryEngine& engine) {
+    const std::filesystem::path query_file(FLAGS_query);
+
+    // Read JSON query
+    std::ifstream file(query_file);
+    if (!file.is_open()) {
+        throw std::runtime_error("Cannot open query file: " + query_file.string());
+    }
+
+    json query_json;
+    file >> query_json;
+
+    if (!FLAGS_explain.empty()) {
+        if (FLAGS_explain != "plan" && FLAGS_explain != "analyze") {
+            throw std::runtime_error("--explain must be 'plan' or 'analyze'");
+        }
+        std::cout << format_explain(engine.explain(query_json, FLAGS_explain == "analyze"));
+        return 0;
+    }
+
+    if (FLAGS_subscribe) {
+        return run_subscription(engine, query_json);
+    }
+
+    // Aggregates are a small JSON summary rather than points
+    if (query_json.contains("query") && is_aggregate(query_json["query"])) {
+        ProfileNode profile;
+        const json summary = engine.execute_aggregate(query_json, FLAGS_profile ? &profile : nullptr);
+        std::ostream& log = (FLAGS_output == "-") ? std::cerr : std::cout;
+        write_json_file(FLAGS_output, summary);
+        log << "Aggregate written to: " << FLAGS_output << std::endl;
+
+        if (FLAGS_profile) {
+            const std::string profile_path = (FLAGS_output == "-") ? "profile.json" : FLAGS_output + ".profile.json";
+            write_json_file(profile_path, profile.to_json());
+            log << "Profile written to: " << profile_path << std::endl;
+        }
+        return 0;
+    }
+
+    // Write output as the result streams in
+    OutputWriter out(FLAGS_output, parse_output_format(FLAGS_output_format), FLAGS_output_precision);
+
+    ProfileNode profile;
+    Point last{};
+    engine.execute_query_stream(query_json, [&out, &last](const std::vector<Point>& chunk) {
+        out.write(chunk);
+        last = chunk.back();
+    }, 10000, FLAGS_profile ? &profile : nullptr);
+    out.close();
+
+    // Keep stdout clean for the results when they are written there
+    std::ostream& log = (FLAGS_output == "-") ? std::cerr : std::cout;
+    log << "Query completed. Found " << out.points_written() << " points." << std::endl;
+    log << "Results written to: " << FLAGS_output << std::endl;
+    const json next = next_page(query_json, out.points_written(), last);
+    if (!next.is_null()) {
+        log << "Next page: \"after\": " << next.dump() << std::endl;
+    }
+
+    if (FLAGS_profile) {
+        const std::string profile_path = (FLAGS_output == "-") ? "profile.json" : FLAGS_output + ".profile.json";
+        write_json_file(profile_path, profile.to_json());
+        log << "Profile written to: " << profile_path << " (" << profile.total_sql_statements() << " SQL statements, "
+            << profile.total_sql_round_trips() << " round-trips)" << std::endl;
+    }
+
+    return 0;
+}
+
+static int run_batch_queries(QueryEngine& engine) {
+    std::vector<BatchQuery> queries = load_batch(FLAGS_batch);
+
+    BatchOptions batch_options;
+    batch_options.output_directory = FLAGS_batch_output_dir;
+    batch_options.format = parse_output_format(FLAGS_output_format);
+    batch_options.precision = FLAGS_output_precision;
+    batch_options.parallelism = static_cast<size_t>(FLAGS_batch_parallel);
+    batch_options.profile = FLAGS_profile;
+
+    json summary = run_batch(engine, queries, batch_options);
+
+    std::cout << "Batch completed. " << summary["succeeded"] << " of " << summary["queries"]
+              << " queries succeeded, " << summary["total_points"] << " points." << std::endl;
+    std::cout << "Latency ms: p50 " << summary["latency_ms"]["p50"]
+              << ", p90 " << summary["latency_ms"]["p90"]
+              << ", p99 " << summary["latency_ms"]["p99"] << std::endl;
+    std::cout << "Results written to: " << FLAGS_batch_output_dir << std::endl;
+
+    return summary["failed"].get<size_t>() == 0 ? 0 : 1;
+}
+
+static QueryServer* g_server = nullptr;
+
+static void handle_shutdown_signal(int) {
+    if (g_server) {
+        g_server->stop();
+    }
+}
+
+static int run_server(QueryEngine& engine) {
+    ServerOptions server_options;
+    server_options.socket_path = FLAGS_serve;
+    server_options.max_connections = static_cast<size_t>(FLAGS_serve_max_connections);
+
+    // Each request is a query document; the answer lists its points, plus
+    // the execution profile when the request sets "profile": true
+    QueryServer server(server_options, [&engine](const json& request) {
+        json points = json::array();
+        ProfileNode profile;
+        const bool profiled = FLAGS_profile || request.value("profile", false);
+
+        // Aggregates answer with their summary instead of points
+        if (request.contains("query") && is_aggregate(request["query"])) {
+            json response = engine.execute_aggregate(request, profiled ? &profile : nullptr);
+            if (profiled) {
+                response["profile"] = profile.to_json();
+            }
+            return response;
+        }
+
+        Point last{};
+        engine.execute_query_stream(request, [&points, &last](const std::vector<Point>& chunk) {
+            for (const auto& point : chunk) {
+                points.push_back({point.x, point.y});
+            }
+            last = chunk.back();
+        }, 10000, profiled ? &profile : nullptr);
+
+        json response = {{"count", points.size()}};
+        const json next = next_page(request, points.size(), last);
+        if (!next.is_null()) {
+            response["next_after"] = next;
+        }
+        response["points"] = std::move(points);
+        if (profiled) {
+            response["profile"] = profile.to_json();
+        }
+        return response;
+    });
+
+    server.start();
+    g_server = &server;
+    std::signal(SIGINT, handle_shutdown_signal);
+    std::signal(SIGTERM, handle_shutdown_signal);
+
+    std::cout << "Serving queries on " << FLAGS_serve << std::endl;
+    server.serve();
+    g_server = nullptr;
+    std::cout << "Server stopped." << std::endl;
+
+    return 0;
+}
 
 int main(int argc, char* argv[]) {
     try {
         gflags::ParseCommandLineFlags(&argc, &argv, true);
-        const std::filesystem::path query_file(FLAGS_query);
 
-        // Validate required --query flag
-        if (FLAGS_query.empty()) {
-            std::cerr << "Error: --query is a required argument." << std::endl;
+        // Validate required --query, --batch or --serve flag
+        const int modes = !FLAGS_query.empty() + !FLAGS_batch.empty() + !FLAGS_serve.empty();
+        if (modes != 1) {
+            std::cerr << "Error: exactly one of --query, --batch or --serve is required." << std::endl;
             return 1;
         }
 
-        // Read JSON query
-        std::ifstream file(query_file);
-        if (!file.is_open()) {
-            throw std::runtime_error("Cannot open query file: " + query_file.string());
+        if (FLAGS_threads < 1 || FLAGS_crop_tiles < 1 || FLAGS_batch_parallel < 1 || FLAGS_serve_max_connections < 1) {
+            std::cerr << "Error: --threads, --crop_tiles, --batch_parallel and --serve_max_connections must be at least 1." << std::endl;
+            return 1;
+        }
+        if (FLAGS_output_precision < 0 || FLAGS_output_precision > OutputWriter::kMaxPrecision) {
+            std::cerr << "Error: --output_precision must be between 0 and " << OutputWriter::kMaxPrecision << "."
+                      << std::endl;
+            return 1;
         }
 
-        json query_json;
-        file >> query_json;
+        EngineOptions options;
+        options.strategy = parse_strategy(FLAGS_strategy);
+        options.threads = static_cast<size_t>(FLAGS_threads);
+        options.crop_tiles = static_cast<size_t>(FLAGS_crop_tiles);
 
-        // Execute query
-        QueryEngine engine("dbname=inspection_db user=postgres password=postgres host=localhost port=5432");
-        std::vector<Point> results = engine.execute_query(query_json);
+        // One warm connection per concurrent query, plus room for subtree
+        // workers
+        const size_t concurrent_queries = static_cast<size_t>(
+            FLAGS_serve.empty() ? FLAGS_batch_parallel : FLAGS_serve_max_connections);
+        ConnectionPoolOptions pool_options;
+        pool_options.min_connections = concurrent_queries;
+        pool_options.max_connections = concurrent_queries + options.threads;
+        auto connections = std::make_shared<ConnectionPool>(kConnectionString, pool_options);
 
-        // Write output
-        std::string output_file = "output.txt";
-        std::ofstream out(output_file);
+        QueryEngine engine(connections, options);
 
-        for (const auto& point : results) {
-            out << point.x << " " << point.y << std::endl;
+        if (!FLAGS_serve.empty()) {
+            return run_server(engine);
         }
-
-        std::cout << "Query completed. Found " << results.size() << " points." << std::endl;
-        std::cout << "Results written to: " << output_file << std::endl;
+        return FLAGS_batch.empty() ? run_query(engine) : run_batch_queries(engine);
 
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
     }
-
-    return 0;
-}
\ No newline at end of file
+}
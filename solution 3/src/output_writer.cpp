@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "output_writer.h"
+
+namespace {
+
+// Longest to_chars output for a double in general format of at most
+// OutputWriter::kMaxPrecision digits, plus a separator
+constexpr size_t kMaxNumberChars = 32;
+
+} // namespace
+
+OutputFormat parse_output_format(const std::string& name) {
+    if (name == "text") return OutputFormat::Text;
+    if (name == "csv") return OutputFormat::Csv;
+    if (name == "f64") return OutputFormat::Binary64;
+    if (name == "f32") return OutputFormat::Binary32;
+    throw std::runtime_error("Unknown output format: " + name + " (expected text, csv, f64 or f32)");
+}
+
+void write_json_file(const std::string& path, const nlohmann::json& value) {
+    if (path == "-") {
+        std::cout << value.dump(2) << std::endl;
+        if (!std::cout) {
+            throw std::runtime_error("Failed to write JSON to stdout");
+        }
+        return;
+    }
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Cannot open output file: " + path);
+    }
+    file << value.dump(2) << std::endl;
+    file.close();
+    if (!file) {
+        throw std::runtime_error("Failed to write " + path);
+    }
+}
+
+OutputWriter::OutputWriter(const std::string& path, OutputFormat format, int precision, size_t buffer_size)
+    : format_(format), precision_(std::clamp(precision, 0, kMaxPrecision)),
+      buffer_(std::max<size_t>(buffer_size, 2 * kMaxNumberChars)) {
+    if (path == "-") {
+        file_ = stdout;
+    } else {
+        file_ = std::fopen(path.c_str(), "wb");
+        if (!file_) {
+            throw std::runtime_error("Cannot open output file: " + path);
+        }
+        owns_file_ = true;
+    }
+
+    if (format_ == OutputFormat::Csv) {
+        append("x,y\n", 4);
+    }
+}
+
+OutputWriter::~OutputWriter() {
+    try {
+        close();
+    } catch (const std::exception&) {
+        // Destructors must not throw; call close() to observe write errors
+    }
+}
+
+void OutputWriter::append(const void* data, size_t size) {
+    if (used_ + size > buffer_.size()) {
+        write_buffer();
+    }
+    std::memcpy(buffer_.data() + used_, data, size);
+    used_ += size;
+}
+
+bool OutputWriter::try_append_number(double value) {
+    char* first = buffer_.data() + used_;
+    char* last = buffer_.data() + buffer_.size();
+    std::to_chars_result res = precision_ > 0
+        ? std::to_chars(first, last, value, std::chars_format::general, precision_)
+        : std::to_chars(first, last, value);
+    if (res.ec != std::errc()) {
+        return false;
+    }
+    used_ = static_cast<size_t>(res.ptr - buffer_.data());
+    return true;
+}
+
+void OutputWriter::append_char(char c) {
+    if (used_ == buffer_.size()) {
+        write_buffer();
+    }
+    buffer_[used_++] = c;
+}
+
+void OutputWriter::append_number(double value) {
+    // The caller reserved kMaxNumberChars, so this only fails if the number
+    // is longer than that; an empty buffer has room for it
+    if (!try_append_number(value)) {
+        write_buffer();
+        if (!try_append_number(value)) {
+            throw std::runtime_error("Number too long to format");
+        }
+    }
+}
+
+void OutputWriter::write(const Point& point) {
+    switch (format_) {
+        case OutputFormat::Text:
+        case OutputFormat::Csv:
+            if (used_ + 2 * kMaxNumberChars > buffer_.size()) {
+                write_buffer();
+            }
+            append_number(point.x);
+            append_char((format_ == OutputFormat::Csv) ? ',' : ' ');
+            append_number(point.y);
+            append_char('\n');
+            break;
+        case OutputFormat::Binary64: {
+            const double values[2] = {point.x, point.y};
+            append(values, sizeof(values));
+            break;
+        }
+        case OutputFormat::Binary32: {
+            const float values[2] = {static_cast<float>(point.x), static_cast<float>(point.y)};
+            append(values, sizeof(values));
+            break;
+        }
+    }
+    ++points_written_;
+}
+
+void OutputWriter::write(const std::vector<Point>& points) {
+    for (const auto& point : points) {
+        write(point);
+    }
+}
+
+void OutputWriter::write_buffer() {
+    if (used_ > 0 && std::fwrite(buffer_.data(), 1, used_, file_) != used_) {
+        throw std::runtime_error("Failed to write results");
+    }
+    used_ = 0;
+}
+
+void OutputWriter::flush() {
+    if (!file_) {
+        return;
+    }
+    write_buffer();
+    if (std::fflush(file_) != 0) {
+        throw std::runtime_error("Failed to write results");
+    }
+}
+
+void OutputWriter::close() {
+    if (!file_) {
+        return;
+    }
+
+    std::FILE* file = file_;
+    try {
+        flush();
+    } catch (...) {
+        file_ = nullptr;
+        if (owns_file_) std::fclose(file);
+        throw;
+    }
+
+    file_ = nullptr;
+    if (owns_file_ && std::fclose(file) != 0) {
+        throw std::runtime_error("Failed to close output file");
+    }
+}
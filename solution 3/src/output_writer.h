@@ -0,0 +1,69 @@
+#ifndef OUTPUT_WRITER_H
+#define OUTPUT_WRITER_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "query_engine.h"
+
+enum class OutputFormat {
+    Text,      // "x y" per line
+    Csv,       // "x,y" per line after an "x,y" header
+    Binary64,  // packed native-endian float64 pairs
+    Binary32   // packed native-endian float32 pairs
+};
+
+// Accepts "text", "csv", "f64" and "f32"; throws std::runtime_error otherwise
+OutputFormat parse_output_format(const std::string& name);
+
+// Writes value as indented JSON to path ("-" for stdout); throws
+// std::runtime_error if the file cannot be created or written
+void write_json_file(const std::string& path, const nlohmann::json& value);
+
+// Buffered result writer. Numbers are formatted with std::to_chars into a
+// large block that is written with a single fwrite when full, instead of
+// going through locale-aware iostreams line by line.
+class OutputWriter {
+public:
+    // Enough significant digits to round-trip any double
+    static constexpr int kMaxPrecision = 17;
+
+    // path "-" writes to stdout. precision 6 reproduces the default
+    // "out << x" formatting; 0 selects the shortest round-trip form.
+    // precision is clamped to [0, kMaxPrecision].
+    OutputWriter(const std::string& path, OutputFormat format, int precision = 6,
+                 size_t buffer_size = 1 << 20);
+    ~OutputWriter();
+
+    OutputWriter(const OutputWriter&) = delete;
+    OutputWriter& operator=(const OutputWriter&) = delete;
+
+    void write(const Point& point);
+    void write(const std::vector<Point>& points);
+
+    // Throws std::runtime_error if the data could not be written
+    void flush();
+    void close();
+
+    size_t points_written() const { return points_written_; }
+
+private:
+    std::FILE* file_ = nullptr;
+    bool owns_file_ = false;
+    OutputFormat format_;
+    int precision_;
+    std::vector<char> buffer_;
+    size_t used_ = 0;
+    size_t points_written_ = 0;
+
+    void append(const void* data, size_t size);
+    void append_char(char c);
+    // False, with nothing written, if value does not fit in the buffer
+    bool try_append_number(double value);
+    void append_number(double value);
+    void write_buffer();
+};
+
+#endif // OUTPUT_WRITER_H
@@ -0,0 +1,44 @@
+#include "profile.h"
+
+ProfileNode* ProfileNode::add_child(const std::string& child_name) {
+    children.push_back(std::make_unique<ProfileNode>(child_name));
+    return children.back().get();
+}
+
+json ProfileNode::to_json() const {
+    json node = {
+        {"name", name},
+        {"wall_ms", wall_ms},
+        {"rows_in", rows_in},
+        {"rows_out", rows_out},
+        {"sql_statements", sql_statements},
+        {"sql_round_trips", sql_round_trips},
+        {"bytes", bytes}
+    };
+    if (!detail.empty()) {
+        node["detail"] = detail;
+    }
+    if (!children.empty()) {
+        node["children"] = json::array();
+        for (const auto& child : children) {
+            node["children"].push_back(child->to_json());
+        }
+    }
+    return node;
+}
+
+size_t ProfileNode::total_sql_statements() const {
+    size_t total = sql_statements;
+    for (const auto& child : children) {
+        total += child->total_sql_statements();
+    }
+    return total;
+}
+
+size_t ProfileNode::total_sql_round_trips() const {
+    size_t total = sql_round_trips;
+    for (const auto& child : children) {
+        total += child->total_sql_round_trips();
+    }
+    return total;
+}
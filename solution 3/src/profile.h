@@ -0,0 +1,58 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+// Execution statistics of one operator, arranged in the shape of the plan.
+// A node is only ever written by the thread evaluating its operator; the
+// engine creates child nodes before handing subtrees to other threads.
+struct ProfileNode {
+    std::string name;
+    json detail = json::object();   // operator specific facts (leaf index, filters, ...)
+    double wall_ms = 0.0;
+    size_t rows_in = 0;
+    size_t rows_out = 0;
+    size_t sql_statements = 0;
+    size_t sql_round_trips = 0;
+    size_t bytes = 0;               // payload bytes of the rows received
+    std::vector<std::unique_ptr<ProfileNode>> children;
+
+    ProfileNode() = default;
+    explicit ProfileNode(std::string node_name) : name(std::move(node_name)) {}
+
+    ProfileNode* add_child(const std::string& child_name);
+    json to_json() const;
+
+    // Totals over this node and all its descendants
+    size_t total_sql_statements() const;
+    size_t total_sql_round_trips() const;
+};
+
+// Adds the lifetime of the scope to node->wall_ms. With a null node it does
+// not even read the clock, so disabled profiling costs one branch.
+class ProfileTimer {
+public:
+    explicit ProfileTimer(ProfileNode* node) : node_(node) {
+        if (node_) start_ = std::chrono::steady_clock::now();
+    }
+    ~ProfileTimer() {
+        if (node_) {
+            node_->wall_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_).count();
+        }
+    }
+
+    ProfileTimer(const ProfileTimer&) = delete;
+    ProfileTimer& operator=(const ProfileTimer&) = delete;
+
+private:
+    ProfileNode* node_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+#endif // PROFILE_H
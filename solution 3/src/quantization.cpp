@@ -0,0 +1,74 @@
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#include "quantization.h"
+
+namespace {
+
+double dequantize(int64_t q, double offset, double scale) {
+    return offset + static_cast<double>(q) * scale;
+}
+
+// Dequantization is monotone, so the exact bounds are found by rounding the
+// real-valued estimate outwards and then stepping until the dequantized value
+// sits on the right side of the boundary. This keeps the integer compare
+// identical to comparing the dequantized doubles.
+bool quantize_range(double lo, double hi, double offset, double scale, int64_t& q_lo, int64_t& q_hi) {
+    const int64_t q_min = std::numeric_limits<int32_t>::min();
+    const int64_t q_max = std::numeric_limits<int32_t>::max();
+
+    double lo_steps = std::ceil((lo - offset) / scale);
+    double hi_steps = std::floor((hi - offset) / scale);
+    if (lo_steps > static_cast<double>(q_max) || hi_steps < static_cast<double>(q_min) || lo > hi) {
+        return false;
+    }
+
+    q_lo = std::max<int64_t>(q_min, static_cast<int64_t>(std::max(lo_steps, static_cast<double>(q_min))));
+    q_hi = std::min<int64_t>(q_max, static_cast<int64_t>(std::min(hi_steps, static_cast<double>(q_max))));
+
+    while (q_lo > q_min && dequantize(q_lo - 1, offset, scale) >= lo) --q_lo;
+    while (q_lo <= q_max && dequantize(q_lo, offset, scale) < lo) ++q_lo;
+    while (q_hi < q_max && dequantize(q_hi + 1, offset, scale) <= hi) ++q_hi;
+    while (q_hi >= q_min && dequantize(q_hi, offset, scale) > hi) --q_hi;
+
+    return q_lo <= q_hi;
+}
+
+} // namespace
+
+double Quantization::dequantize_x(int32_t q) const {
+    return dequantize(q, offset_x, scale);
+}
+
+double Quantization::dequantize_y(int32_t q) const {
+    return dequantize(q, offset_y, scale);
+}
+
+bool Quantization::quantize_range_x(double lo, double hi, int64_t& q_lo, int64_t& q_hi) const {
+    return quantize_range(lo, hi, offset_x, scale, q_lo, q_hi);
+}
+
+bool Quantization::quantize_range_y(double lo, double hi, int64_t& q_lo, int64_t& q_hi) const {
+    return quantize_range(lo, hi, offset_y, scale, q_lo, q_hi);
+}
+
+Quantization Quantization::from_metadata(const std::map<std::string, std::string>& metadata) {
+    Quantization quant;
+
+    auto scale = metadata.find("quantization.scale");
+    if (scale == metadata.end()) {
+        return quant;
+    }
+
+    quant.scale = std::stod(scale->second);
+    if (!(quant.scale > 0.0)) {
+        throw std::runtime_error("Invalid quantization scale in dataset_metadata: " + scale->second);
+    }
+    quant.offset_x = std::stod(metadata.at("quantization.offset_x"));
+    quant.offset_y = std::stod(metadata.at("quantization.offset_y"));
+    quant.enabled = true;
+
+    return quant;
+}
@@ -0,0 +1,29 @@
+#ifndef QUANTIZATION_H
+#define QUANTIZATION_H
+
+#include <cstdint>
+#include <string>
+#include <map>
+
+// Fixed-point coordinate encoding written by data_loader --quantize_scale:
+// coord = offset + q * scale, with q stored in the INTEGER columns qx / qy.
+struct Quantization {
+    bool enabled = false;
+    double scale = 1.0;
+    double offset_x = 0.0;
+    double offset_y = 0.0;
+
+    double dequantize_x(int32_t q) const;
+    double dequantize_y(int32_t q) const;
+
+    // Converts an inclusive [lo, hi] coordinate range into the inclusive range
+    // of integers whose dequantized value lies in [lo, hi]. Returns false if no
+    // integer qualifies.
+    bool quantize_range_x(double lo, double hi, int64_t& q_lo, int64_t& q_hi) const;
+    bool quantize_range_y(double lo, double hi, int64_t& q_lo, int64_t& q_hi) const;
+
+    // Builds the encoding from dataset_metadata rows (key -> value).
+    static Quantization from_metadata(const std::map<std::string, std::string>& metadata);
+};
+
+#endif // QUANTIZATION_H
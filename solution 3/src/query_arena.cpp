@@ -0,0 +1,18 @@
+#include "query_arena.h"
+
+QueryArena::QueryArena(bool shared)
+    : arena_(inline_, sizeof(inline_)), shared_(shared) {
+}
+
+std::size_t QueryArena::bytes_allocated() const {
+    std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+    if (shared_) lock.lock();
+    return bytes_;
+}
+
+void* QueryArena::do_allocate(std::size_t bytes, std::size_t alignment) {
+    std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+    if (shared_) lock.lock();
+    bytes_ += bytes;
+    return arena_.allocate(bytes, alignment);
+}
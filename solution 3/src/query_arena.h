@@ -0,0 +1,48 @@
+#ifndef QUERY_ARENA_H
+#define QUERY_ARENA_H
+
+#include <cstddef>
+#include <memory_resource>
+#include <mutex>
+#include <set>
+#include <vector>
+
+// Ids selected by a crop or an operator, allocated from the memory of the
+// query evaluating them
+using IdSet = std::pmr::set<long long>;
+// Operand results: elements are constructed with the vector's memory
+// resource, so results moved in from the same query are not copied
+using IdSets = std::pmr::vector<IdSet>;
+
+// Memory of one query evaluation: a monotonic arena that hands out growing
+// blocks and releases them all at once when the arena is destroyed. Set
+// nodes, snapshot rows and bitmaps cost a pointer bump instead of a heap
+// allocation, and nothing of one query is left fragmenting the heap for the
+// next. The first kInlineBytes live inside the arena itself.
+class QueryArena : public std::pmr::memory_resource {
+public:
+    static constexpr std::size_t kInlineBytes = 16 * 1024;
+
+    // shared: allocations may come from several threads at once, as under
+    // the Parallel strategy
+    explicit QueryArena(bool shared);
+
+    QueryArena(const QueryArena&) = delete;
+    QueryArena& operator=(const QueryArena&) = delete;
+
+    std::size_t bytes_allocated() const;
+
+private:
+    alignas(std::max_align_t) std::byte inline_[kInlineBytes];
+    std::pmr::monotonic_buffer_resource arena_;
+    const bool shared_;
+    mutable std::mutex mutex_;
+    std::size_t bytes_ = 0;
+
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+    // Memory is only released with the whole arena
+    void do_deallocate(void*, std::size_t, std::size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+};
+
+#endif // QUERY_ARENA_H
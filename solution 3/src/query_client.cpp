@@ -0,0 +1,78 @@
+#include <iostream>
+#include <fstream>
+#include <gflags/gflags.h>
+#include <nlohmann/json.hpp>
+
+#include "output_writer.h"
+#include "query_server.h"
+
+using json = nlohmann::json;
+
+// --- Command-line Flag Definitions ---
+DEFINE_string(socket, "/tmp/query_engine.sock", "Unix socket of a running query_engine --serve.");
+DEFINE_string(query, "", "JSON query file.");
+DEFINE_bool(ping, false, "Only check that the server answers.");
+DEFINE_string(output, "output.txt", "Output file, or - for stdout.");
+DEFINE_string(output_format, "text", "Output format: text, csv, f64 (packed float64 pairs) or f32 (packed float32 pairs).");
+DEFINE_int32(output_precision, 6, "Significant digits for text and csv output; 0 writes the shortest exact form.");
+
+int main(int argc, char* argv[]) {
+    try {
+        gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+        QueryClient client(FLAGS_socket);
+
+        if (FLAGS_ping) {
+            json response = client.request({{"command", "ping"}});
+            std::cout << (response.value("ok", false) ? "Server is up." : "Unexpected answer.") << std::endl;
+            return response.value("ok", false) ? 0 : 1;
+        }
+
+        // Validate required --query flag
+        if (FLAGS_query.empty()) {
+            std::cerr << "Error: --query is a required argument." << std::endl;
+            return 1;
+        }
+
+        // Read JSON query
+        std::ifstream file(FLAGS_query);
+        if (!file.is_open()) {
+            throw std::runtime_error("Cannot open query file: " + FLAGS_query);
+        }
+
+        json query_json;
+        file >> query_json;
+
+        json response = client.request(query_json);
+        if (response.contains("error")) {
+            throw std::runtime_error("Server: " + response["error"].get<std::string>());
+        }
+
+        // Aggregates come back as their summary, written as query_engine does
+        std::ostream& log = (FLAGS_output == "-") ? std::cerr : std::cout;
+        if (is_aggregate_response(response)) {
+            write_json_file(FLAGS_output, response);
+            log << "Aggregate written to: " << FLAGS_output << std::endl;
+            return 0;
+        }
+
+        // Write output
+        OutputWriter out(FLAGS_output, parse_output_format(FLAGS_output_format), FLAGS_output_precision);
+        for (const auto& coords : response["points"]) {
+            Point point{};
+            point.x = coords[0].get<double>();
+            point.y = coords[1].get<double>();
+            out.write(point);
+        }
+        out.close();
+
+        log << "Query completed. Found " << out.points_written() << " points." << std::endl;
+        log << "Results written to: " << FLAGS_output << std::endl;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,9 +1,311 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <set>
+#include <map>
+#include <limits>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
 
+#include "cost_model.h"
+#include "profile.h"
 #include "query_engine.h"
+#include "query_plan.h"
+#include "statistics_catalog.h"
+
+namespace {
+
+// Text payload of a result as it came over the wire; only computed while
+// profiling.
+size_t result_bytes(const pqxx::result& res) {
+    size_t bytes = 0;
+    for (const auto& row : res) {
+        for (const auto& field : row) {
+            bytes += field.size();
+        }
+    }
+    return bytes;
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Profile node for an operator, or nullptr when profiling is off
+ProfileNode* add_operator_profile(ProfileNode* parent, const QueryNode& node) {
+    if (!parent) {
+        return nullptr;
+    }
+
+    if (node.type != NodeType::Crop) {
+        return parent->add_child(operator_name(node.type));
+    }
+
+    ProfileNode* profile = parent->add_child("crop");
+    const CropSpec& crop = node.crop;
+    profile->detail["leaf_index"] = node.leaf_index;
+    profile->detail["region"] = {crop.region.x_min, crop.region.y_min, crop.region.x_max, crop.region.y_max};
+    profile->detail["proper"] = crop.proper;
+    if (crop.shape.kind != CropShape::Kind::Rectangle) {
+        profile->detail["shape"] = shape_name(crop.shape.kind);
+    }
+    if (crop.has_category) {
+        profile->detail["category"] = crop.category;
+    }
+    if (crop.has_groups) {
+        profile->detail["groups"] = crop.groups;
+    }
+    return profile;
+}
+
+// Mirrors the operator subtree below profile and records the node of each
+// leaf, so pipelined results can be attributed to their crop.
+void add_subtree_profile(ProfileNode* profile, const QueryNode& node, std::vector<ProfileNode*>& leaf_profiles) {
+    if (node.type == NodeType::Crop) {
+        leaf_profiles[node.leaf_index] = profile;
+        return;
+    }
+    for (const auto& child : node.children) {
+        add_subtree_profile(add_operator_profile(profile, *child), *child, leaf_profiles);
+    }
+}
+
+// Collects the scans of a PostgreSQL EXPLAIN (FORMAT JSON) plan node
+void collect_scans(const json& plan_node, json& scans) {
+    if (plan_node.contains("Relation Name")) {
+        json scan = {
+            {"node_type", plan_node["Node Type"]},
+            {"relation", plan_node["Relation Name"]}
+        };
+        if (plan_node.contains("Index Name")) {
+            scan["index"] = plan_node["Index Name"];
+        }
+        scans.push_back(scan);
+    }
+    if (plan_node.contains("Plans")) {
+        for (const auto& child : plan_node["Plans"]) {
+            collect_scans(child, scans);
+        }
+    }
+}
+
+// One row under the crops of an in-process evaluation, with coordinates in
+// the domain of the columns they came from (qx / qy when quantized)
+struct SnapshotRow {
+    long long id;
+    double x, y;
+    bool has_category;
+    int category;
+    bool has_group;
+    int group_id;
+};
+
+// Bounding box of a group's points, in the same domain; complete is false if
+// any of them has no coordinates, which keeps the group from being proper
+struct GroupBounds {
+    double x_min, y_min, x_max, y_max;
+    bool complete;
+};
+
+// region in the domain of the coordinate columns. Returns false if no stored
+// coordinate can fall inside it.
+bool column_bounds(const Quantization& quantization, const Rectangle& region, Rectangle& bounds) {
+    if (!quantization.enabled) {
+        bounds = region;
+        return true;
+    }
+    int64_t qx_min, qx_max, qy_min, qy_max;
+    if (!quantization.quantize_range_x(region.x_min, region.x_max, qx_min, qx_max) ||
+        !quantization.quantize_range_y(region.y_min, region.y_max, qy_min, qy_max)) {
+        return false;
+    }
+    bounds = {static_cast<double>(qx_min), static_cast<double>(qy_min),
+              static_cast<double>(qx_max), static_cast<double>(qy_max)};
+    return true;
+}
+
+bool inside(const GroupBounds& group, const Rectangle& region) {
+    return group.x_min >= region.x_min && group.x_max <= region.x_max &&
+           group.y_min >= region.y_min && group.y_max <= region.y_max;
+}
+
+// Rows of the snapshot by group, as offset arrays: the rows of the group in
+// slot s are rows[offsets[s]] up to rows[offsets[s + 1]]
+struct GroupPostings {
+    explicit GroupPostings(std::pmr::memory_resource* memory)
+        : slot_of_group(memory), offsets(memory), rows(memory) {}
+
+    std::pmr::unordered_map<int, size_t> slot_of_group;
+    std::pmr::vector<size_t> offsets;
+    std::pmr::vector<size_t> rows;
+};
+
+// Snapshot containers live in the memory of the query
+using SnapshotRows = std::pmr::vector<SnapshotRow>;
+using GroupBoundsMap = std::pmr::unordered_map<int, GroupBounds>;
+
+GroupPostings build_group_postings(const SnapshotRows& rows) {
+    std::pmr::memory_resource* memory = rows.get_allocator().resource();
+    GroupPostings postings(memory);
+    for (const SnapshotRow& row : rows) {
+        if (!row.has_group) continue;
+        auto slot = postings.slot_of_group.emplace(row.group_id, postings.offsets.size());
+        if (slot.second) postings.offsets.push_back(0);
+        ++postings.offsets[slot.first->second];
+    }
+
+    // Counts to start offsets, then each row into its group's range
+    size_t start = 0;
+    for (size_t& offset : postings.offsets) {
+        const size_t count = offset;
+        offset = start;
+        start += count;
+    }
+    std::pmr::vector<size_t> next(postings.offsets, memory);
+    postings.offsets.push_back(start);
+    postings.rows.resize(start);
+    for (size_t i = 0; i < rows.size(); ++i) {
+        if (rows[i].has_group) {
+            postings.rows[next[postings.slot_of_group[rows[i].group_id]]++] = i;
+        }
+    }
+    return postings;
+}
+
+using Bitmap = std::pmr::vector<uint64_t>;
+
+// Rows of the snapshot one crop selects, with the same semantics as crop_sql.
+// A group-filtered crop only looks at the rows of its groups.
+Bitmap crop_bitmap(const Quantization& quantization, const CropSpec& crop, const Rectangle& valid_region,
+                   const SnapshotRows& rows, const GroupBoundsMap& groups, const GroupPostings& postings) {
+    std::pmr::memory_resource* memory = rows.get_allocator().resource();
+    Bitmap bits((rows.size() + 63) / 64, 0, memory);
+    Rectangle crop_bounds, valid_bounds;
+    if (!column_bounds(quantization, crop.region, crop_bounds) ||
+        !column_bounds(quantization, valid_region, valid_bounds)) {
+        return bits;
+    }
+
+    std::pmr::vector<size_t> candidates(memory);
+    auto consider = [&](size_t i) {
+        const SnapshotRow& row = rows[i];
+        if (!crop_bounds.contains(row.x, row.y) || !valid_bounds.contains(row.x, row.y)) return;
+        if (crop.has_category && (!row.has_category || row.category != crop.category)) return;
+        if (crop.proper) {
+            // Shaped proper crops are fetched with SQL instead, see
+            // evaluate_in_process
+            if (!row.has_group) return;
+            auto group = groups.find(row.group_id);
+            if (group == groups.end() || !group->second.complete ||
+                !inside(group->second, crop_bounds) || !inside(group->second, valid_bounds)) return;
+        }
+        candidates.push_back(i);
+    };
+
+    if (crop.has_groups) {
+        std::pmr::vector<int> wanted_groups(crop.groups.begin(), crop.groups.end(), memory);
+        std::sort(wanted_groups.begin(), wanted_groups.end());
+        wanted_groups.erase(std::unique(wanted_groups.begin(), wanted_groups.end()), wanted_groups.end());
+        for (int group : wanted_groups) {
+            auto slot = postings.slot_of_group.find(group);
+            if (slot == postings.slot_of_group.end()) continue;
+            for (size_t k = postings.offsets[slot->second]; k < postings.offsets[slot->second + 1]; ++k) {
+                consider(postings.rows[k]);
+            }
+        }
+    } else {
+        for (size_t i = 0; i < rows.size(); ++i) {
+            consider(i);
+        }
+    }
+
+    // The exact shape test runs over all candidates at once, on the
+    // coordinates the points are returned with
+    std::pmr::vector<uint8_t> inside_shape(candidates.size(), 1, memory);
+    if (crop.shape.kind != CropShape::Kind::Rectangle) {
+        std::pmr::vector<double> xs(candidates.size(), memory), ys(candidates.size(), memory);
+        for (size_t k = 0; k < candidates.size(); ++k) {
+            const SnapshotRow& row = rows[candidates[k]];
+            xs[k] = quantization.enabled ? quantization.dequantize_x(static_cast<int32_t>(row.x)) : row.x;
+            ys[k] = quantization.enabled ? quantization.dequantize_y(static_cast<int32_t>(row.y)) : row.y;
+        }
+        crop.shape.contains(xs.data(), ys.data(), candidates.size(), inside_shape.data());
+    }
+
+    for (size_t k = 0; k < candidates.size(); ++k) {
+        if (inside_shape[k]) {
+            bits[candidates[k] / 64] |= uint64_t{1} << (candidates[k] % 64);
+        }
+    }
+    return bits;
+}
+
+size_t popcount(const Bitmap& bits) {
+    size_t count = 0;
+    for (uint64_t word : bits) {
+        count += static_cast<size_t>(__builtin_popcountll(word));
+    }
+    return count;
+}
+
+// Combines the leaf bitmaps bottom-up, filling in the profile nodes that
+// add_subtree_profile laid out
+Bitmap combine_bitmaps(const QueryNode& node, std::pmr::vector<Bitmap>& leaf_bits, size_t words, ProfileNode* profile) {
+    if (node.type == NodeType::Crop) {
+        return std::move(leaf_bits[node.leaf_index]);
+    }
+
+    Bitmap result(words, node.type == NodeType::And ? ~uint64_t{0} : 0, leaf_bits.get_allocator());
+    if (node.children.empty()) {
+        result.assign(words, 0);
+    }
+    for (size_t i = 0; i < node.children.size(); ++i) {
+        ProfileNode* operand_profile = profile ? profile->children[i].get() : nullptr;
+        Bitmap operand = combine_bitmaps(*node.children[i], leaf_bits, words, operand_profile);
+        if (profile) profile->rows_in += popcount(operand);
+        // A difference starts from its first operand and clears the bits of
+        // the others
+        if (node.type == NodeType::Difference && i == 0) {
+            result = std::move(operand);
+            continue;
+        }
+        for (size_t w = 0; w < words; ++w) {
+            switch (node.type) {
+            case NodeType::And: result[w] &= operand[w]; break;
+            case NodeType::Difference: result[w] &= ~operand[w]; break;
+            default: result[w] |= operand[w]; break;
+            }
+        }
+    }
+    if (profile) profile->rows_out = popcount(result);
+    return result;
+}
+
+// Keeps n of the ids, chosen by a hash so the choice is uniform and the
+// same on every run
+void keep_uniform_subset(IdSet& ids, size_t n) {
+    auto mix = [](long long id) {
+        uint64_t z = static_cast<uint64_t>(id) + 0x9e3779b97f4a7c15ULL;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    };
+    std::vector<std::pair<uint64_t, long long>> keyed;
+    keyed.reserve(ids.size());
+    for (long long id : ids) {
+        keyed.emplace_back(mix(id), id);
+    }
+    std::nth_element(keyed.begin(), keyed.begin() + static_cast<std::ptrdiff_t>(n), keyed.end());
+    ids.clear();
+    for (size_t i = 0; i < n; ++i) {
+        ids.insert(keyed[i].second);
+    }
+}
+
+} // namespace
 
 bool Point::operator<(const Point& other) const {
     if (y != other.y) return y < other.y;
@@ -14,210 +316,1254 @@ bool Rectangle::contains(double x, double y) const {
     return x >= x_min && x <= x_max && y >= y_min && y <= y_max;
 }
 
-std::set<long long> QueryEngine::get_valid_point_ids(pqxx::work& txn) {
-        std::set<long long> valid_ids;
+const char* strategy_name(ExecutionStrategy strategy) {
+    switch (strategy) {
+    case ExecutionStrategy::Sequential: return "sequential";
+    case ExecutionStrategy::Pipelined: return "pipelined";
+    case ExecutionStrategy::Parallel: return "parallel";
+    case ExecutionStrategy::Pushdown: return "pushdown";
+    case ExecutionStrategy::InProcess: return "in_process";
+    default: return "auto";
+    }
+}
+
+ExecutionStrategy parse_strategy(const std::string& name) {
+    for (ExecutionStrategy strategy : {ExecutionStrategy::Auto, ExecutionStrategy::Sequential,
+                                       ExecutionStrategy::Pipelined, ExecutionStrategy::Parallel,
+                                       ExecutionStrategy::Pushdown, ExecutionStrategy::InProcess}) {
+        if (name == strategy_name(strategy)) {
+            return strategy;
+        }
+    }
+    throw std::runtime_error("Unknown execution strategy: " + name);
+}
 
-        pqxx::result res = txn.exec_params(
-            "SELECT id FROM inspection_region "
-            "WHERE coord_x >= $1 AND coord_x <= $2 "
-            "AND coord_y >= $3 AND coord_y <= $4",
-            valid_region_.x_min, valid_region_.x_max,
-            valid_region_.y_min, valid_region_.y_max
-        );
+std::vector<ExecutionStrategy> all_strategies() {
+    return {ExecutionStrategy::Sequential, ExecutionStrategy::Pipelined, ExecutionStrategy::Parallel,
+            ExecutionStrategy::Pushdown, ExecutionStrategy::InProcess};
+}
+
+void QueryEngine::load_dataset_metadata() {
+        std::map<std::string, std::string> metadata;
+
+        // dataset_metadata is optional: datasets loaded without it use plain
+        // FLOAT coordinates.
+        ConnectionPool::Lease conn = connections_->acquire();
+        pqxx::work txn(*conn);
+        pqxx::result exists = txn.exec("SELECT to_regclass('dataset_metadata') IS NOT NULL");
+        if (exists[0][0].as<bool>()) {
+            pqxx::result res = txn.exec("SELECT key, value FROM dataset_metadata");
+            for (const auto& row : res) {
+                metadata[row[0].as<std::string>()] = row[1].as<std::string>();
+            }
+        }
+        pqxx::result kind = txn.exec("SELECT relkind = 'p' FROM pg_class WHERE oid = to_regclass('inspection_region')");
+        partitioned_ = !kind.empty() && kind[0][0].as<bool>();
+        StatisticsCatalog catalog = StatisticsCatalog::load(txn);
+        txn.commit();
         
-        for (const auto& row : res) {
-            valid_ids.insert(row[0].as<long long>());
+        if (!catalog.empty()) {
+            catalog_ = std::make_shared<const StatisticsCatalog>(std::move(catalog));
+        }
+
+        quantization_ = Quantization::from_metadata(metadata);
+        group_postings_ = options_.group_postings && metadata["group_postings"] == "id_ranges";
+        sample_keys_ = metadata["sample_keys"] == "stratified";
+    }
+void QueryEngine::load_table_statistics() {
+        // Planner statistics are as fresh as the last ANALYZE; a table that
+        // was never analyzed leaves statistics_ invalid and Auto falls back
+        // to a fixed strategy.
+        const std::string x_column = quantization_.enabled ? "qx" : "coord_x";
+        const std::string y_column = quantization_.enabled ? "qy" : "coord_y";
+        
+        ConnectionPool::Lease conn = connections_->acquire();
+        pqxx::work txn(*conn);
+        pqxx::result tuples = txn.exec("SELECT reltuples FROM pg_class WHERE oid = to_regclass('inspection_region')");
+        if (tuples.empty() || tuples[0][0].is_null() || tuples[0][0].as<double>() <= 0.0) {
+            txn.commit();
+            return;
         }
         
-        return valid_ids;
+        TableStatistics stats;
+        stats.rows = tuples[0][0].as<double>();
+        bool has_x = false, has_y = false;
+        // Values too common for the histogram are only in most_common_vals,
+        // so the extent spans both
+        pqxx::result columns = txn.exec(
+            "SELECT attname, n_distinct, histogram_bounds::text, most_common_vals::text FROM pg_stats "
+            "WHERE schemaname = current_schema() AND tablename = 'inspection_region' "
+            "AND attname IN ('" + x_column + "', '" + y_column + "', 'category', 'group_id')");
+        txn.commit();
+        
+        for (const auto& row : columns) {
+            const std::string column = row[0].as<std::string>();
+            // A negative n_distinct is a fraction of the row count
+            double distinct = row[1].is_null() ? 1.0 : row[1].as<double>();
+            if (distinct < 0.0) distinct = -distinct * stats.rows;
+            
+            double lo = 0.0, hi = 0.0;
+            bool has_range = false;
+            for (int field = 2; field <= 3; ++field) {
+                double field_lo = 0.0, field_hi = 0.0;
+                if (row[field].is_null() || !array_range(row[field].as<std::string>(), field_lo, field_hi)) continue;
+                lo = has_range ? std::min(lo, field_lo) : field_lo;
+                hi = has_range ? std::max(hi, field_hi) : field_hi;
+                has_range = true;
+            }
+            if (column == x_column && has_range) {
+                stats.extent.x_min = quantization_.enabled ? quantization_.dequantize_x(static_cast<int32_t>(lo)) : lo;
+                stats.extent.x_max = quantization_.enabled ? quantization_.dequantize_x(static_cast<int32_t>(hi)) : hi;
+                has_x = true;
+            } else if (column == y_column && has_range) {
+                stats.extent.y_min = quantization_.enabled ? quantization_.dequantize_y(static_cast<int32_t>(lo)) : lo;
+                stats.extent.y_max = quantization_.enabled ? quantization_.dequantize_y(static_cast<int32_t>(hi)) : hi;
+                has_y = true;
+            } else if (column == "category") {
+                stats.categories = std::max(distinct, 1.0);
+            } else if (column == "group_id") {
+                stats.groups = std::max(distinct, 1.0);
+            }
+        }
+        
+        stats.valid = has_x && has_y;
+        statistics_ = stats;
     }
-std::set<long long> QueryEngine::get_proper_groups(pqxx::work& txn) {
-        std::set<long long> proper_groups;
+ExecutionStrategy QueryEngine::choose_strategy(const ExecutionContext& ctx, const QueryNode& plan, json* explanation) const {
+        if (options_.strategy != ExecutionStrategy::Auto) {
+            if (explanation) (*explanation)["strategy_source"] = "fixed";
+            return options_.strategy;
+        }
+        if (!statistics_.valid) {
+            if (explanation) (*explanation)["strategy_source"] = "no_statistics";
+            return options_.threads > 1 ? ExecutionStrategy::Parallel : ExecutionStrategy::Pipelined;
+        }
+        
+        const std::vector<StrategyCost> costs = CostModel(statistics_, options_.threads, catalog_.get()).estimate(plan, ctx.valid_region);
+        if (explanation) {
+            (*explanation)["strategy_source"] = "cost_model";
+            (*explanation)["statistics_source"] = catalog_ ? "catalog" : "pg_stats";
+            json& estimates = (*explanation)["estimated_cost_us"];
+            for (const StrategyCost& cost : costs) {
+                estimates[strategy_name(cost.strategy)] = cost.cost_us;
+            }
+        }
+        return costs.front().strategy;
+    }
+std::string QueryEngine::region_predicate(const Rectangle& region, const std::string& alias) const {
+        std::ostringstream predicate;
+
+        if (quantization_.enabled) {
+            // Compare the integer columns against bounds that select exactly
+            // the points whose dequantized coordinates fall inside the region.
+            int64_t qx_min, qx_max, qy_min, qy_max;
+            if (!quantization_.quantize_range_x(region.x_min, region.x_max, qx_min, qx_max) ||
+                !quantization_.quantize_range_y(region.y_min, region.y_max, qy_min, qy_max)) {
+                return "FALSE";
+            }
+            predicate << alias << "qx >= " << qx_min << " AND " << alias << "qx <= " << qx_max << " AND "
+                      << alias << "qy >= " << qy_min << " AND " << alias << "qy <= " << qy_max;
+        } else {
+            predicate.precision(std::numeric_limits<double>::max_digits10);
+            predicate << alias << "coord_x >= " << region.x_min << " AND " << alias << "coord_x <= " << region.x_max << " AND "
+                      << alias << "coord_y >= " << region.y_min << " AND " << alias << "coord_y <= " << region.y_max;
+        }
 
-        // Find groups where ALL points are valid
-        pqxx::result res = txn.exec_params(
-            "SELECT group_id FROM inspection_region "
-            "GROUP BY group_id "
-            "HAVING COUNT(*) = SUM(CASE WHEN coord_x >= $1 AND coord_x <= $2 "
-            "AND coord_y >= $3 AND coord_y <= $4 THEN 1 ELSE 0 END)",
-            valid_region_.x_min, valid_region_.x_max,
-            valid_region_.y_min, valid_region_.y_max
-        );
+        return predicate.str();
+    }
+Point QueryEngine::read_point(const pqxx::row& row) const {
+        // Expects (id, x, y, category, group_id) as selected by execute_query
+        Point p;
+        p.id = row[0].as<long long>();
+        if (quantization_.enabled) {
+            p.x = quantization_.dequantize_x(row[1].as<int32_t>());
+            p.y = quantization_.dequantize_y(row[2].as<int32_t>());
+        } else {
+            p.x = row[1].as<double>();
+            p.y = row[2].as<double>();
+        }
+        p.category = row[3].as<int>();
+        p.group_id = row[4].as<int>();
+        return p;
+    }
+std::string QueryEngine::crop_sql(const ExecutionContext& ctx, const CropSpec& crop, const Rectangle& scan_region) const {
+        return "SELECT id FROM inspection_region r WHERE " + crop_condition(ctx, crop, scan_region);
+    }
+std::string QueryEngine::keyset_predicate(const PageSpec& page, const std::string& alias) const {
+        const double y = page.after_y;
+        const double x = page.after_x;
+        const bool has_id = page.has_after_id;
+        std::ostringstream predicate;
+        predicate.precision(std::numeric_limits<double>::max_digits10);
         
-        for (const auto& row : res) {
-            proper_groups.insert(row[0].as<long long>());
+        if (!quantization_.enabled) {
+            if (has_id) {
+                predicate << "(" << alias << "coord_y, " << alias << "coord_x, " << alias << "id) > ("
+                          << y << ", " << x << ", " << page.after_id << ")";
+            } else {
+                predicate << "(" << alias << "coord_y, " << alias << "coord_x) > (" << y << ", " << x << ")";
+            }
+            return predicate.str();
         }
         
-        return proper_groups;
+        // The cursor maps to the last stored values at or below it. When one
+        // is not exactly the cursor's coordinate, every point with that value
+        // lies strictly before the cursor and the later components no longer
+        // matter.
+        const double lowest = std::numeric_limits<double>::lowest();
+        int64_t q_lo, qy, qx;
+        if (!quantization_.quantize_range_y(lowest, y, q_lo, qy)) {
+            return "TRUE";
+        }
+        if (quantization_.dequantize_y(static_cast<int32_t>(qy)) != y) {
+            predicate << alias << "qy > " << qy;
+        } else if (!quantization_.quantize_range_x(lowest, x, q_lo, qx)) {
+            predicate << alias << "qy >= " << qy;
+        } else if (quantization_.dequantize_x(static_cast<int32_t>(qx)) != x || !has_id) {
+            predicate << "(" << alias << "qy, " << alias << "qx) > (" << qy << ", " << qx << ")";
+        } else {
+            predicate << "(" << alias << "qy, " << alias << "qx, " << alias << "id) > ("
+                      << qy << ", " << qx << ", " << page.after_id << ")";
+        }
+        return predicate.str();
     }
-std::set<long long> QueryEngine::process_crop(pqxx::work& txn, const json& crop_op) {
-        std::set<long long> result_ids;
-        
-        // Parse rectangle
-        Rectangle crop_region;
-        crop_region.x_min = crop_op["region"]["p_min"]["x"].get<double>();
-        crop_region.y_min = crop_op["region"]["p_min"]["y"].get<double>();
-        crop_region.x_max = crop_op["region"]["p_max"]["x"].get<double>();
-        crop_region.y_max = crop_op["region"]["p_max"]["y"].get<double>();
+std::string QueryEngine::shape_predicate(const CropShape& shape, const std::string& alias) const {
+        if (!quantization_.enabled) {
+            return shape.sql_predicate(alias + "coord_x", alias + "coord_y");
+        }
         
-        // Build query
+        // Shapes are tested on dequantized coordinates, computed on the
+        // server exactly as Quantization::dequantize_x/y does
+        std::ostringstream x, y;
+        x.precision(std::numeric_limits<double>::max_digits10);
+        y.precision(std::numeric_limits<double>::max_digits10);
+        x << "(" << quantization_.offset_x << " + " << alias << "qx * " << quantization_.scale << "::float8)";
+        y << "(" << quantization_.offset_y << " + " << alias << "qy * " << quantization_.scale << "::float8)";
+        return shape.sql_predicate(x.str(), y.str());
+    }
+std::string QueryEngine::group_members(const std::string& key_condition) const {
+        if (group_postings_) {
+            return "group_posting gp JOIN inspection_region g ON g.id BETWEEN gp.first_id AND gp.last_id "
+                   "WHERE gp.group_id " + key_condition;
+        }
+        return "inspection_region g WHERE g.group_id " + key_condition;
+    }
+std::string QueryEngine::sample_predicate(double fraction, const std::string& alias) const {
+        std::ostringstream predicate;
+        predicate.precision(std::numeric_limits<double>::max_digits10);
+        if (sample_keys_) {
+            predicate << alias << "sample_key < " << fraction << "::real";
+        } else {
+            predicate << "(hashint8(" << alias << "id) & 2147483647) < "
+                      << static_cast<long long>(fraction * 2147483648.0);
+        }
+        return predicate.str();
+    }
+std::string QueryEngine::crop_condition(const ExecutionContext& ctx, const CropSpec& crop, const Rectangle& scan_region) const {
+        // One statement per crop: the crop itself, the valid region and, for
+        // proper crops, a check that no point of the group lies outside both.
         std::ostringstream query;
-        query << "SELECT id, group_id FROM inspection_region WHERE "
-              << "coord_x >= " << crop_region.x_min << " AND coord_x <= " << crop_region.x_max << " AND "
-              << "coord_y >= " << crop_region.y_min << " AND coord_y <= " << crop_region.y_max;
+        query << region_predicate(scan_region, "r.") << " AND "
+              << region_predicate(ctx.valid_region, "r.");
+        
+        // Approximate queries see the sample only; the proper check below
+        // still looks at every point of the group
+        if (ctx.sample_fraction < 1.0) {
+            query << " AND " << sample_predicate(ctx.sample_fraction, "r.");
+        }
+        
+        // Polygons and circles: the exact test on the rows the bounding box
+        // selected
+        if (crop.shape.kind != CropShape::Kind::Rectangle) {
+            query << " AND " << shape_predicate(crop.shape, "r.");
+        }
         
         // Add category filter
-        if (crop_op.contains("category")) {
-            int category = crop_op["category"].get<int>();
-            query << " AND category = " << category;
+        if (crop.has_category) {
+            query << " AND r.category = " << crop.category;
         }
         
-        // Add group filter
-        if (crop_op.contains("one_of_groups")) {
-            query << " AND group_id IN (";
-            auto groups = crop_op["one_of_groups"];
-            for (size_t i = 0; i < groups.size(); ++i) {
-                if (i > 0) query << ", ";
-                query << groups[i].get<int>();
+        // Add group filter. With postings the listed groups' ids are looked
+        // up by primary key, so the cost follows the size of the groups
+        // rather than of the table.
+        if (crop.has_groups) {
+            std::ostringstream groups;
+            for (size_t i = 0; i < crop.groups.size(); ++i) {
+                if (i > 0) groups << ", ";
+                groups << crop.groups[i];
+            }
+            if (crop.groups.empty()) groups << "NULL";
+            
+            if (group_postings_) {
+                query << " AND r.id = ANY(ARRAY(SELECT generate_series(p.first_id, p.last_id) "
+                      << "FROM group_posting p WHERE p.group_id IN (" << groups.str() << ")))";
+            } else {
+                query << " AND r.group_id IN (" << groups.str() << ")";
             }
-            query << ")";
         }
         
-        pqxx::result res = txn.exec(query.str());
-        
-        // Collect points
-        std::set<long long> candidate_ids;
-        std::set<int> candidate_groups;
+        // Handle proper filter
+        if (crop.proper) {
+            query << " AND r.group_id IS NOT NULL AND NOT EXISTS (SELECT 1 FROM " << group_members("= r.group_id") << " AND ("
+                  << region_predicate(crop.region, "g.") << " AND "
+                  << region_predicate(ctx.valid_region, "g.");
+            if (crop.shape.kind != CropShape::Kind::Rectangle) {
+                query << " AND " << shape_predicate(crop.shape, "g.");
+            }
+            query << ") IS NOT TRUE)";
+        }
         
+        return query.str();
+    }
+IdSet QueryEngine::read_ids(const pqxx::result& res, std::pmr::memory_resource* memory) const {
+        IdSet ids(memory);
         for (const auto& row : res) {
-            long long id = row[0].as<long long>();
-            int group_id = row[1].as<int>();
-            candidate_ids.insert(id);
-            candidate_groups.insert(group_id);
+            ids.insert(row[0].as<long long>());
+        }
+        return ids;
+    }
+bool QueryEngine::spawn_with_connection(TaskGroup& group, std::function<void(pqxx::work&)> task) {
+        // Only fan out while connections are free; otherwise the caller runs
+        // the work inline, which also rules out tasks waiting on each other
+        // for connections.
+        auto conn = std::make_shared<ConnectionPool::Lease>(connections_->try_acquire());
+        if (!*conn) {
+            return false;
+        }
+
+        group.run([conn, task] {
+            pqxx::work txn(**conn);
+            task(txn);
+            txn.commit();
+        });
+        return true;
+    }
+IdSet QueryEngine::evaluate_crop(pqxx::work& txn, const ExecutionContext& ctx, const QueryNode& leaf, ProfileNode* profile) {
+        ProfileTimer timer(profile);
+        pqxx::result res = txn.exec(crop_sql(ctx, leaf.crop, leaf.crop.region));
+        IdSet ids = read_ids(res, ctx.memory);
+        
+        if (profile) {
+            profile->sql_statements += 1;
+            profile->sql_round_trips += 1;
+            profile->bytes += result_bytes(res);
+            profile->rows_out = ids.size();
         }
+        return ids;
+    }
+IdSet QueryEngine::evaluate_tiled_crop(pqxx::work& txn, const ExecutionContext& ctx, const QueryNode& leaf, ProfileNode* profile) {
+        // Split the crop into horizontal bands fetched in parallel. Bands
+        // share their boundary rows; the id set removes the duplicates. The
+        // proper check still runs against the whole crop.
+        ProfileTimer timer(profile);
+        const Rectangle& crop_region = leaf.crop.region;
+        const size_t tiles = options_.crop_tiles;
+        const double band = (crop_region.y_max - crop_region.y_min) / static_cast<double>(tiles);
+        IdSets tile_results(tiles, ctx.memory);
+        std::vector<ProfileNode*> tile_profiles(tiles, nullptr);
         
-        // Handle proper filter
-        if (crop_op.contains("proper") && crop_op["proper"].get<bool>()) {
-            std::set<long long> proper_groups = get_proper_groups(txn);
+        TaskGroup group(*workers_);
+        for (size_t t = 0; t < tiles; ++t) {
+            Rectangle tile = crop_region;
+            tile.y_min = crop_region.y_min + band * static_cast<double>(t);
+            tile.y_max = (t + 1 == tiles) ? crop_region.y_max : crop_region.y_min + band * static_cast<double>(t + 1);
+            std::string query = crop_sql(ctx, leaf.crop, tile);
             
-            // Re-query to filter by proper groups
-            for (const auto& row : res) {
-                long long id = row[0].as<long long>();
-                int group_id = row[1].as<int>();
-                
-                if (proper_groups.count(group_id) > 0) {
-                    // Verify entire group is in crop region
-                    std::ostringstream group_query;
-                    group_query << "SELECT COUNT(*) FROM inspection_region WHERE group_id = " << group_id;
-                    pqxx::result group_count = txn.exec(group_query.str());
-                    int total_in_group = group_count[0][0].as<int>();
-                    
-                    group_query.str("");
-                    group_query << "SELECT COUNT(*) FROM inspection_region WHERE group_id = " << group_id
-                               << " AND coord_x >= " << crop_region.x_min << " AND coord_x <= " << crop_region.x_max
-                               << " AND coord_y >= " << crop_region.y_min << " AND coord_y <= " << crop_region.y_max;
-                    pqxx::result crop_count = txn.exec(group_query.str());
-                    int in_crop = crop_count[0][0].as<int>();
-                    
-                    if (total_in_group == in_crop) {
-                        result_ids.insert(id);
-                    }
+            if (profile) {
+                tile_profiles[t] = profile->add_child("tile");
+                tile_profiles[t]->detail["y_min"] = tile.y_min;
+                tile_profiles[t]->detail["y_max"] = tile.y_max;
+            }
+            
+            ProfileNode* tile_profile = tile_profiles[t];
+            auto fetch_tile = [this, &ctx, query, &tile_results, t, tile_profile](pqxx::work& tile_txn) {
+                ProfileTimer tile_timer(tile_profile);
+                pqxx::result res = tile_txn.exec(query);
+                tile_results[t] = read_ids(res, ctx.memory);
+                if (tile_profile) {
+                    tile_profile->sql_statements = 1;
+                    tile_profile->sql_round_trips = 1;
+                    tile_profile->bytes = result_bytes(res);
+                    tile_profile->rows_out = tile_results[t].size();
                 }
+            };
+            if (!spawn_with_connection(group, fetch_tile)) {
+                fetch_tile(txn);
             }
-        } else {
-            result_ids = candidate_ids;
         }
+        group.wait();
         
-        // Filter by valid region
-        std::set<long long> valid_ids = get_valid_point_ids(txn);
-        std::set<long long> final_result;
-        std::set_intersection(
-            result_ids.begin(), result_ids.end(),
-            valid_ids.begin(), valid_ids.end(),
-            std::inserter(final_result, final_result.begin())
-        );
-        
-        return final_result;
+        IdSet result(ctx.memory);
+        for (const auto& tile : tile_results) {
+            if (profile) profile->rows_in += tile.size();
+            result.insert(tile.begin(), tile.end());
+        }
+        if (profile) profile->rows_out = result.size();
+        return result;
     }
-std::set<long long> QueryEngine::process_query(pqxx::work& txn, const json& query_obj) {
-        if (query_obj.contains("operator_crop")) {
-            return process_crop(txn, query_obj["operator_crop"]);
+IdSet QueryEngine::evaluate_pipelined(pqxx::work& txn, const ExecutionContext& ctx, const QueryNode& node, ProfileNode* profile) {
+        std::vector<const QueryNode*> leaves;
+        collect_leaves(node, leaves);
+        
+        std::vector<ProfileNode*> leaf_profiles(ctx.leaf_count, nullptr);
+        std::chrono::steady_clock::time_point start;
+        if (profile) {
+            add_subtree_profile(profile, node, leaf_profiles);
+            profile->detail["pipelined"] = true;
+            profile->sql_round_trips += 1;
+            start = std::chrono::steady_clock::now();
         }
-        else if (query_obj.contains("operator_and")) {
-            std::set<long long> result;
-            bool first = true;
+        
+        // Send every leaf statement before reading any result, so the subtree
+        // costs about one round-trip instead of one per leaf.
+        IdSets leaf_results(ctx.leaf_count, ctx.memory);
+        std::map<pqxx::pipeline::query_id, size_t> pending;
+        
+        pqxx::pipeline pipe(txn);
+        for (const QueryNode* leaf : leaves) {
+            pending[pipe.insert(crop_sql(ctx, leaf->crop, leaf->crop.region))] = leaf->leaf_index;
+        }
+        pipe.complete();
+        
+        while (!pipe.empty()) {
+            auto answer = pipe.retrieve();
+            const size_t leaf_index = pending.at(answer.first);
+            leaf_results[leaf_index] = read_ids(answer.second, ctx.memory);
             
-            for (const auto& operand : query_obj["operator_and"]) {
-                std::set<long long> operand_result = process_query(txn, operand);
-                
-                if (first) {
-                    result = operand_result;
-                    first = false;
+            // A pipelined leaf's time is how long its result took to arrive
+            if (ProfileNode* leaf_profile = leaf_profiles[leaf_index]) {
+                leaf_profile->wall_ms = elapsed_ms(start);
+                leaf_profile->sql_statements = 1;
+                leaf_profile->bytes = result_bytes(answer.second);
+                leaf_profile->rows_out = leaf_results[leaf_index].size();
+            }
+        }
+        
+        IdSet result = combine_leaves(node, leaf_results, profile);
+        if (profile) profile->wall_ms = elapsed_ms(start);
+        return result;
+    }
+IdSet QueryEngine::combine(const QueryNode& node, IdSets& operand_results, ProfileNode* profile) const {
+        if (profile) {
+            for (const auto& operand_result : operand_results) {
+                profile->rows_in += operand_result.size();
+            }
+        }
+        
+        IdSet result = combine_results(node.type, operand_results);
+        if (profile) profile->rows_out = result.size();
+        return result;
+    }
+IdSet QueryEngine::combine_leaves(const QueryNode& node, IdSets& leaf_results, ProfileNode* profile) const {
+        if (node.type == NodeType::Crop) {
+            return std::move(leaf_results[node.leaf_index]);
+        }
+        
+        // Profile children were laid out in operand order by add_subtree_profile
+        IdSets operand_results(leaf_results.get_allocator());
+        for (size_t i = 0; i < node.children.size(); ++i) {
+            ProfileNode* operand_profile = profile ? profile->children[i].get() : nullptr;
+            operand_results.push_back(combine_leaves(*node.children[i], leaf_results, operand_profile));
+        }
+        
+        ProfileTimer timer(profile);
+        return combine(node, operand_results, profile);
+    }
+IdSet QueryEngine::evaluate_sequential(pqxx::work& txn, const ExecutionContext& ctx, const QueryNode& node, ProfileNode* profile) {
+        // One statement per crop, each awaited before the next is sent
+        if (node.type == NodeType::Crop) {
+            return evaluate_crop(txn, ctx, node, profile);
+        }
+        
+        ProfileTimer timer(profile);
+        IdSets operand_results(ctx.memory);
+        for (const auto& child : node.children) {
+            operand_results.push_back(evaluate_sequential(txn, ctx, *child, add_operator_profile(profile, *child)));
+        }
+        return combine(node, operand_results, profile);
+    }
+std::string QueryEngine::pushdown_condition(const ExecutionContext& ctx, const QueryNode& node) const {
+        if (node.type == NodeType::Crop) {
+            return crop_condition(ctx, node.crop, node.crop.region);
+        }
+        
+        // A crop minus other operands is an anti-join: the crop's rows are
+        // scanned once and each is probed against the excluded ids, so only
+        // the excluded part is evaluated besides the crop itself
+        if (node.type == NodeType::Difference && node.children.front()->type == NodeType::Crop) {
+            const CropSpec& crop = node.children.front()->crop;
+            std::string condition = crop_condition(ctx, crop, crop.region);
+            for (size_t i = 1; i < node.children.size(); ++i) {
+                condition += " AND NOT EXISTS (SELECT 1 FROM (" + pushdown_sql(ctx, *node.children[i]) +
+                             ") s WHERE s.id = r.id)";
+            }
+            return condition;
+        }
+        return "r.id IN (" + pushdown_sql(ctx, node) + ")";
+    }
+std::string QueryEngine::pushdown_sql(const ExecutionContext& ctx, const QueryNode& node) const {
+        if (node.type == NodeType::Crop ||
+            (node.type == NodeType::Difference && node.children.front()->type == NodeType::Crop)) {
+            return "SELECT id FROM inspection_region r WHERE " + pushdown_condition(ctx, node);
+        }
+        if (node.children.empty()) {
+            return "SELECT id FROM inspection_region WHERE FALSE";
+        }
+        
+        // INTERSECT, UNION and EXCEPT drop duplicates like the id sets do
+        const char* set_operator = (node.type == NodeType::And) ? " INTERSECT "
+                                 : (node.type == NodeType::Difference) ? " EXCEPT " : " UNION ";
+        std::string sql;
+        for (size_t i = 0; i < node.children.size(); ++i) {
+            if (i > 0) sql += set_operator;
+            sql += "(" + pushdown_sql(ctx, *node.children[i]) + ")";
+        }
+        return sql;
+    }
+IdSet QueryEngine::evaluate_pushdown(pqxx::work& txn, const ExecutionContext& ctx, const QueryNode& node, ProfileNode* profile) {
+        // The server combines the crops, so only the final ids come back.
+        // Per-operator rows are not observable; the profile only has the
+        // tree's shape and the root's result.
+        ProfileTimer timer(profile);
+        std::vector<ProfileNode*> leaf_profiles(ctx.leaf_count, nullptr);
+        if (profile) {
+            add_subtree_profile(profile, node, leaf_profiles);
+            profile->detail["pushdown"] = true;
+        }
+        
+        pqxx::result res = txn.exec(pushdown_sql(ctx, node));
+        IdSet ids = read_ids(res, ctx.memory);
+        
+        if (profile) {
+            profile->sql_statements += 1;
+            profile->sql_round_trips += 1;
+            profile->bytes += result_bytes(res);
+            profile->rows_out = ids.size();
+        }
+        return ids;
+    }
+IdSet QueryEngine::evaluate_in_process(pqxx::work& txn, const ExecutionContext& ctx, const QueryNode& node, ProfileNode* profile) {
+        ProfileTimer timer(profile);
+        std::vector<const QueryNode*> leaves;
+        collect_leaves(node, leaves);
+        std::vector<ProfileNode*> leaf_profiles(ctx.leaf_count, nullptr);
+        if (profile) {
+            add_subtree_profile(profile, node, leaf_profiles);
+            profile->detail["in_process"] = true;
+        }
+        
+        // Only rows inside the bounds of the plan and the valid region can be
+        // selected; the excluded operands of a difference do not widen them
+        bool any_proper = false;
+        std::vector<const QueryNode*> sql_leaves;
+        Rectangle snapshot_region = ctx.valid_region;
+        Rectangle crops_box{0.0, 0.0, 0.0, 0.0};
+        for (const QueryNode* leaf : leaves) {
+            if (leaf->crop.proper) {
+                // The group bounds decide proper for rectangles only; a
+                // shaped proper crop runs as its own statement
+                if (leaf->crop.shape.kind == CropShape::Kind::Rectangle) {
+                    any_proper = true;
                 } else {
-                    std::set<long long> intersection;
-                    std::set_intersection(
-                        result.begin(), result.end(),
-                        operand_result.begin(), operand_result.end(),
-                        std::inserter(intersection, intersection.begin())
-                    );
-                    result = intersection;
+                    sql_leaves.push_back(leaf);
                 }
             }
+        }
+        if (!plan_bounds(node, crops_box)) {
+            return {};
+        }
+        snapshot_region = {std::max(snapshot_region.x_min, crops_box.x_min), std::max(snapshot_region.y_min, crops_box.y_min),
+                           std::min(snapshot_region.x_max, crops_box.x_max), std::min(snapshot_region.y_max, crops_box.y_max)};
+        
+        const char* x = quantization_.enabled ? "qx" : "coord_x";
+        const char* y = quantization_.enabled ? "qy" : "coord_y";
+        std::ostringstream rows_sql, groups_sql;
+        rows_sql << "SELECT id, " << x << ", " << y << ", category, group_id FROM inspection_region WHERE "
+                 << region_predicate(snapshot_region);
+        if (ctx.sample_fraction < 1.0) {
+            rows_sql << " AND " << sample_predicate(ctx.sample_fraction, "");
+        }
+        // Proper crops need the bounds of every group with a point in the
+        // snapshot, including its points outside of it
+        groups_sql << "SELECT g.group_id, MIN(g." << x << "), MIN(g." << y << "), MAX(g." << x << "), MAX(g." << y << "), "
+                   << "COUNT(g." << x << ") = COUNT(*) AND COUNT(g." << y << ") = COUNT(*) "
+                   << "FROM " << group_members("IN (SELECT r.group_id FROM inspection_region r WHERE " +
+                                               region_predicate(snapshot_region, "r.") + ")")
+                   << " GROUP BY g.group_id";
+        
+        // All statements go out in one round-trip
+        pqxx::pipeline pipe(txn);
+        const auto rows_query = pipe.insert(rows_sql.str());
+        pqxx::pipeline::query_id groups_query{};
+        if (any_proper) groups_query = pipe.insert(groups_sql.str());
+        std::vector<pqxx::pipeline::query_id> leaf_queries;
+        for (const QueryNode* leaf : sql_leaves) {
+            leaf_queries.push_back(pipe.insert(crop_sql(ctx, leaf->crop, leaf->crop.region)));
+        }
+        pipe.complete();
+        
+        const pqxx::result rows_result = pipe.retrieve(rows_query);
+        SnapshotRows rows(ctx.memory);
+        rows.reserve(rows_result.size());
+        for (const auto& row : rows_result) {
+            SnapshotRow r;
+            r.id = row[0].as<long long>();
+            r.x = row[1].as<double>();
+            r.y = row[2].as<double>();
+            r.has_category = !row[3].is_null();
+            r.category = r.has_category ? row[3].as<int>() : 0;
+            r.has_group = !row[4].is_null();
+            r.group_id = r.has_group ? row[4].as<int>() : 0;
+            rows.push_back(r);
+        }
+        
+        GroupBoundsMap groups(ctx.memory);
+        size_t bytes = 0;
+        if (any_proper) {
+            const pqxx::result groups_result = pipe.retrieve(groups_query);
+            groups.reserve(groups_result.size());
+            for (const auto& row : groups_result) {
+                groups[row[0].as<int>()] = {row[1].as<double>(), row[2].as<double>(),
+                                            row[3].as<double>(), row[4].as<double>(), row[5].as<bool>()};
+            }
+            if (profile) bytes += result_bytes(groups_result);
+        }
+        
+        // Group-filtered crops go through the rows of their groups only
+        GroupPostings postings(ctx.memory);
+        if (std::any_of(leaves.begin(), leaves.end(), [](const QueryNode* leaf) { return leaf->crop.has_groups; })) {
+            postings = build_group_postings(rows);
+        }
+        
+        std::pmr::vector<Bitmap> leaf_bits(ctx.leaf_count, ctx.memory);
+        const size_t words = (rows.size() + 63) / 64;
+        
+        // Ids from SQL map back to snapshot rows; every one of them lies
+        // inside the snapshot region
+        std::pmr::unordered_map<long long, size_t> row_of_id(ctx.memory);
+        if (!sql_leaves.empty()) {
+            row_of_id.reserve(rows.size());
+            for (size_t i = 0; i < rows.size(); ++i) row_of_id.emplace(rows[i].id, i);
+        }
+        for (size_t k = 0; k < sql_leaves.size(); ++k) {
+            const pqxx::result leaf_result = pipe.retrieve(leaf_queries[k]);
+            Bitmap& bits = leaf_bits[sql_leaves[k]->leaf_index];
+            bits.assign(words, 0);
+            for (const auto& row : leaf_result) {
+                auto found = row_of_id.find(row[0].as<long long>());
+                if (found != row_of_id.end()) bits[found->second / 64] |= uint64_t{1} << (found->second % 64);
+            }
+            if (profile) bytes += result_bytes(leaf_result);
+        }
+        
+        for (const QueryNode* leaf : leaves) {
+            const bool from_sql = leaf->crop.proper && leaf->crop.shape.kind != CropShape::Kind::Rectangle;
+            if (!from_sql) {
+                leaf_bits[leaf->leaf_index] = crop_bitmap(quantization_, leaf->crop, ctx.valid_region, rows, groups, postings);
+            }
+            if (ProfileNode* leaf_profile = leaf_profiles[leaf->leaf_index]) {
+                leaf_profile->rows_in = rows.size();
+                leaf_profile->rows_out = popcount(leaf_bits[leaf->leaf_index]);
+            }
+        }
+        const Bitmap result_bits = combine_bitmaps(node, leaf_bits, words, node.type == NodeType::Crop ? nullptr : profile);
+        
+        IdSet ids(ctx.memory);
+        for (size_t w = 0; w < words; ++w) {
+            for (uint64_t word = result_bits[w]; word != 0; word &= word - 1) {
+                ids.insert(rows[w * 64 + static_cast<size_t>(__builtin_ctzll(word))].id);
+            }
+        }
+        
+        if (profile) {
+            profile->detail["snapshot_rows"] = rows.size();
+            profile->detail["snapshot_groups"] = groups.size();
+            profile->detail["snapshot_postings"] = postings.slot_of_group.size();
+            profile->sql_statements += (any_proper ? 2 : 1) + sql_leaves.size();
+            profile->sql_round_trips += 1;
+            profile->bytes += bytes + result_bytes(rows_result);
+            profile->rows_out = ids.size();
+        }
+        return ids;
+    }
+IdSet QueryEngine::evaluate(pqxx::work& txn, const ExecutionContext& ctx, const QueryNode& node, ProfileNode* profile) {
+        if (profile) {
+            profile->detail["strategy"] = strategy_name(ctx.strategy);
+        }
+        
+        switch (ctx.strategy) {
+        case ExecutionStrategy::Sequential:
+            return evaluate_sequential(txn, ctx, node, profile);
+        case ExecutionStrategy::Parallel:
+            return evaluate_parallel(txn, ctx, node, profile);
+        case ExecutionStrategy::Pushdown:
+            return evaluate_pushdown(txn, ctx, node, profile);
+        case ExecutionStrategy::InProcess:
+            return evaluate_in_process(txn, ctx, node, profile);
+        default:
+            return evaluate_pipelined(txn, ctx, node, profile);
+        }
+    }
+IdSet QueryEngine::evaluate_parallel(pqxx::work& txn, const ExecutionContext& ctx, const QueryNode& node, ProfileNode* profile) {
+        if (node.type == NodeType::Crop) {
+            if (options_.crop_tiles > 1 && node.crop.region.y_max > node.crop.region.y_min) {
+                return evaluate_tiled_crop(txn, ctx, node, profile);
+            }
+            return evaluate_crop(txn, ctx, node, profile);
+        }
+        
+        ProfileTimer timer(profile);
+        
+        // Profile nodes are created here, before any operand runs on another
+        // thread, so each task only ever writes its own node.
+        std::vector<ProfileNode*> operand_profiles;
+        for (const auto& child : node.children) {
+            operand_profiles.push_back(add_operator_profile(profile, *child));
+        }
+        
+        // Operands are independent: hand all but the first to the pool, each
+        // in its own transaction, and evaluate the rest here meanwhile.
+        IdSets operand_results(node.children.size(), ctx.memory);
+        TaskGroup group(*workers_);
+        std::vector<size_t> inline_operands = {0};
+        for (size_t i = 1; i < node.children.size(); ++i) {
+            auto evaluate_operand = [this, &ctx, &node, &operand_results, &operand_profiles, i](pqxx::work& operand_txn) {
+                operand_results[i] = evaluate_parallel(operand_txn, ctx, *node.children[i], operand_profiles[i]);
+            };
+            if (!spawn_with_connection(group, evaluate_operand)) {
+                inline_operands.push_back(i);
+            }
+        }
+        // Operands left without a connection are pipelined on this one
+        for (size_t i : inline_operands) {
+            if (i == 0 && !node.children.empty()) {
+                operand_results[i] = evaluate_parallel(txn, ctx, *node.children[i], operand_profiles[i]);
+            } else if (i > 0) {
+                operand_results[i] = evaluate_pipelined(txn, ctx, *node.children[i], operand_profiles[i]);
+            }
+        }
+        group.wait();
+        
+        return combine(node, operand_results, profile);
+    }
+QueryEngine::QueryEngine(const std::string& connection_string, const EngineOptions& options)
+        : QueryEngine(std::make_shared<ConnectionPool>(connection_string, [&options] {
+              // One connection per worker plus the caller's
+              ConnectionPoolOptions pool_options;
+              pool_options.max_connections = std::max<size_t>(options.threads, 1) + 1;
+              return pool_options;
+          }()), options) {
+    }
+
+QueryEngine::QueryEngine(std::shared_ptr<ConnectionPool> connections, const EngineOptions& options)
+        : options_(options), connections_(std::move(connections)) {
+        load_dataset_metadata();
+        if (options_.strategy == ExecutionStrategy::Auto) {
+            // The loader's catalog describes exactly the data it loaded;
+            // planner statistics cover tables filled some other way
+            if (catalog_) {
+                statistics_ = catalog_->table_statistics();
+            } else {
+                load_table_statistics();
+            }
+        }
+        
+        // Auto only picks Parallel when there are threads to use
+        if (options_.strategy == ExecutionStrategy::Parallel ||
+            (options_.strategy == ExecutionStrategy::Auto && options_.threads > 1)) {
+            workers_ = std::make_unique<ThreadPool>(std::max<size_t>(options_.threads, 1));
+        }
+    }
+
+std::vector<Point> QueryEngine::execute_query(const json& query_json, ProfileNode* profile) {
+        std::vector<Point> points;
+        
+        execute_query_stream(query_json, [&points](const std::vector<Point>& chunk) {
+            points.insert(points.end(), chunk.begin(), chunk.end());
+        }, 10000, profile);
+        
+        return points;
+    }
+
+void QueryEngine::execute_query_stream(const json& query_json,
+                                       const std::function<void(const std::vector<Point>&)>& on_chunk,
+                                       size_t chunk_size,
+                                       ProfileNode* profile) {
+        ExecutionContext ctx;
+        
+        if (profile) {
+            *profile = ProfileNode("query");
+            profile->detail["threads"] = options_.threads;
+            profile->detail["crop_tiles"] = options_.crop_tiles;
+            profile->detail["quantized"] = quantization_.enabled;
+        }
+        ProfileTimer query_timer(profile);
+        
+        std::unique_ptr<QueryNode> plan;
+        {
+            ProfileTimer parse_timer(profile ? profile->add_child("parse") : nullptr);
+            
+            // Parse valid region
+            ctx.valid_region = parse_rectangle(query_json["valid_region"]);
             
-            return result;
+            if (is_aggregate(query_json["query"])) {
+                throw std::runtime_error("operator_count and operator_histogram return a summary; use execute_aggregate");
+            }
+            
+            // Parse query tree
+            plan = optimize_plan(parse_query(query_json["query"]), ctx.valid_region);
+            std::vector<const QueryNode*> leaves;
+            collect_leaves(*plan, leaves);
+            ctx.leaf_count = leaves.size();
+        }
+        
+        const ApproximateSpec approximate = parse_approximate(query_json);
+        if (approximate.enabled) {
+            ctx.sample_fraction = approximate.fraction;
+            if (profile) {
+                profile->detail["sample_fraction"] = approximate.fraction;
+                profile->detail["max_points"] = approximate.max_points;
+            }
+        }
+        
+        // A page is always pushed down, whatever the strategy
+        const PageSpec page = parse_page(query_json);
+        const bool paged = page.paged();
+        if (paged) {
+            ctx.strategy = ExecutionStrategy::Pushdown;
+            if (profile) profile->detail["strategy_source"] = "paged";
+        } else {
+            ctx.strategy = choose_strategy(ctx, *plan, profile ? &profile->detail : nullptr);
         }
-        else if (query_obj.contains("operator_or")) {
-            std::set<long long> result;
+        if (profile) profile->detail["strategy"] = strategy_name(ctx.strategy);
+        
+        ProfileNode* acquire_profile = profile ? profile->add_child("acquire_connection") : nullptr;
+        ConnectionPool::Lease conn = [&] {
+            ProfileTimer acquire_timer(acquire_profile);
+            return connections_->acquire();
+        }();
+        pqxx::work txn(*conn);
+        
+        // Full point data comes through a server-side cursor, sorted by
+        // (y, x) on the server, so only one chunk of rows is buffered here.
+        std::ostringstream cursor;
+        cursor << "DECLARE query_result NO SCROLL CURSOR FOR "
+               << (quantization_.enabled
+                   ? "SELECT r.id, r.qx, r.qy, r.category, r.group_id FROM inspection_region r "
+                   : "SELECT r.id, r.coord_x, r.coord_y, r.category, r.group_id FROM inspection_region r ");
+        const char* order = quantization_.enabled ? " ORDER BY r.qy, r.qx, r.id" : " ORDER BY r.coord_y, r.coord_x, r.id";
+        ProfileNode* fetch_profile = nullptr;
+        
+        if (paged) {
+            // The tree goes into the cursor statement itself. A lone crop's
+            // predicates, or a crop's minus an anti-join, apply to the rows
+            // directly, so the server can walk the (y, x) index from the
+            // cursor and stop after limit rows.
+            if (ProfileNode* plan_profile = add_operator_profile(profile, *plan)) {
+                std::vector<ProfileNode*> leaf_profiles(ctx.leaf_count, nullptr);
+                add_subtree_profile(plan_profile, *plan, leaf_profiles);
+                plan_profile->detail["paged"] = true;
+            }
+            cursor << "WHERE " << pushdown_condition(ctx, *plan);
+            if (page.has_after) {
+                cursor << " AND " << keyset_predicate(page, "r.");
+            }
+            cursor << order;
+            if (page.has_limit) {
+                cursor << " LIMIT " << page.limit;
+            }
+            fetch_profile = profile ? profile->add_child("fetch") : nullptr;
+        } else {
+            // Id sets and snapshots of this evaluation come from one arena,
+            // released in a piece before any rows stream in. Parallel
+            // allocates from its workers too. The context that points at it
+            // goes out of scope with it.
+            QueryArena arena(ctx.strategy == ExecutionStrategy::Parallel);
+            ExecutionContext arena_ctx = ctx;
+            arena_ctx.memory = &arena;
+            IdSet result_ids = evaluate(txn, arena_ctx, *plan, add_operator_profile(profile, *plan));
+            if (profile) profile->detail["arena_bytes"] = arena.bytes_allocated();
+
+            // A page is capped by its limit instead
+            if (approximate.max_points > 0 && result_ids.size() > approximate.max_points) {
+                keep_uniform_subset(result_ids, approximate.max_points);
+            }
             
-            for (const auto& operand : query_obj["operator_or"]) {
-                std::set<long long> operand_result = process_query(txn, operand);
-                result.insert(operand_result.begin(), operand_result.end());
+            fetch_profile = profile ? profile->add_child("fetch") : nullptr;
+            if (fetch_profile) fetch_profile->rows_in = result_ids.size();
+            
+            if (result_ids.empty()) {
+                txn.commit();
+                return;
             }
             
-            return result;
+            cursor << "WHERE r.id = ANY('{";
+            bool first = true;
+            for (long long id : result_ids) {
+                if (!first) cursor << ",";
+                cursor << id;
+                first = false;
+            }
+            cursor << "}'::bigint[])";
+            // Ids alone cannot be pruned; the bounds of the plan let a
+            // spatially partitioned table skip the tiles outside them
+            Rectangle bounds;
+            if (partitioned_ && plan_bounds(*plan, bounds)) {
+                cursor << " AND " << region_predicate(bounds, "r.");
+            }
+            cursor << order;
+            // The id set goes out of scope before any rows stream in
         }
         
-        return std::set<long long>();
-    }
-QueryEngine::QueryEngine(const std::string& connection_string)
-        : conn_(connection_string) {
+        ProfileTimer fetch_timer(fetch_profile);
+        txn.exec(cursor.str());
+        
+        const std::string fetch = "FETCH FORWARD " + std::to_string(std::max<size_t>(chunk_size, 1)) + " FROM query_result";
+        std::vector<Point> chunk;
+        size_t fetches = 0;
+        
+        while (true) {
+            pqxx::result res = txn.exec(fetch);
+            ++fetches;
+            if (fetch_profile) {
+                fetch_profile->bytes += result_bytes(res);
+                fetch_profile->rows_out += res.size();
+            }
+            if (res.empty()) {
+                break;
+            }
+            
+            chunk.clear();
+            for (const auto& row : res) {
+                chunk.push_back(read_point(row));
+            }
+            on_chunk(chunk);
+        }
+        
+        txn.exec("CLOSE query_result");
+        txn.commit();
+        
+        if (fetch_profile) {
+            // DECLARE, every FETCH including the final empty one, and CLOSE
+            fetch_profile->sql_statements = fetches + 2;
+            fetch_profile->sql_round_trips = fetches + 2;
+            profile->rows_out = fetch_profile->rows_out;
+        }
     }
 
-std::vector<Point> QueryEngine::execute_query(const json& query_json) {
-        // Parse valid region
-        valid_region_.x_min = query_json["valid_region"]["p_min"]["x"].get<double>();
-        valid_region_.y_min = query_json["valid_region"]["p_min"]["y"].get<double>();
-        valid_region_.x_max = query_json["valid_region"]["p_max"]["x"].get<double>();
-        valid_region_.y_max = query_json["valid_region"]["p_max"]["y"].get<double>();
+std::string QueryEngine::aggregate_sql(const ExecutionContext& ctx, const AggregateSpec& spec, const QueryNode& plan) const {
+        // The operand tree becomes a subquery of ids, as for pushdown, and
+        // the server aggregates the matching rows
+        const std::string ids = pushdown_sql(ctx, plan);
+        if (spec.kind == AggregateKind::Count) {
+            return "SELECT COUNT(*) FROM (" + ids + ") t";
+        }
         
-        pqxx::work txn(conn_);
-        // Process query
-        std::set<long long> result_ids = process_query(txn, query_json["query"]);
+        std::ostringstream key;
+        key.precision(std::numeric_limits<double>::max_digits10);
+        switch (spec.by) {
+        case HistogramKey::Category:
+            key << "p.category";
+            break;
+        case HistogramKey::Group:
+            key << "p.group_id";
+            break;
+        case HistogramKey::Grid:
+            // Cells are computed from the coordinates as the client would
+            // dequantize them, so a point's cell matches its output value
+            if (quantization_.enabled) {
+                key << "FLOOR(((" << quantization_.offset_x << " + p.qx * " << quantization_.scale << "::float8) - "
+                    << ctx.valid_region.x_min << ") / " << spec.cell_width << ")::bigint, "
+                    << "FLOOR(((" << quantization_.offset_y << " + p.qy * " << quantization_.scale << "::float8) - "
+                    << ctx.valid_region.y_min << ") / " << spec.cell_height << ")::bigint";
+            } else {
+                key << "FLOOR((p.coord_x - " << ctx.valid_region.x_min << ") / " << spec.cell_width << ")::bigint, "
+                    << "FLOOR((p.coord_y - " << ctx.valid_region.y_min << ") / " << spec.cell_height << ")::bigint";
+            }
+            break;
+        }
         
-        // Fetch full point data
-        std::vector<Point> points;
+        const std::string columns = (spec.by == HistogramKey::Grid) ? "1, 2" : "1";
+        return "SELECT " + key.str() + ", COUNT(*) FROM inspection_region p WHERE p.id IN (" + ids + ") "
+               "GROUP BY " + columns + " ORDER BY " + columns;
+    }
+
+json QueryEngine::execute_aggregate(const json& query_json, ProfileNode* profile) {
+        ExecutionContext ctx;
+        // The tree is evaluated inside the aggregate statement
+        ctx.strategy = ExecutionStrategy::Pushdown;
+        
+        if (profile) {
+            *profile = ProfileNode("query");
+            profile->detail["strategy"] = strategy_name(ctx.strategy);
+            profile->detail["strategy_source"] = "aggregate";
+            profile->detail["quantized"] = quantization_.enabled;
+        }
+        ProfileTimer query_timer(profile);
         
-        for (long long id : result_ids) {
-            pqxx::result res = txn.exec_params(
-                "SELECT id, coord_x, coord_y, category, group_id FROM inspection_region WHERE id = $1",
-                id
-            );
+        AggregateSpec spec;
+        std::unique_ptr<QueryNode> plan;
+        {
+            ProfileTimer parse_timer(profile ? profile->add_child("parse") : nullptr);
+            ctx.valid_region = parse_rectangle(query_json["valid_region"]);
             
-            if (!res.empty()) {
-                Point p;
-                p.id = res[0][0].as<long long>();
-                p.x = res[0][1].as<double>();
-                p.y = res[0][2].as<double>();
-                p.category = res[0][3].as<int>();
-                p.group_id = res[0][4].as<int>();
-                points.push_back(p);
+            const json& query_obj = query_json["query"];
+            if (!is_aggregate(query_obj)) {
+                throw std::runtime_error("execute_aggregate expects operator_count or operator_histogram");
             }
+            const json* operand = nullptr;
+            spec = parse_aggregate(query_obj, operand);
+            plan = optimize_plan(parse_query(*operand), ctx.valid_region);
+            std::vector<const QueryNode*> leaves;
+            collect_leaves(*plan, leaves);
+            ctx.leaf_count = leaves.size();
         }
         
+        const ApproximateSpec approximate = parse_approximate(query_json);
+        if (approximate.enabled) {
+            ctx.sample_fraction = approximate.fraction;
+            if (profile) profile->detail["sample_fraction"] = approximate.fraction;
+        }
+        // Counts in the sample scaled to the whole table
+        auto estimate = [&approximate](size_t sampled) {
+            return estimate_count(static_cast<double>(sampled), approximate.enabled ? approximate.fraction : 1.0,
+                                  approximate.confidence);
+        };
+        auto rounded = [](double count) { return static_cast<size_t>(std::llround(count)); };
+        
+        ProfileNode* acquire_profile = profile ? profile->add_child("acquire_connection") : nullptr;
+        ConnectionPool::Lease conn = [&] {
+            ProfileTimer acquire_timer(acquire_profile);
+            return connections_->acquire();
+        }();
+        pqxx::work txn(*conn);
+        
+        ProfileNode* aggregate_profile = profile ? profile->add_child(spec.kind == AggregateKind::Count ? "count" : "histogram") : nullptr;
+        ProfileTimer aggregate_timer(aggregate_profile);
+        pqxx::result res = txn.exec(aggregate_sql(ctx, spec, *plan));
         txn.commit();
+        
+        json out;
+        size_t sampled = 0;
+        if (spec.kind == AggregateKind::Count) {
+            sampled = res[0][0].as<size_t>();
+            out = {{"aggregate", "count"}, {"count", rounded(estimate(sampled).estimate)}};
+        } else {
+            static const char* const kKeyNames[] = {"category", "group", "grid"};
+            json buckets = json::array();
+            size_t total = 0;
+            for (const auto& row : res) {
+                json bucket;
+                if (spec.by == HistogramKey::Grid) {
+                    const long long cx = row[0].as<long long>();
+                    const long long cy = row[1].as<long long>();
+                    const double x_min = ctx.valid_region.x_min + static_cast<double>(cx) * spec.cell_width;
+                    const double y_min = ctx.valid_region.y_min + static_cast<double>(cy) * spec.cell_height;
+                    bucket["cell"] = {cx, cy};
+                    bucket["region"] = {x_min, y_min, x_min + spec.cell_width, y_min + spec.cell_height};
+                } else {
+                    bucket["key"] = row[0].is_null() ? json(nullptr) : json(row[0].as<long long>());
+                }
+                const size_t count = row[row.size() - 1].as<size_t>();
+                const SampledCount bucket_count = estimate(count);
+                bucket["count"] = rounded(bucket_count.estimate);
+                if (approximate.enabled) {
+                    bucket["low"] = bucket_count.low;
+                    bucket["high"] = bucket_count.high;
+                }
+                total += count;
+                buckets.push_back(std::move(bucket));
+            }
+            sampled = total;
+            out = {{"aggregate", "histogram"}, {"by", kKeyNames[static_cast<int>(spec.by)]},
+                   {"total", rounded(estimate(total).estimate)}, {"buckets", std::move(buckets)}};
+        }
+        if (approximate.enabled) {
+            const SampledCount count = estimate(sampled);
+            out["approximate"] = {{"fraction", approximate.fraction}, {"confidence", approximate.confidence},
+                                  {"sampled", sampled}, {"low", count.low}, {"high", count.high}};
+        }
+        
+        if (aggregate_profile) {
+            aggregate_profile->sql_statements = 1;
+            aggregate_profile->sql_round_trips = 1;
+            aggregate_profile->bytes = result_bytes(res);
+            aggregate_profile->rows_out = res.size();
+            profile->rows_out = res.size();
+        }
+        return out;
+    }
 
-        // Sort by (y, x)
-        std::sort(points.begin(), points.end());
+json QueryEngine::explain_node(pqxx::work& txn, const ExecutionContext& ctx, const QueryNode& node,
+                               const ProfileNode* profile, bool analyze) {
+        json out;
         
-        return points;
+        if (node.type == NodeType::Crop) {
+            const std::string sql = crop_sql(ctx, node.crop, node.crop.region);
+            pqxx::result res = txn.exec(std::string("EXPLAIN (") + (analyze ? "ANALYZE, BUFFERS, " : "") + "FORMAT JSON) " + sql);
+            const json pg_explain = json::parse(res[0][0].as<std::string>());
+            const json& pg_plan = pg_explain[0]["Plan"];
+            
+            json scans = json::array();
+            collect_scans(pg_plan, scans);
+            bool index_used = false;
+            for (const auto& scan : scans) {
+                index_used = index_used || scan.contains("index");
+            }
+            
+            out = {
+                {"operator", "crop"},
+                {"leaf_index", node.leaf_index},
+                {"region", {node.crop.region.x_min, node.crop.region.y_min, node.crop.region.x_max, node.crop.region.y_max}},
+                {"sql", sql},
+                {"estimated_rows", pg_plan.value("Plan Rows", 0.0)},
+                {"scans", scans},
+                {"index_used", index_used}
+            };
+            if (node.crop.has_category) out["category"] = node.crop.category;
+            if (node.crop.has_groups) out["groups"] = node.crop.groups;
+            if (node.crop.proper) out["proper"] = true;
+            if (node.crop.shape.kind != CropShape::Kind::Rectangle) out["shape"] = shape_name(node.crop.shape.kind);
+            
+            // Buffer counts are inclusive at the top node; hits were served
+            // from PostgreSQL's shared buffer cache.
+            if (analyze) {
+                out["buffers"] = {
+                    {"shared_hit", pg_plan.value("Shared Hit Blocks", 0)},
+                    {"shared_read", pg_plan.value("Shared Read Blocks", 0)}
+                };
+                out["server_ms"] = pg_explain[0].value("Execution Time", 0.0);
+            }
+        }
+        else {
+            json children = json::array();
+            double estimated = 0.0;
+            for (size_t i = 0; i < node.children.size(); ++i) {
+                const ProfileNode* child_profile = profile ? profile->children[i].get() : nullptr;
+                json child = explain_node(txn, ctx, *node.children[i], child_profile, analyze);
+                
+                // An AND returns at most its smallest operand, an OR at most
+                // the sum of its operands, a difference at most its first
+                const double child_estimate = child["estimated_rows"].get<double>();
+                if (node.type == NodeType::And) {
+                    estimated = (i == 0) ? child_estimate : std::min(estimated, child_estimate);
+                } else if (node.type == NodeType::Difference) {
+                    if (i == 0) estimated = child_estimate;
+                } else {
+                    estimated += child_estimate;
+                }
+                children.push_back(std::move(child));
+            }
+            
+            out = {
+                {"operator", operator_name(node.type)},
+                {"estimated_rows", estimated},
+                {"children", std::move(children)}
+            };
+        }
+        // The loader's estimate, next to PostgreSQL's
+        if (catalog_) {
+            out["catalog_rows"] = catalog_->result_rows(node, ctx.valid_region);
+        }
+        
+        if (profile) {
+            out["actual_rows"] = profile->rows_out;
+            out["wall_ms"] = profile->wall_ms;
+            if (profile->detail.contains("pipelined")) {
+                out["pipelined"] = true;
+            }
+        }
+        return out;
+    }
+
+json QueryEngine::explain(const json& query_json, bool analyze) {
+        ExecutionContext ctx;
+        ctx.valid_region = parse_rectangle(query_json["valid_region"]);
+        
+        // An aggregate is explained through the tree it summarizes
+        const json* tree = &query_json["query"];
+        AggregateSpec spec;
+        const bool aggregate = is_aggregate(*tree);
+        if (aggregate) {
+            spec = parse_aggregate(query_json["query"], tree);
+        }
+        std::unique_ptr<QueryNode> plan = optimize_plan(parse_query(*tree), ctx.valid_region);
+        std::vector<const QueryNode*> leaves;
+        collect_leaves(*plan, leaves);
+        ctx.leaf_count = leaves.size();
+        const ApproximateSpec approximate = parse_approximate(query_json);
+        if (approximate.enabled) {
+            ctx.sample_fraction = approximate.fraction;
+        }
+        json choice = json::object();
+        if (aggregate) {
+            ctx.strategy = ExecutionStrategy::Pushdown;
+            choice["strategy_source"] = "aggregate";
+        } else {
+            ctx.strategy = choose_strategy(ctx, *plan, &choice);
+        }
+        
+        ConnectionPool::Lease conn = connections_->acquire();
+        pqxx::work txn(*conn);
+        
+        // Run the plan the way execute_query would, to get actual rows
+        ProfileNode profile("explain");
+        ProfileNode* plan_profile = nullptr;
+        size_t arena_bytes = 0;
+        if (analyze) {
+            QueryArena arena(ctx.strategy == ExecutionStrategy::Parallel);
+            ExecutionContext arena_ctx = ctx;
+            arena_ctx.memory = &arena;
+            plan_profile = add_operator_profile(&profile, *plan);
+            evaluate(txn, arena_ctx, *plan, plan_profile);
+            arena_bytes = arena.bytes_allocated();
+        }
+        
+        json out = {
+            {"valid_region", {ctx.valid_region.x_min, ctx.valid_region.y_min, ctx.valid_region.x_max, ctx.valid_region.y_max}},
+            {"quantized", quantization_.enabled},
+            {"partitioned", partitioned_},
+            {"strategy", strategy_name(ctx.strategy)},
+            {"strategy_source", choice["strategy_source"]},
+            {"threads", options_.threads},
+            {"crop_tiles", options_.crop_tiles},
+            {"analyze", analyze},
+            {"plan", explain_node(txn, ctx, *plan, plan_profile, analyze)}
+        };
+        if (choice.contains("estimated_cost_us")) {
+            out["estimated_cost_us"] = choice["estimated_cost_us"];
+            out["statistics_source"] = choice["statistics_source"];
+        }
+        if (analyze) {
+            out["arena_bytes"] = arena_bytes;
+        }
+        if (approximate.enabled) {
+            out["sample_fraction"] = approximate.fraction;
+        }
+        if (aggregate) {
+            out["aggregate_sql"] = aggregate_sql(ctx, spec, *plan);
+        }
+        if (analyze) {
+            out["sql_statements"] = profile.total_sql_statements();
+            out["sql_round_trips"] = profile.total_sql_round_trips();
+        }
+        
+        txn.commit();
+        return out;
+    }
+double QueryEngine::estimate_rows(const json& query_json) const {
+        const Rectangle valid_region = parse_rectangle(query_json["valid_region"]);
+        const json* tree = &query_json["query"];
+        if (is_aggregate(*tree)) {
+            parse_aggregate(query_json["query"], tree);
+        }
+        std::unique_ptr<QueryNode> plan = optimize_plan(parse_query(*tree), valid_region);
+        
+        if (catalog_) {
+            return catalog_->result_rows(*plan, valid_region);
+        }
+        if (statistics_.valid) {
+            return CostModel(statistics_, options_.threads).result_rows(*plan, valid_region);
+        }
+        throw std::runtime_error("No statistics to estimate from: load the dataset with data_loader or analyze inspection_region");
     }
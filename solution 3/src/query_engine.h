@@ -4,11 +4,26 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <memory>
+#include <functional>
 #include <pqxx/pqxx>
 #include <nlohmann/json.hpp>
 
+#include "connection_pool.h"
+#include "quantization.h"
+#include "query_arena.h"
+#include "thread_pool.h"
+
 using json = nlohmann::json;
 
+struct QueryNode;
+struct CropSpec;
+struct CropShape;
+struct AggregateSpec;
+struct PageSpec;
+struct ProfileNode;
+class StatisticsCatalog;
+
 struct Point {
     long long id;
     double x, y;
@@ -24,19 +39,174 @@ struct Rectangle {
     bool contains(double x, double y) const;
 };
 
+// How the crops of a plan are sent to the database. Every strategy returns
+// exactly the same points.
+enum class ExecutionStrategy {
+    Auto,       // chosen per query by the cost model from table statistics
+    Sequential, // one statement per crop, each awaited before the next
+    Pipelined,  // all crops in one batch on one connection
+    Parallel,   // AND/OR operands on worker threads, each with its own connection
+    Pushdown,   // the whole tree as one INTERSECT / UNION statement
+    InProcess   // rows under the crops fetched once, operators evaluated here
+};
+
+const char* strategy_name(ExecutionStrategy strategy);
+// Inverse of strategy_name; throws std::runtime_error for unknown names
+ExecutionStrategy parse_strategy(const std::string& name);
+// Every strategy other than Auto, e.g. to check them against each other
+std::vector<ExecutionStrategy> all_strategies();
+
+struct EngineOptions {
+    // Anything but Auto overrides the cost model for every query
+    ExecutionStrategy strategy = ExecutionStrategy::Auto;
+    // Worker threads of the Parallel strategy, for evaluating AND/OR
+    // operands and crop tiles concurrently
+    size_t threads = 1;
+    // Number of horizontal bands a single crop is split into by Parallel
+    size_t crop_tiles = 1;
+    // Find the points of a group through the group_posting table when
+    // data_loader built one, instead of by group_id
+    bool group_postings = true;
+};
+
+// Planner statistics of inspection_region from pg_class and pg_stats, with
+// coordinates dequantized. Not valid until the table has been analyzed.
+struct TableStatistics {
+    bool valid = false;
+    double rows = 0.0;
+    Rectangle extent{0.0, 0.0, 0.0, 0.0};
+    double categories = 1.0;       // distinct values
+    double groups = 1.0;
+
+    double mean_group_size() const { return groups > 0.0 ? rows / groups : 1.0; }
+};
+
 class QueryEngine {
 public:
-    QueryEngine(const std::string& connection_string);
-    std::vector<Point> execute_query(const json& query_json);
+    // Opens a private connection pool sized for options.threads
+    QueryEngine(const std::string& connection_string, const EngineOptions& options = EngineOptions());
+    // Borrows connections from a pool that may be shared with other engines
+    QueryEngine(std::shared_ptr<ConnectionPool> connections, const EngineOptions& options = EngineOptions());
+
+    // Safe to call concurrently from several threads. When profile is given
+    // it is replaced by the execution statistics of this call.
+    std::vector<Point> execute_query(const json& query_json, ProfileNode* profile = nullptr);
+
+    // Delivers the result in (y, x) order in chunks of at most chunk_size
+    // points, so memory stays bounded for very large answers. The chunk is
+    // only valid for the duration of the callback.
+    //
+    // A query with a top-level "limit" and/or "after": {"y", "x"[, "id"]}
+    // returns one page: the first limit points after the cursor in (y, x,
+    // id) order. The next page's cursor is the last point of this one. Pages
+    // run as a single statement that walks the (y, x) index, so a page costs
+    // about its size rather than the size of the whole answer.
+    //
+    // A query with "approximate" (see ApproximateSpec) is evaluated on a
+    // sample and returns the result's points in the sample, at most
+    // max_points of them chosen uniformly. execute_query does the same.
+    void execute_query_stream(const json& query_json,
+                              const std::function<void(const std::vector<Point>&)>& on_chunk,
+                              size_t chunk_size = 10000,
+                              ProfileNode* profile = nullptr);
+
+    // Answers an operator_count or operator_histogram query with a summary
+    // computed on the server, so memory does not depend on how many points
+    // match: {"aggregate": "count", "count": n}, or {"aggregate":
+    // "histogram", "by": ..., "total": n, "buckets": [...]} where each bucket
+    // has a "key" (category / group id, null for none) or a grid "cell" and
+    // its "region", and a "count". execute_query rejects aggregates.
+    //
+    // With "approximate" the counts are estimated from the sample, scaled
+    // by its fraction, with an "approximate" summary and "low" / "high"
+    // bounds of the confidence interval.
+    json execute_aggregate(const json& query_json, ProfileNode* profile = nullptr);
+
+    // Describes the optimized plan without fetching points: the operator
+    // tree, the SQL of every crop, PostgreSQL's row estimate and the scans
+    // and indexes it would use. With analyze the plan is also evaluated and
+    // each node gets its actual rows and time, and each crop its buffer
+    // cache hits.
+    json explain(const json& query_json, bool analyze = false);
+
+    // Number of points a query would return, estimated from the statistics
+    // catalog data_loader stores with the dataset, or else from the planner
+    // statistics the Auto strategy loads, without touching the data. An
+    // aggregate is estimated by the tree it summarizes. Throws
+    // std::runtime_error if neither exists.
+    double estimate_rows(const json& query_json) const;
 
 private:
-    pqxx::connection conn_;
-    Rectangle valid_region_;
+    // Re-evaluates single crops through the same SQL as execute_query
+    friend class QuerySubscription;
+
+    // State of a single execute_query call
+    struct ExecutionContext {
+        Rectangle valid_region;
+        size_t leaf_count = 0;
+        ExecutionStrategy strategy = ExecutionStrategy::Pipelined;
+        // Below 1, crops only select the rows in a sample of this fraction
+        double sample_fraction = 1.0;
+        // Where id sets and in-process snapshots are allocated: the query's
+        // arena while it evaluates
+        std::pmr::memory_resource* memory = std::pmr::get_default_resource();
+    };
+
+    EngineOptions options_;
+    std::shared_ptr<ConnectionPool> connections_;
+    Quantization quantization_;
+    // inspection_region is partitioned, e.g. into spatial tiles by data_loader
+    bool partitioned_ = false;
+    // group_posting is current and options_.group_postings allows it
+    bool group_postings_ = false;
+    // data_loader gave every row a stratified sample_key
+    bool sample_keys_ = false;
+    TableStatistics statistics_;
+    // Null when the dataset was loaded without a catalog
+    std::shared_ptr<const StatisticsCatalog> catalog_;
+    std::unique_ptr<ThreadPool> workers_;
 
-    std::set<long long> get_valid_point_ids(pqxx::work& txn);
-    std::set<long long> get_proper_groups(pqxx::work& txn);
-    std::set<long long> process_crop(pqxx::work& txn, const json& crop_op);
-    std::set<long long> process_query(pqxx::work& txn, const json& query_obj);
+    void load_dataset_metadata();
+    void load_table_statistics();
+    // The configured strategy, or under Auto the cheapest one for this plan;
+    // explanation receives the estimates behind the choice
+    ExecutionStrategy choose_strategy(const ExecutionContext& ctx, const QueryNode& plan, json* explanation) const;
+    std::string region_predicate(const Rectangle& region, const std::string& alias = "") const;
+    std::string crop_sql(const ExecutionContext& ctx, const CropSpec& crop, const Rectangle& scan_region) const;
+    // WHERE clause of crop_sql, over the table aliased as r
+    std::string crop_condition(const ExecutionContext& ctx, const CropSpec& crop, const Rectangle& scan_region) const;
+    // FROM source and WHERE clause of the rows g of the groups whose id
+    // satisfies key_condition, e.g. "= r.group_id"; through group_posting
+    // when the dataset has one
+    std::string group_members(const std::string& key_condition) const;
+    // Rows of the table aliased as alias that are in the sample of fraction:
+    // by sample_key when the dataset has them, else by a hash of the id, so
+    // every statement of a query sees the same sample
+    std::string sample_predicate(double fraction, const std::string& alias) const;
+    // Exact test of a polygon or circle over the table aliased as alias
+    std::string shape_predicate(const CropShape& shape, const std::string& alias) const;
+    // Rows strictly after the page's cursor in (y, x, id) order
+    std::string keyset_predicate(const PageSpec& page, const std::string& alias) const;
+    Point read_point(const pqxx::row& row) const;
+    bool spawn_with_connection(TaskGroup& group, std::function<void(pqxx::work&)> task);
+    IdSet read_ids(const pqxx::result& res, std::pmr::memory_resource* memory) const;
+    // The ProfileNode* arguments are the node of the operator being
+    // evaluated, or nullptr when profiling is off.
+    IdSet evaluate_crop(pqxx::work& txn, const ExecutionContext& ctx, const QueryNode& leaf, ProfileNode* profile);
+    IdSet evaluate_tiled_crop(pqxx::work& txn, const ExecutionContext& ctx, const QueryNode& leaf, ProfileNode* profile);
+    IdSet evaluate_pipelined(pqxx::work& txn, const ExecutionContext& ctx, const QueryNode& node, ProfileNode* profile);
+    IdSet evaluate_sequential(pqxx::work& txn, const ExecutionContext& ctx, const QueryNode& node, ProfileNode* profile);
+    IdSet evaluate_parallel(pqxx::work& txn, const ExecutionContext& ctx, const QueryNode& node, ProfileNode* profile);
+    std::string pushdown_sql(const ExecutionContext& ctx, const QueryNode& node) const;
+    // WHERE clause over the table aliased as r that selects the rows of node
+    std::string pushdown_condition(const ExecutionContext& ctx, const QueryNode& node) const;
+    std::string aggregate_sql(const ExecutionContext& ctx, const AggregateSpec& spec, const QueryNode& plan) const;
+    IdSet evaluate_pushdown(pqxx::work& txn, const ExecutionContext& ctx, const QueryNode& node, ProfileNode* profile);
+    IdSet evaluate_in_process(pqxx::work& txn, const ExecutionContext& ctx, const QueryNode& node, ProfileNode* profile);
+    IdSet evaluate(pqxx::work& txn, const ExecutionContext& ctx, const QueryNode& node, ProfileNode* profile);
+    IdSet combine(const QueryNode& node, IdSets& operand_results, ProfileNode* profile) const;
+    IdSet combine_leaves(const QueryNode& node, IdSets& leaf_results, ProfileNode* profile) const;
+    json explain_node(pqxx::work& txn, const ExecutionContext& ctx, const QueryNode& node, const ProfileNode* profile, bool analyze);
 };
 
 #endif // QUERY_ENGINE_H
\ No newline at end of file
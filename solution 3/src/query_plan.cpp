@@ -0,0 +1,509 @@
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <stdexcept>
+
+#include "query_plan.h"
+
+namespace {
+
+// category, one_of_groups and proper, shared by every crop operator
+void parse_crop_filters(const json& crop_op, CropSpec& crop) {
+    if (crop_op.contains("category")) {
+        crop.has_category = true;
+        crop.category = crop_op["category"].get<int>();
+    }
+    if (crop_op.contains("one_of_groups")) {
+        crop.has_groups = true;
+        for (const auto& group : crop_op["one_of_groups"]) {
+            crop.groups.push_back(group.get<int>());
+        }
+    }
+    crop.proper = crop_op.contains("proper") && crop_op["proper"].get<bool>();
+}
+
+std::unique_ptr<QueryNode> parse_node(const json& query_obj, size_t& next_leaf) {
+    auto node = std::make_unique<QueryNode>();
+
+    if (query_obj.contains("operator_crop")) {
+        const json& crop_op = query_obj["operator_crop"];
+        node->type = NodeType::Crop;
+        node->leaf_index = next_leaf++;
+        node->crop.region = parse_rectangle(crop_op["region"]);
+        parse_crop_filters(crop_op, node->crop);
+    }
+    else if (query_obj.contains("operator_crop_polygon") || query_obj.contains("operator_crop_circle")) {
+        // The region is the shape's bounding box; the shape is tested on
+        // the points inside it
+        const bool is_polygon = query_obj.contains("operator_crop_polygon");
+        const json& crop_op = query_obj[is_polygon ? "operator_crop_polygon" : "operator_crop_circle"];
+        CropShape& shape = node->crop.shape;
+        node->type = NodeType::Crop;
+        node->leaf_index = next_leaf++;
+
+        if (is_polygon) {
+            shape.kind = CropShape::Kind::Polygon;
+            for (const auto& vertex : crop_op["points"]) {
+                shape.xs.push_back(vertex["x"].get<double>());
+                shape.ys.push_back(vertex["y"].get<double>());
+                if (!std::isfinite(shape.xs.back()) || !std::isfinite(shape.ys.back())) {
+                    throw std::runtime_error("operator_crop_polygon: points must be finite");
+                }
+            }
+            if (shape.xs.size() < 3) {
+                throw std::runtime_error("operator_crop_polygon: a polygon needs at least 3 points");
+            }
+        } else {
+            shape.kind = CropShape::Kind::Circle;
+            shape.center_x = crop_op["center"]["x"].get<double>();
+            shape.center_y = crop_op["center"]["y"].get<double>();
+            shape.radius = crop_op["radius"].get<double>();
+            if (!std::isfinite(shape.center_x) || !std::isfinite(shape.center_y)) {
+                throw std::runtime_error("operator_crop_circle: center must be finite");
+            }
+            // Also rejects NaN
+            if (!(shape.radius > 0.0 && std::isfinite(shape.radius))) {
+                throw std::runtime_error("operator_crop_circle: radius must be positive and finite");
+            }
+        }
+        node->crop.region = shape.bounds();
+        parse_crop_filters(crop_op, node->crop);
+    }
+    else if (query_obj.contains("operator_and") || query_obj.contains("operator_or")) {
+        const bool is_and = query_obj.contains("operator_and");
+        node->type = is_and ? NodeType::And : NodeType::Or;
+        for (const auto& operand : query_obj[is_and ? "operator_and" : "operator_or"]) {
+            node->children.push_back(parse_node(operand, next_leaf));
+        }
+    }
+    else if (query_obj.contains("operator_not")) {
+        node->type = NodeType::Not;
+        node->children.push_back(parse_node(query_obj["operator_not"], next_leaf));
+    }
+    else if (query_obj.contains("operator_difference")) {
+        node->type = NodeType::Difference;
+        for (const auto& operand : query_obj["operator_difference"]) {
+            node->children.push_back(parse_node(operand, next_leaf));
+        }
+    }
+    else {
+        node->type = NodeType::Or;
+    }
+
+    return node;
+}
+
+// An empty operator: an OR without operands, which is also what unknown
+// operators and empty ANDs reduce to
+bool matches_nothing(const QueryNode& node) {
+    return node.type != NodeType::Crop && node.children.empty();
+}
+
+std::unique_ptr<QueryNode> make_operator(NodeType type, std::vector<std::unique_ptr<QueryNode>> operands) {
+    auto node = std::make_unique<QueryNode>();
+    node->type = type;
+    node->children = std::move(operands);
+    return node;
+}
+
+std::unique_ptr<QueryNode> simplify(std::unique_ptr<QueryNode> node);
+
+// a - b - c with simplified operands: differences in the first operand and
+// ORs among the others are flattened, and negations are folded away since
+// a - NOT b is a AND b, and NOT a - b is NOT (a OR b)
+std::unique_ptr<QueryNode> simplify_difference(std::vector<std::unique_ptr<QueryNode>> operands) {
+    if (operands.empty() || matches_nothing(*operands.front())) {
+        return make_operator(NodeType::Or, {});
+    }
+
+    std::unique_ptr<QueryNode> minuend = std::move(operands.front());
+    std::vector<std::unique_ptr<QueryNode>> subtrahends;
+    std::vector<std::unique_ptr<QueryNode>> kept;
+    if (minuend->type == NodeType::Difference) {
+        for (size_t i = 1; i < minuend->children.size(); ++i) {
+            subtrahends.push_back(std::move(minuend->children[i]));
+        }
+        minuend = std::move(minuend->children.front());
+    }
+    for (size_t i = 1; i < operands.size(); ++i) {
+        std::unique_ptr<QueryNode>& operand = operands[i];
+        if (matches_nothing(*operand)) {
+            continue;
+        }
+        if (operand->type == NodeType::Not) {
+            kept.push_back(std::move(operand->children.front()));
+        } else if (operand->type == NodeType::Or) {
+            for (auto& grandchild : operand->children) {
+                subtrahends.push_back(std::move(grandchild));
+            }
+        } else {
+            subtrahends.push_back(std::move(operand));
+        }
+    }
+
+    if (minuend->type == NodeType::Not) {
+        subtrahends.insert(subtrahends.begin(), std::move(minuend->children.front()));
+        if (kept.empty()) {
+            std::vector<std::unique_ptr<QueryNode>> negated;
+            negated.push_back(simplify(make_operator(NodeType::Or, std::move(subtrahends))));
+            return simplify(make_operator(NodeType::Not, std::move(negated)));
+        }
+        minuend = simplify(make_operator(NodeType::And, std::move(kept)));
+    } else if (!kept.empty()) {
+        kept.insert(kept.begin(), std::move(minuend));
+        minuend = simplify(make_operator(NodeType::And, std::move(kept)));
+    }
+
+    if (matches_nothing(*minuend) || subtrahends.empty()) {
+        return minuend;
+    }
+    subtrahends.insert(subtrahends.begin(), std::move(minuend));
+    return make_operator(NodeType::Difference, std::move(subtrahends));
+}
+
+std::unique_ptr<QueryNode> simplify(std::unique_ptr<QueryNode> node) {
+    if (node->type == NodeType::Crop) {
+        return node;
+    }
+    if (node->type == NodeType::Not) {
+        std::unique_ptr<QueryNode> operand = simplify(std::move(node->children.front()));
+        // NOT NOT a is a
+        if (operand->type == NodeType::Not) {
+            return std::move(operand->children.front());
+        }
+        node->children.front() = std::move(operand);
+        return node;
+    }
+    if (node->type == NodeType::Difference) {
+        std::vector<std::unique_ptr<QueryNode>> operands;
+        for (auto& child : node->children) {
+            operands.push_back(simplify(std::move(child)));
+        }
+        return simplify_difference(std::move(operands));
+    }
+
+    std::vector<std::unique_ptr<QueryNode>> operands;
+    std::vector<std::unique_ptr<QueryNode>> negated;
+    for (auto& child : node->children) {
+        std::unique_ptr<QueryNode> operand = simplify(std::move(child));
+
+        if (matches_nothing(*operand)) {
+            if (node->type == NodeType::And) {
+                operands.clear();
+                negated.clear();
+                break;
+            }
+            continue;
+        }
+        // (a AND (b AND c)) is (a AND b AND c); likewise for OR
+        if (operand->type == node->type) {
+            for (auto& grandchild : operand->children) {
+                operands.push_back(std::move(grandchild));
+            }
+        } else if (operand->type == NodeType::Not) {
+            negated.push_back(std::move(operand->children.front()));
+        } else {
+            operands.push_back(std::move(operand));
+        }
+    }
+
+    if (!negated.empty()) {
+        if (node->type == NodeType::And) {
+            // a AND NOT b AND NOT c is a - b - c; without an a it is
+            // NOT (b OR c)
+            if (operands.empty()) {
+                std::vector<std::unique_ptr<QueryNode>> negation;
+                negation.push_back(simplify(make_operator(NodeType::Or, std::move(negated))));
+                return simplify(make_operator(NodeType::Not, std::move(negation)));
+            }
+            std::vector<std::unique_ptr<QueryNode>> difference;
+            difference.push_back(simplify(make_operator(NodeType::And, std::move(operands))));
+            for (auto& operand : negated) {
+                difference.push_back(std::move(operand));
+            }
+            return simplify_difference(std::move(difference));
+        }
+        // a OR NOT b OR NOT c is NOT ((b AND c) - a)
+        std::vector<std::unique_ptr<QueryNode>> difference;
+        difference.push_back(simplify(make_operator(NodeType::And, std::move(negated))));
+        for (auto& operand : operands) {
+            difference.push_back(std::move(operand));
+        }
+        std::vector<std::unique_ptr<QueryNode>> negation;
+        negation.push_back(simplify_difference(std::move(difference)));
+        return simplify(make_operator(NodeType::Not, std::move(negation)));
+    }
+
+    if (operands.size() == 1) {
+        return std::move(operands.front());
+    }
+    if (operands.empty()) {
+        node->type = NodeType::Or;
+    }
+    node->children = std::move(operands);
+    return node;
+}
+
+void number_leaves(QueryNode& node, size_t& next_leaf) {
+    if (node.type == NodeType::Crop) {
+        node.leaf_index = next_leaf++;
+        return;
+    }
+    for (auto& child : node.children) {
+        number_leaves(*child, next_leaf);
+    }
+}
+
+} // namespace
+
+Rectangle parse_rectangle(const json& region) {
+    Rectangle rect;
+    rect.x_min = region["p_min"]["x"].get<double>();
+    rect.y_min = region["p_min"]["y"].get<double>();
+    rect.x_max = region["p_max"]["x"].get<double>();
+    rect.y_max = region["p_max"]["y"].get<double>();
+    return rect;
+}
+
+bool is_aggregate(const json& query_obj) {
+    return query_obj.contains("operator_count") || query_obj.contains("operator_histogram");
+}
+
+AggregateSpec parse_aggregate(const json& query_obj, const json*& operand) {
+    AggregateSpec spec;
+    if (query_obj.contains("operator_count")) {
+        spec.kind = AggregateKind::Count;
+        operand = &query_obj["operator_count"];
+        return spec;
+    }
+
+    const json& histogram = query_obj.at("operator_histogram");
+    spec.kind = AggregateKind::Histogram;
+    operand = &histogram.at("query");
+
+    const std::string by = histogram.value("by", "category");
+    if (by == "category") {
+        spec.by = HistogramKey::Category;
+    } else if (by == "group") {
+        spec.by = HistogramKey::Group;
+    } else if (by == "grid") {
+        spec.by = HistogramKey::Grid;
+        const json& cell = histogram.at("cell_size");
+        spec.cell_width = cell.is_number() ? cell.get<double>() : cell.at("x").get<double>();
+        spec.cell_height = cell.is_number() ? cell.get<double>() : cell.at("y").get<double>();
+        if (!(spec.cell_width > 0.0) || !(spec.cell_height > 0.0)) {
+            throw std::runtime_error("operator_histogram: cell_size must be positive");
+        }
+    } else {
+        throw std::runtime_error("operator_histogram: unknown key '" + by + "', expected category, group or grid");
+    }
+    return spec;
+}
+
+std::unique_ptr<QueryNode> parse_query(const json& query_obj) {
+    size_t next_leaf = 0;
+    return parse_node(query_obj, next_leaf);
+}
+
+ApproximateSpec parse_approximate(const json& query_json) {
+    ApproximateSpec spec;
+    if (!query_json.contains("approximate")) {
+        return spec;
+    }
+    const json& approximate = query_json["approximate"];
+    if (approximate.is_boolean()) {
+        spec.enabled = approximate.get<bool>();
+        return spec;
+    }
+    spec.enabled = true;
+    spec.fraction = approximate.value("fraction", spec.fraction);
+    spec.confidence = approximate.value("confidence", spec.confidence);
+    spec.max_points = approximate.value("max_points", spec.max_points);
+    if (!(spec.fraction > 0.0 && spec.fraction <= 1.0)) {
+        throw std::runtime_error("approximate: fraction must be in (0, 1]");
+    }
+    if (!(spec.confidence > 0.0 && spec.confidence < 1.0)) {
+        throw std::runtime_error("approximate: confidence must be in (0, 1)");
+    }
+    return spec;
+}
+
+PageSpec parse_page(const json& query_json) {
+    PageSpec page;
+    if (query_json.contains("limit")) {
+        const json& limit = query_json["limit"];
+        if (!limit.is_number_unsigned() && !(limit.is_number_integer() && limit.get<long long>() >= 0)) {
+            throw std::runtime_error("limit must be a non-negative integer");
+        }
+        page.has_limit = true;
+        page.limit = limit.get<size_t>();
+    }
+    if (query_json.contains("after")) {
+        const json& after = query_json["after"];
+        if (!after.is_object() || !after.contains("y") || !after.contains("x") ||
+            !after["y"].is_number() || !after["x"].is_number()) {
+            throw std::runtime_error("after must be {\"y\": number, \"x\": number[, \"id\": integer]}");
+        }
+        page.has_after = true;
+        page.after_y = after["y"].get<double>();
+        page.after_x = after["x"].get<double>();
+        if (after.contains("id")) {
+            if (!after["id"].is_number_integer()) {
+                throw std::runtime_error("after: id must be an integer");
+            }
+            page.has_after_id = true;
+            page.after_id = after["id"].get<long long>();
+        }
+    }
+    return page;
+}
+
+SampledCount estimate_count(double sampled, double fraction, double confidence) {
+    SampledCount count;
+    count.estimate = count.low = count.high = sampled / fraction;
+    if (fraction >= 1.0) {
+        return count;
+    }
+    if (sampled <= 0.0) {
+        // Nothing sampled: the largest count that misses the sample with
+        // probability 1 - confidence
+        count.high = -std::log(1.0 - confidence) / fraction;
+        return count;
+    }
+    // Two-sided normal quantile, by bisection on the CDF
+    double lo = 0.0, hi = 40.0;
+    for (int i = 0; i < 100; ++i) {
+        const double z = (lo + hi) / 2.0;
+        (std::erf(z / std::sqrt(2.0)) < confidence ? lo : hi) = z;
+    }
+    const double half_width = lo * std::sqrt(sampled * (1.0 - fraction)) / fraction;
+    // Every sampled point exists, so the count is at least the sample's
+    count.low = std::max(sampled, count.estimate - half_width);
+    count.high = count.estimate + half_width;
+    return count;
+}
+
+std::unique_ptr<QueryNode> optimize_plan(std::unique_ptr<QueryNode> plan, const Rectangle& valid_region) {
+    plan = simplify(std::move(plan));
+    // Only a NOT at the root is left; its complement is the answer itself
+    if (plan->type == NodeType::Not) {
+        std::vector<std::unique_ptr<QueryNode>> difference;
+        difference.push_back(std::make_unique<QueryNode>());
+        difference.front()->type = NodeType::Crop;
+        difference.front()->crop.region = valid_region;
+        difference.push_back(std::move(plan->children.front()));
+        plan = simplify_difference(std::move(difference));
+    }
+    size_t next_leaf = 0;
+    number_leaves(*plan, next_leaf);
+    return plan;
+}
+
+IdSet combine_results(NodeType type, IdSets& operand_results) {
+    // Moving an operand into a result with the same memory takes its nodes
+    const IdSet::allocator_type memory =
+        operand_results.empty() ? IdSet::allocator_type() : operand_results.front().get_allocator();
+
+    if (type == NodeType::And) {
+        IdSet result(memory);
+        bool first = true;
+
+        for (auto& operand_result : operand_results) {
+            if (first) {
+                result = std::move(operand_result);
+                first = false;
+            } else {
+                IdSet intersection(memory);
+                std::set_intersection(
+                    result.begin(), result.end(),
+                    operand_result.begin(), operand_result.end(),
+                    std::inserter(intersection, intersection.begin())
+                );
+                result = std::move(intersection);
+            }
+        }
+
+        return result;
+    }
+
+    if (type == NodeType::Difference) {
+        // Each step costs about the smaller of the two sets, so excluding a
+        // few points from many is cheap, and vice versa
+        IdSet result(memory);
+        for (size_t i = 0; i < operand_results.size(); ++i) {
+            IdSet& operand_result = operand_results[i];
+            if (i == 0) {
+                result = std::move(operand_result);
+            } else if (operand_result.size() < result.size()) {
+                for (long long id : operand_result) {
+                    result.erase(id);
+                }
+            } else {
+                for (auto it = result.begin(); it != result.end();) {
+                    it = operand_result.count(*it) ? result.erase(it) : std::next(it);
+                }
+            }
+        }
+        return result;
+    }
+
+    IdSet result(memory);
+    for (const auto& operand_result : operand_results) {
+        result.insert(operand_result.begin(), operand_result.end());
+    }
+    return result;
+}
+
+void collect_leaves(const QueryNode& node, std::vector<const QueryNode*>& leaves) {
+    if (node.type == NodeType::Crop) {
+        leaves.push_back(&node);
+        return;
+    }
+    for (const auto& child : node.children) {
+        collect_leaves(*child, leaves);
+    }
+}
+
+bool plan_bounds(const QueryNode& node, Rectangle& bounds) {
+    if (node.type == NodeType::Crop) {
+        bounds = node.crop.region;
+        return bounds.x_min <= bounds.x_max && bounds.y_min <= bounds.y_max;
+    }
+
+    bool any = false;
+    for (size_t i = 0; i < node.children.size(); ++i) {
+        Rectangle child;
+        const bool selects = plan_bounds(*node.children[i], child);
+        if (node.type == NodeType::Difference) {
+            bounds = child;
+            return selects;
+        }
+        if (node.type == NodeType::And) {
+            if (!selects) {
+                return false;
+            }
+            bounds = (i == 0) ? child : Rectangle{std::max(bounds.x_min, child.x_min), std::max(bounds.y_min, child.y_min),
+                                                  std::min(bounds.x_max, child.x_max), std::min(bounds.y_max, child.y_max)};
+            any = bounds.x_min <= bounds.x_max && bounds.y_min <= bounds.y_max;
+            if (!any) {
+                return false;
+            }
+        } else if (selects) {
+            bounds = any ? Rectangle{std::min(bounds.x_min, child.x_min), std::min(bounds.y_min, child.y_min),
+                                     std::max(bounds.x_max, child.x_max), std::max(bounds.y_max, child.y_max)}
+                         : child;
+            any = true;
+        }
+    }
+    return any;
+}
+
+const char* operator_name(NodeType type) {
+    switch (type) {
+    case NodeType::Crop: return "crop";
+    case NodeType::And: return "and";
+    case NodeType::Difference: return "difference";
+    case NodeType::Not: return "not";
+    default: return "or";
+    }
+}
@@ -0,0 +1,149 @@
+#ifndef QUERY_PLAN_H
+#define QUERY_PLAN_H
+
+#include <memory>
+#include <set>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "crop_shape.h"
+#include "query_engine.h"
+
+using json = nlohmann::json;
+
+enum class NodeType {
+    Crop,
+    And,
+    Or,
+    Difference, // the first operand minus the union of the others
+    Not         // the valid region minus the operand; removed by optimize_plan
+};
+
+struct CropSpec {
+    Rectangle region;          // the bounding box of shape, if it has one
+    CropShape shape;
+    bool has_category = false;
+    int category = 0;
+    bool has_groups = false;
+    std::vector<int> groups;
+    bool proper = false;
+};
+
+// Summaries that operator_count / operator_histogram compute over the
+// points of their operand tree, instead of returning the points:
+//   {"operator_count": <tree>}
+//   {"operator_histogram": {"by": "category" | "group" | "grid",
+//                           "cell_size": {"x": w, "y": h},   (grid only)
+//                           "query": <tree>}}
+enum class AggregateKind {
+    Count,
+    Histogram
+};
+
+enum class HistogramKey {
+    Category,
+    Group,
+    Grid    // cells of cell_width x cell_height from the valid region's p_min
+};
+
+struct AggregateSpec {
+    AggregateKind kind = AggregateKind::Count;
+    HistogramKey by = HistogramKey::Category;
+    double cell_width = 0.0;
+    double cell_height = 0.0;
+};
+
+// Top-level "approximate" of a query document: crops are evaluated on a
+// sample of the points, so counts are estimates and point results a subset.
+//   "approximate": true
+//   "approximate": {"fraction": f, "confidence": c, "max_points": n}
+struct ApproximateSpec {
+    bool enabled = false;
+    double fraction = 0.01;     // share of the points in the sample, in (0, 1]
+    double confidence = 0.95;   // of the intervals around estimated counts
+    size_t max_points = 0;      // at most this many points returned; 0 for no cap
+};
+
+// Top-level "limit" and "after" of a query document, which ask for one page
+// of the result in (y, x, id) order
+//   "limit": n, "after": {"y": y, "x": x[, "id": id]}
+struct PageSpec {
+    bool has_limit = false;
+    size_t limit = 0;
+    bool has_after = false;
+    double after_y = 0.0;
+    double after_x = 0.0;
+    bool has_after_id = false;
+    long long after_id = 0;
+
+    bool paged() const { return has_limit || has_after; }
+};
+
+// An estimated count and its confidence interval
+struct SampledCount {
+    double estimate = 0.0;
+    double low = 0.0;
+    double high = 0.0;
+};
+
+// Parsed form of the "query" object. Leaves are numbered in document order
+// so their results can be fetched in one batch and looked up by index.
+struct QueryNode {
+    NodeType type;
+    CropSpec crop;                                   // Crop only
+    std::vector<std::unique_ptr<QueryNode>> children; // operators only
+    size_t leaf_index = 0;                           // Crop only
+};
+
+// Unknown operators parse to an empty OR, which evaluates to no points.
+// {"operator_not": <tree>} parses to Not and {"operator_difference":
+// [<tree>, ...]} to Difference. Throws std::runtime_error for a polygon of
+// fewer than 3 points, a circle whose radius is not positive, or a shape
+// with non-finite coordinates.
+std::unique_ptr<QueryNode> parse_query(const json& query_obj);
+// Disabled unless query_json has "approximate"; throws std::runtime_error
+// for a fraction outside (0, 1] or a confidence outside (0, 1)
+ApproximateSpec parse_approximate(const json& query_json);
+// Not paged unless query_json has "limit" or "after"; throws
+// std::runtime_error unless limit is a non-negative integer and after has
+// numeric y and x and an integer id
+PageSpec parse_page(const json& query_json);
+// Count of the whole population from sampled points found in a sample of
+// fraction, with a normal-approximation interval that treats each point as
+// sampled independently. A stratified sample varies less, so the interval
+// is conservative for it.
+SampledCount estimate_count(double sampled, double fraction, double confidence);
+Rectangle parse_rectangle(const json& region);
+
+// True if the "query" object is an aggregate rather than an operator tree
+bool is_aggregate(const json& query_obj);
+// Parses an aggregate and points operand at the tree it summarizes; throws
+// std::runtime_error for an unknown histogram key or a bad cell size
+AggregateSpec parse_aggregate(const json& query_obj, const json*& operand);
+
+// Rewrites a parsed plan into an equivalent, smaller one: nested operators
+// of the same kind are flattened, single-operand operators are replaced by
+// their operand, operands that can match nothing are dropped from ORs and
+// make an AND match nothing. Leaves are renumbered in document order.
+//
+// Negations are turned into differences, so no complement is ever built
+// on its own: a AND NOT b becomes a - b, a OR NOT b becomes NOT (b - a),
+// and a NOT left at the root becomes a crop of the whole valid region
+// minus its operand. The result has no Not nodes.
+std::unique_ptr<QueryNode> optimize_plan(std::unique_ptr<QueryNode> plan, const Rectangle& valid_region);
+
+// Intersection (And), union (Or) or difference of the operand id sets,
+// allocated from the memory of the first; the operands may be moved from
+IdSet combine_results(NodeType type, IdSets& operand_results);
+
+void collect_leaves(const QueryNode& node, std::vector<const QueryNode*>& leaves);
+
+// Bounding box of every point an optimized plan can select: a crop's region,
+// the intersection of an AND's operands, the union of an OR's and the first
+// operand's of a difference. Returns false if the plan selects nothing.
+bool plan_bounds(const QueryNode& node, Rectangle& bounds);
+
+// "crop", "and", "or" or "difference", as in profiles and EXPLAIN output
+const char* operator_name(NodeType type);
+
+#endif // QUERY_PLAN_H
@@ -0,0 +1,302 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "query_server.h"
+
+namespace {
+
+std::runtime_error system_error(const std::string& what) {
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+// Reads exactly size bytes; returns the number read before end of stream
+size_t read_fully(int fd, char* data, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = ::read(fd, data + done, size - done);
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw system_error("Socket read failed");
+        }
+        done += static_cast<size_t>(n);
+    }
+    return done;
+}
+
+void write_fully(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        // MSG_NOSIGNAL: a client hanging up must not kill the server
+        ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw system_error("Socket write failed");
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+sockaddr_un socket_address(const std::string& path) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("Socket path too long: " + path);
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return addr;
+}
+
+} // namespace
+
+bool read_frame(int fd, std::string& payload, size_t max_bytes) {
+    unsigned char header[4];
+    size_t got = read_fully(fd, reinterpret_cast<char*>(header), sizeof(header));
+    if (got == 0) {
+        return false;
+    }
+    if (got < sizeof(header)) {
+        throw std::runtime_error("Truncated frame header");
+    }
+
+    const size_t length = (static_cast<size_t>(header[0]) << 24) | (static_cast<size_t>(header[1]) << 16) |
+                          (static_cast<size_t>(header[2]) << 8) | static_cast<size_t>(header[3]);
+    if (length > max_bytes) {
+        throw std::runtime_error("Frame of " + std::to_string(length) + " bytes exceeds the limit");
+    }
+
+    payload.resize(length);
+    if (read_fully(fd, &payload[0], length) < length) {
+        throw std::runtime_error("Truncated frame payload");
+    }
+    return true;
+}
+
+void write_frame(int fd, const std::string& payload) {
+    if (payload.size() > UINT32_MAX) {
+        throw std::runtime_error("Frame too large");
+    }
+
+    const uint32_t length = static_cast<uint32_t>(payload.size());
+    const unsigned char header[4] = {
+        static_cast<unsigned char>(length >> 24), static_cast<unsigned char>(length >> 16),
+        static_cast<unsigned char>(length >> 8), static_cast<unsigned char>(length)
+    };
+    write_fully(fd, reinterpret_cast<const char*>(header), sizeof(header));
+    write_fully(fd, payload.data(), payload.size());
+}
+
+bool is_aggregate_response(const json& response) {
+    return response.is_object() && response.contains("aggregate") && !response.contains("points");
+}
+
+QueryServer::QueryServer(const ServerOptions& options, Handler handler)
+    : options_(options), handler_(std::move(handler)) {
+    if (options_.max_connections == 0) {
+        options_.max_connections = 1;
+    }
+    if (::pipe(stop_pipe_) != 0) {
+        throw system_error("Cannot create shutdown pipe");
+    }
+}
+
+QueryServer::~QueryServer() {
+    if (listen_fd_ >= 0) {
+        ::close(listen_fd_);
+        ::unlink(options_.socket_path.c_str());
+    }
+    ::close(stop_pipe_[0]);
+    ::close(stop_pipe_[1]);
+}
+
+void QueryServer::start() {
+    sockaddr_un addr = socket_address(options_.socket_path);
+
+    listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) {
+        throw system_error("Cannot create socket");
+    }
+    ::fcntl(listen_fd_, F_SETFD, FD_CLOEXEC);
+
+    // A socket file left behind by a crashed server would make bind fail
+    ::unlink(options_.socket_path.c_str());
+    if (::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        throw system_error("Cannot bind " + options_.socket_path);
+    }
+    if (::listen(listen_fd_, options_.listen_backlog) != 0) {
+        throw system_error("Cannot listen on " + options_.socket_path);
+    }
+}
+
+void QueryServer::stop() {
+    stopping_ = true;
+    // The pipe is never drained, so every poller sees it readable from now on
+    const char byte = 1;
+    ssize_t ignored = ::write(stop_pipe_[1], &byte, 1);
+    (void)ignored;
+}
+
+bool QueryServer::wait_readable(int fd) {
+    pollfd fds[2] = {{fd, POLLIN, 0}, {stop_pipe_[0], POLLIN, 0}};
+
+    while (true) {
+        int ready = ::poll(fds, 2, -1);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            throw system_error("poll failed");
+        }
+        if (fds[1].revents != 0) {
+            return false;
+        }
+        if (fds[0].revents != 0) {
+            return true;
+        }
+    }
+}
+
+void QueryServer::reap_finished_threads() {
+    std::vector<std::thread> done;
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        for (auto id : finished_threads_) {
+            for (auto it = connection_threads_.begin(); it != connection_threads_.end(); ++it) {
+                if (it->get_id() == id) {
+                    done.push_back(std::move(*it));
+                    connection_threads_.erase(it);
+                    break;
+                }
+            }
+        }
+        finished_threads_.clear();
+    }
+
+    for (auto& thread : done) {
+        thread.join();
+    }
+}
+
+void QueryServer::serve() {
+    if (listen_fd_ < 0) {
+        start();
+    }
+
+    while (!stopping_) {
+        // Backpressure: stop accepting while every connection slot is busy
+        {
+            std::unique_lock<std::mutex> lock(connections_mutex_);
+            connection_closed_.wait(lock, [this] {
+                return stopping_ || active_connections_ < options_.max_connections;
+            });
+        }
+
+        reap_finished_threads();
+
+        if (!wait_readable(listen_fd_)) {
+            break;
+        }
+
+        int client_fd = ::accept(listen_fd_, nullptr, nullptr);
+        if (client_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            throw system_error("accept failed");
+        }
+        ::fcntl(client_fd, F_SETFD, FD_CLOEXEC);
+
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        ++active_connections_;
+        connection_threads_.emplace_back(&QueryServer::handle_connection, this, client_fd);
+    }
+
+    // Graceful shutdown: connection threads finish their current request
+    // and exit once they notice the stop pipe.
+    std::list<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        threads.swap(connection_threads_);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    ::close(listen_fd_);
+    listen_fd_ = -1;
+    ::unlink(options_.socket_path.c_str());
+}
+
+std::string QueryServer::handle_request(const std::string& payload) {
+    json response;
+    json request;
+
+    try {
+        request = json::parse(payload);
+
+        if (request.is_object() && request.value("command", "") == "ping") {
+            response = {{"ok", true}};
+        } else {
+            response = handler_(request);
+        }
+    } catch (const std::exception& e) {
+        response = {{"error", e.what()}};
+    }
+
+    if (request.is_object() && request.contains("id")) {
+        response["id"] = request["id"];
+    }
+    return response.dump();
+}
+
+void QueryServer::handle_connection(int client_fd) {
+    try {
+        std::string payload;
+        while (wait_readable(client_fd) && read_frame(client_fd, payload, options_.max_frame_bytes)) {
+            write_frame(client_fd, handle_request(payload));
+        }
+    } catch (const std::exception&) {
+        // Broken or misbehaving client: drop the connection
+    }
+
+    ::close(client_fd);
+
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    --active_connections_;
+    finished_threads_.push_back(std::this_thread::get_id());
+    connection_closed_.notify_all();
+}
+
+QueryClient::QueryClient(const std::string& socket_path) {
+    sockaddr_un addr = socket_address(socket_path);
+
+    fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd_ < 0) {
+        throw system_error("Cannot create socket");
+    }
+    if (::connect(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        ::close(fd_);
+        throw system_error("Cannot connect to " + socket_path);
+    }
+}
+
+QueryClient::~QueryClient() {
+    ::close(fd_);
+}
+
+json QueryClient::request(const json& message) {
+    write_frame(fd_, message.dump());
+
+    std::string payload;
+    if (!read_frame(fd_, payload)) {
+        throw std::runtime_error("Server closed the connection");
+    }
+    return json::parse(payload);
+}
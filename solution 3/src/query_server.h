@@ -0,0 +1,95 @@
+#ifndef QUERY_SERVER_H
+#define QUERY_SERVER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+// Wire format shared by QueryServer and QueryClient: every message is a
+// 4-byte big-endian payload length followed by that many bytes of JSON.
+constexpr size_t kDefaultMaxFrameBytes = 64 * 1024 * 1024;
+
+// Returns false on a clean end of stream before the length prefix; throws
+// std::runtime_error on I/O errors, truncated frames or oversized payloads.
+bool read_frame(int fd, std::string& payload, size_t max_bytes = kDefaultMaxFrameBytes);
+void write_frame(int fd, const std::string& payload);
+
+// Whether a query answer is an aggregate summary ({"aggregate": "count" |
+// "histogram", ...}) rather than {"count", "points": [[x, y], ...]}
+bool is_aggregate_response(const json& response);
+
+struct ServerOptions {
+    std::string socket_path = "/tmp/query_engine.sock";
+    // Connections served at once; further clients wait in the listen backlog
+    size_t max_connections = 16;
+    int listen_backlog = 64;
+    size_t max_frame_bytes = kDefaultMaxFrameBytes;
+};
+
+// Serves framed JSON requests on a Unix domain socket. Each connection is
+// handled on its own thread and may send any number of requests; requests
+// on one connection are answered in order. {"command": "ping"} is answered
+// by the server itself, everything else goes to the handler, whose
+// exceptions are returned as {"error": "..."}. A request "id" is echoed.
+class QueryServer {
+public:
+    using Handler = std::function<json(const json& request)>;
+
+    QueryServer(const ServerOptions& options, Handler handler);
+    ~QueryServer();
+
+    QueryServer(const QueryServer&) = delete;
+    QueryServer& operator=(const QueryServer&) = delete;
+
+    // Binds and listens; replaces a stale socket file at socket_path
+    void start();
+    // Accepts connections until stop(); then lets in-flight requests finish,
+    // closes every connection and removes the socket file.
+    void serve();
+    // Thread- and async-signal-safe
+    void stop();
+
+private:
+    ServerOptions options_;
+    Handler handler_;
+    int listen_fd_ = -1;
+    int stop_pipe_[2] = {-1, -1};
+    std::atomic<bool> stopping_{false};
+
+    std::mutex connections_mutex_;
+    std::condition_variable connection_closed_;
+    size_t active_connections_ = 0;
+    std::list<std::thread> connection_threads_;
+    std::vector<std::thread::id> finished_threads_;
+
+    void handle_connection(int client_fd);
+    std::string handle_request(const std::string& payload);
+    bool wait_readable(int fd);
+    void reap_finished_threads();
+};
+
+// Synchronous client for a QueryServer; keeps one connection open
+class QueryClient {
+public:
+    explicit QueryClient(const std::string& socket_path);
+    ~QueryClient();
+
+    QueryClient(const QueryClient&) = delete;
+    QueryClient& operator=(const QueryClient&) = delete;
+
+    json request(const json& message);
+
+private:
+    int fd_ = -1;
+};
+
+#endif // QUERY_SERVER_H
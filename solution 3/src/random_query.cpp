@@ -0,0 +1,297 @@
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+#include "random_query.h"
+
+namespace {
+
+double uniform(std::mt19937_64& rng) {
+    return static_cast<double>(rng() >> 11) * 0x1.0p-53;
+}
+
+uint64_t below(std::mt19937_64& rng, uint64_t n) {
+    return n == 0 ? 0 : rng() % n;
+}
+
+double coordinate(std::mt19937_64& rng, double lo, double hi) {
+    // Slightly beyond the extent on both sides; whole numbers half the time
+    // so region edges coincide with gridded points
+    const double margin = (hi - lo) * 0.05;
+    const double v = lo - margin + uniform(rng) * (hi - lo + 2.0 * margin);
+    return (rng() & 1) ? std::round(v) : v;
+}
+
+json random_region(std::mt19937_64& rng, const Rectangle& extent) {
+    double x0 = coordinate(rng, extent.x_min, extent.x_max);
+    double x1 = coordinate(rng, extent.x_min, extent.x_max);
+    double y0 = coordinate(rng, extent.y_min, extent.y_max);
+    double y1 = coordinate(rng, extent.y_min, extent.y_max);
+
+    // Mostly proper rectangles; occasionally degenerate or inverted ones
+    const uint64_t shape = below(rng, 20);
+    if (shape != 0) {
+        if (x0 > x1) std::swap(x0, x1);
+        if (y0 > y1) std::swap(y0, y1);
+    }
+    if (shape == 1) {
+        x1 = x0;
+    }
+    return {{"p_min", {{"x", x0}, {"y", y0}}}, {"p_max", {{"x", x1}, {"y", y1}}}};
+}
+
+json random_point(std::mt19937_64& rng, const Rectangle& extent) {
+    return {{"x", coordinate(rng, extent.x_min, extent.x_max)}, {"y", coordinate(rng, extent.y_min, extent.y_max)}};
+}
+
+// The geometry of a crop: a region, or a polygon or circle with its operator
+// name
+std::pair<const char*, json> random_crop_shape(std::mt19937_64& rng, const RandomQueryOptions& options) {
+    const uint64_t kind = options.shapes ? below(rng, 6) : 2;
+    if (kind == 0) {
+        json points = json::array();
+        const uint64_t count = 3 + below(rng, 4);
+        for (uint64_t i = 0; i < count; ++i) {
+            points.push_back(random_point(rng, options.extent));
+        }
+        return {"operator_crop_polygon", {{"points", points}}};
+    }
+    if (kind == 1) {
+        const double width = options.extent.x_max - options.extent.x_min;
+        // At least 0.5, so the rounded radius stays positive as parse_query
+        // requires
+        const double radius = std::max(uniform(rng) * width / 3.0, 0.5);
+        return {"operator_crop_circle", {{"center", random_point(rng, options.extent)},
+                                         {"radius", (rng() & 1) ? std::round(radius) : radius}}};
+    }
+    return {"operator_crop", {{"region", random_region(rng, options.extent)}}};
+}
+
+json random_operator(std::mt19937_64& rng, const RandomQueryOptions& options, int depth) {
+    if (depth >= options.max_depth || below(rng, 10) < 4) {
+        auto [name, crop] = random_crop_shape(rng, options);
+        if (below(rng, 4) == 0) {
+            crop["category"] = static_cast<int>(below(rng, static_cast<uint64_t>(options.categories)));
+        }
+        if (below(rng, 5) == 0) {
+            json groups = json::array();
+            const uint64_t count = below(rng, 6);
+            for (uint64_t i = 0; i < count; ++i) {
+                groups.push_back(static_cast<int>(below(rng, static_cast<uint64_t>(options.groups))));
+            }
+            crop["one_of_groups"] = groups;
+        }
+        if (below(rng, 3) == 0) {
+            crop["proper"] = true;
+        }
+        return {{name, crop}};
+    }
+
+    const uint64_t kind = options.negations ? below(rng, 6) : 2 + (rng() & 1);
+    if (kind == 0) {
+        return {{"operator_not", random_operator(rng, options, depth + 1)}};
+    }
+
+    json operands = json::array();
+    const uint64_t count = 1 + below(rng, static_cast<uint64_t>(std::max(options.max_operands, 1)));
+    for (uint64_t i = 0; i < count; ++i) {
+        operands.push_back(random_operator(rng, options, depth + 1));
+    }
+    const char* name = (kind == 1) ? "operator_difference" : (kind & 1) ? "operator_and" : "operator_or";
+    return {{name, operands}};
+}
+
+struct Region {
+    double x_min, y_min, x_max, y_max;
+
+    Region(double x0, double y0, double x1, double y1) : x_min(x0), y_min(y0), x_max(x1), y_max(y1) {}
+
+    explicit Region(const json& region)
+        : x_min(region["p_min"]["x"].get<double>()), y_min(region["p_min"]["y"].get<double>()),
+          x_max(region["p_max"]["x"].get<double>()), y_max(region["p_max"]["y"].get<double>()) {}
+
+    bool contains(const Point& p) const {
+        return p.x >= x_min && p.x <= x_max && p.y >= y_min && p.y <= y_max;
+    }
+};
+
+// A crop's geometry: its region, plus the polygon or circle test. Written
+// independently of CropShape, with the same arithmetic so boundary points
+// agree.
+struct CropGeometry {
+    Region bounds;
+    int kind = 0;   // 0 rectangle, 1 polygon, 2 circle
+    std::vector<double> xs, ys;
+    double cx = 0.0, cy = 0.0, r = 0.0;
+
+    static CropGeometry from(const json& node, const json*& crop) {
+        if (node.contains("operator_crop_polygon")) {
+            crop = &node["operator_crop_polygon"];
+            CropGeometry g(Region(0, 0, -1, -1));
+            g.kind = 1;
+            for (const auto& v : (*crop)["points"]) {
+                g.xs.push_back(v["x"].get<double>());
+                g.ys.push_back(v["y"].get<double>());
+            }
+            if (!g.xs.empty()) {
+                g.bounds = Region(*std::min_element(g.xs.begin(), g.xs.end()), *std::min_element(g.ys.begin(), g.ys.end()),
+                                  *std::max_element(g.xs.begin(), g.xs.end()), *std::max_element(g.ys.begin(), g.ys.end()));
+            }
+            return g;
+        }
+        if (node.contains("operator_crop_circle")) {
+            crop = &node["operator_crop_circle"];
+            const double cx = (*crop)["center"]["x"].get<double>();
+            const double cy = (*crop)["center"]["y"].get<double>();
+            const double r = (*crop)["radius"].get<double>();
+            CropGeometry g(Region(cx - r, cy - r, cx + r, cy + r));
+            g.kind = 2;
+            g.cx = cx;
+            g.cy = cy;
+            g.r = r;
+            return g;
+        }
+        crop = &node["operator_crop"];
+        return CropGeometry(Region((*crop)["region"]));
+    }
+
+    explicit CropGeometry(const Region& region) : bounds(region) {}
+
+    bool contains(const Point& p) const {
+        if (!bounds.contains(p)) {
+            return false;
+        }
+        if (kind == 2) {
+            const double dx = p.x - cx;
+            const double dy = p.y - cy;
+            return dx * dx + dy * dy <= r * r;
+        }
+        if (kind == 1) {
+            // Even-odd rule: count edges crossed by a ray towards +x
+            bool inside = false;
+            for (size_t i = 0, j = xs.size() - 1; i < xs.size(); j = i++) {
+                if (ys[i] == ys[j]) continue;
+                if ((p.y < ys[i]) != (p.y < ys[j]) &&
+                    p.x < (xs[j] - xs[i]) * (p.y - ys[i]) / (ys[j] - ys[i]) + xs[i]) {
+                    inside = !inside;
+                }
+            }
+            return inside;
+        }
+        return true;
+    }
+};
+
+class Reference {
+public:
+    Reference(const std::vector<Point>& points, const json& valid_region)
+        : points_(points), valid_(valid_region) {
+        for (size_t i = 0; i < points_.size(); ++i) {
+            groups_[points_[i].group_id].push_back(i);
+        }
+    }
+
+    std::set<long long> evaluate(const json& node) const {
+        std::set<long long> result;
+
+        if (node.contains("operator_crop") || node.contains("operator_crop_polygon") ||
+            node.contains("operator_crop_circle")) {
+            const json* crop = nullptr;
+            const CropGeometry geometry = CropGeometry::from(node, crop);
+            for (const Point& p : points_) {
+                if (selected_by_crop(p, *crop, geometry)) {
+                    result.insert(p.id);
+                }
+            }
+            return result;
+        }
+
+        if (node.contains("operator_not")) {
+            // Every point of the valid region the operand does not select
+            const std::set<long long> excluded = evaluate(node["operator_not"]);
+            for (const Point& p : points_) {
+                if (valid_.contains(p) && !excluded.count(p.id)) {
+                    result.insert(p.id);
+                }
+            }
+            return result;
+        }
+        if (node.contains("operator_difference")) {
+            const json& operands = node["operator_difference"];
+            for (size_t i = 0; i < operands.size(); ++i) {
+                const std::set<long long> operand_ids = evaluate(operands[i]);
+                if (i == 0) {
+                    result = operand_ids;
+                } else {
+                    for (long long id : operand_ids) result.erase(id);
+                }
+            }
+            return result;
+        }
+
+        const bool is_and = node.contains("operator_and");
+        if (!is_and && !node.contains("operator_or")) {
+            return result;
+        }
+        bool first = true;
+        for (const auto& operand : node[is_and ? "operator_and" : "operator_or"]) {
+            std::set<long long> operand_ids = evaluate(operand);
+            if (!is_and) {
+                result.insert(operand_ids.begin(), operand_ids.end());
+            } else if (first) {
+                result = std::move(operand_ids);
+            } else {
+                std::set<long long> kept;
+                for (long long id : result) {
+                    if (operand_ids.count(id)) kept.insert(id);
+                }
+                result = std::move(kept);
+            }
+            first = false;
+        }
+        return result;
+    }
+
+private:
+    const std::vector<Point>& points_;
+    Region valid_;
+    std::map<int, std::vector<size_t>> groups_;
+
+    bool selected_by_crop(const Point& p, const json& crop, const CropGeometry& region) const {
+        if (!region.contains(p) || !valid_.contains(p)) {
+            return false;
+        }
+        if (crop.contains("category") && p.category != crop["category"].get<int>()) {
+            return false;
+        }
+        if (crop.contains("one_of_groups")) {
+            const json& groups = crop["one_of_groups"];
+            if (std::find(groups.begin(), groups.end(), json(p.group_id)) == groups.end()) {
+                return false;
+            }
+        }
+        if (crop.value("proper", false)) {
+            // Every point of the group must lie in the crop and the valid region
+            for (size_t member : groups_.at(p.group_id)) {
+                if (!region.contains(points_[member]) || !valid_.contains(points_[member])) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace
+
+json random_query(std::mt19937_64& rng, const RandomQueryOptions& options) {
+    return {
+        {"valid_region", random_region(rng, options.extent)},
+        {"query", random_operator(rng, options, 0)}
+    };
+}
+
+std::set<long long> reference_evaluate(const std::vector<Point>& points, const json& query_json) {
+    Reference reference(points, query_json["valid_region"]);
+    return reference.evaluate(query_json["query"]);
+}
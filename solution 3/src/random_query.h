@@ -0,0 +1,41 @@
+#ifndef RANDOM_QUERY_H
+#define RANDOM_QUERY_H
+
+#include <cstdint>
+#include <random>
+#include <set>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "query_engine.h"
+
+using json = nlohmann::json;
+
+// Randomized queries and a brute-force evaluator for them, used to check
+// the execution strategies against each other and against ground truth.
+
+struct RandomQueryOptions {
+    Rectangle extent{0.0, 0.0, 100.0, 100.0};  // regions are drawn around this area
+    int max_depth = 3;
+    int max_operands = 3;
+    int categories = 4;   // category filters drawn from [0, categories)
+    int groups = 100;     // one_of_groups drawn from [0, groups)
+    bool shapes = true;   // also draw polygon and circle crops
+    bool negations = true; // also draw operator_not and operator_difference
+};
+
+// A query document over the operator_and / operator_or / operator_crop
+// (/ operator_crop_polygon / operator_crop_circle / operator_not /
+// operator_difference) grammar with random
+// category, one_of_groups and proper filters. Polygons may intersect
+// themselves. Regions
+// are sometimes snapped to whole numbers, empty, or outside the extent, to
+// exercise boundary handling. Only rng() is used, so the sequence does not
+// depend on the standard library implementation.
+json random_query(std::mt19937_64& rng, const RandomQueryOptions& options);
+
+// Ids of the points the query selects, computed directly from its JSON
+// without the engine's parser, planner or SQL
+std::set<long long> reference_evaluate(const std::vector<Point>& points, const json& query_json);
+
+#endif // RANDOM_QUERY_H
@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <utility>
+
+#include "statistics_catalog.h"
+
+namespace {
+
+// Fraction of [lo, hi] that [a, b] covers; a single value is in or out
+double overlap(double lo, double hi, double a, double b) {
+    const double from = std::max(lo, a);
+    const double to = std::min(hi, b);
+    if (to < from) {
+        return 0.0;
+    }
+    return hi > lo ? (to - from) / (hi - lo) : 1.0;
+}
+
+// Chance that an extent of size fits in a window of size window when placed
+// uniformly at random so that it overlaps it
+double fit(double size, double window) {
+    if (size <= 0.0) {
+        return 1.0;
+    }
+    return window > 0.0 ? std::max(0.0, 1.0 - size / window) : 0.0;
+}
+
+} // namespace
+
+StatisticsCatalog::StatisticsCatalog(std::vector<Cell> cells, std::map<int, double> category_points,
+                                     std::vector<GroupSize> group_sizes)
+    : cells_(std::move(cells)), category_points_(std::move(category_points)), group_sizes_(std::move(group_sizes)) {
+    for (const Cell& cell : cells_) {
+        rows_ += cell.points;
+    }
+    for (const GroupSize& size : group_sizes_) {
+        groups_ += size.groups;
+    }
+}
+
+StatisticsCatalog StatisticsCatalog::load(pqxx::work& txn) {
+    if (!txn.exec("SELECT to_regclass('statistics_cell') IS NOT NULL")[0][0].as<bool>()) {
+        return StatisticsCatalog();
+    }
+
+    std::vector<Cell> cells;
+    for (const auto& row : txn.exec("SELECT x_min, y_min, x_max, y_max, points FROM statistics_cell")) {
+        cells.push_back({{row[0].as<double>(), row[1].as<double>(), row[2].as<double>(), row[3].as<double>()},
+                         row[4].as<double>()});
+    }
+    std::map<int, double> category_points;
+    for (const auto& row : txn.exec("SELECT category, points FROM statistics_category")) {
+        category_points[row[0].as<int>()] = row[1].as<double>();
+    }
+    std::vector<GroupSize> group_sizes;
+    for (const auto& row : txn.exec("SELECT size, group_count, mean_width, mean_height FROM statistics_group")) {
+        group_sizes.push_back({row[0].as<int>(), row[1].as<double>(), row[2].as<double>(), row[3].as<double>()});
+    }
+    return StatisticsCatalog(std::move(cells), std::move(category_points), std::move(group_sizes));
+}
+
+double StatisticsCatalog::crop_rows(const CropSpec& crop, const Rectangle& valid_region) const {
+    return total(crop_selectivity(crop, valid_region));
+}
+
+double StatisticsCatalog::result_rows(const QueryNode& plan, const Rectangle& valid_region) const {
+    return total(selectivity(plan, valid_region));
+}
+
+TableStatistics StatisticsCatalog::table_statistics() const {
+    TableStatistics stats;
+    if (cells_.empty()) {
+        return stats;
+    }
+    stats.valid = true;
+    stats.rows = rows_;
+    stats.extent = cells_.front().bounds;
+    for (const Cell& cell : cells_) {
+        stats.extent.x_min = std::min(stats.extent.x_min, cell.bounds.x_min);
+        stats.extent.y_min = std::min(stats.extent.y_min, cell.bounds.y_min);
+        stats.extent.x_max = std::max(stats.extent.x_max, cell.bounds.x_max);
+        stats.extent.y_max = std::max(stats.extent.y_max, cell.bounds.y_max);
+    }
+    stats.categories = std::max(static_cast<double>(category_points_.size()), 1.0);
+    stats.groups = std::max(groups_, 1.0);
+    return stats;
+}
+
+std::vector<double> StatisticsCatalog::selectivity(const QueryNode& node, const Rectangle& valid_region) const {
+    if (node.type == NodeType::Crop) {
+        return crop_selectivity(node.crop, valid_region);
+    }
+    std::vector<double> result(cells_.size(), 0.0);
+    if (node.children.empty()) {
+        return result;
+    }
+
+    if (node.type == NodeType::Not) {
+        CropSpec everything;
+        everything.region = valid_region;
+        result = crop_selectivity(everything, valid_region);
+    } else if (node.type == NodeType::And) {
+        std::fill(result.begin(), result.end(), 1.0);
+    }
+    for (size_t i = 0; i < node.children.size(); ++i) {
+        const std::vector<double> child = selectivity(*node.children[i], valid_region);
+        for (size_t c = 0; c < result.size(); ++c) {
+            switch (node.type) {
+            case NodeType::And:
+                result[c] *= child[c];
+                break;
+            case NodeType::Or:
+                result[c] += child[c] - result[c] * child[c];
+                break;
+            case NodeType::Difference:
+                result[c] = (i == 0) ? child[c] : result[c] * (1.0 - child[c]);
+                break;
+            case NodeType::Not:
+                result[c] *= 1.0 - child[c];
+                break;
+            case NodeType::Crop:
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+std::vector<double> StatisticsCatalog::crop_selectivity(const CropSpec& crop, const Rectangle& valid_region) const {
+    std::vector<double> result(cells_.size(), 0.0);
+    const Rectangle region{std::max(crop.region.x_min, valid_region.x_min), std::max(crop.region.y_min, valid_region.y_min),
+                           std::min(crop.region.x_max, valid_region.x_max), std::min(crop.region.y_max, valid_region.y_max)};
+    if (region.x_max < region.x_min || region.y_max < region.y_min || rows_ <= 0.0) {
+        return result;
+    }
+
+    // Filters are assumed independent of the location
+    double filtered = crop.shape.coverage();
+    if (crop.has_category) {
+        auto it = category_points_.find(crop.category);
+        filtered *= (it == category_points_.end()) ? 0.0 : it->second / rows_;
+    }
+    if (crop.has_groups) {
+        filtered *= std::min(1.0, static_cast<double>(crop.groups.size()) / std::max(groups_, 1.0));
+    }
+    if (crop.proper) {
+        filtered *= proper_fraction(region.x_max - region.x_min, region.y_max - region.y_min);
+    }
+
+    for (size_t c = 0; c < cells_.size(); ++c) {
+        const Rectangle& b = cells_[c].bounds;
+        result[c] = overlap(b.x_min, b.x_max, region.x_min, region.x_max) *
+                    overlap(b.y_min, b.y_max, region.y_min, region.y_max) * filtered;
+    }
+    return result;
+}
+
+double StatisticsCatalog::proper_fraction(double width, double height) const {
+    double points = 0.0, fitting = 0.0;
+    for (const GroupSize& size : group_sizes_) {
+        const double members = size.size * size.groups;
+        points += members;
+        fitting += members * fit(size.mean_width, width) * fit(size.mean_height, height);
+    }
+    return points > 0.0 ? fitting / points : 1.0;
+}
+
+double StatisticsCatalog::total(const std::vector<double>& selectivity) const {
+    double rows = 0.0;
+    for (size_t c = 0; c < cells_.size(); ++c) {
+        rows += cells_[c].points * selectivity[c];
+    }
+    return rows;
+}
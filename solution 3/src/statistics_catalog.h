@@ -0,0 +1,64 @@
+#ifndef STATISTICS_CATALOG_H
+#define STATISTICS_CATALOG_H
+
+#include <map>
+#include <vector>
+#include <pqxx/pqxx>
+
+#include "query_plan.h"
+
+// The statistics data_loader stores with a dataset: an equi-depth grid of
+// point counts (statistics_cell), the points per category
+// (statistics_category) and the number and mean extent of groups per size
+// (statistics_group). Estimates are computed from these alone, so they cost
+// microseconds and never touch inspection_region.
+class StatisticsCatalog {
+public:
+    struct Cell {
+        Rectangle bounds;   // bounding box of the cell's points
+        double points;
+    };
+
+    struct GroupSize {
+        int size;
+        double groups;
+        double mean_width, mean_height;
+    };
+
+    StatisticsCatalog() = default;
+    StatisticsCatalog(std::vector<Cell> cells, std::map<int, double> category_points, std::vector<GroupSize> group_sizes);
+
+    // The catalog of the current dataset; empty if it was loaded without one
+    static StatisticsCatalog load(pqxx::work& txn);
+
+    bool empty() const { return cells_.empty(); }
+    double rows() const { return rows_; }
+
+    // Points a crop selects within the valid region
+    double crop_rows(const CropSpec& crop, const Rectangle& valid_region) const;
+    // Points an optimized plan selects. Operands are combined cell by cell,
+    // assuming they are independent within a cell, so crops that overlap
+    // or are far apart are estimated from where their points actually are.
+    double result_rows(const QueryNode& plan, const Rectangle& valid_region) const;
+
+    // The summary the cost model works from, equivalent to analyzed
+    // planner statistics
+    TableStatistics table_statistics() const;
+
+private:
+    std::vector<Cell> cells_;
+    std::map<int, double> category_points_;
+    std::vector<GroupSize> group_sizes_;
+    double rows_ = 0.0;
+    double groups_ = 0.0;
+
+    // Fraction of each cell's points that node selects
+    std::vector<double> selectivity(const QueryNode& node, const Rectangle& valid_region) const;
+    std::vector<double> crop_selectivity(const CropSpec& crop, const Rectangle& valid_region) const;
+    // Share of the points in a region of width x height whose whole group
+    // fits inside it, placing each group uniformly at random
+    double proper_fraction(double width, double height) const;
+    double total(const std::vector<double>& selectivity) const;
+};
+
+#endif // STATISTICS_CATALOG_H
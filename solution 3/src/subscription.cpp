@@ -0,0 +1,295 @@
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+#include "subscription.h"
+#include "query_plan.h"
+
+namespace {
+
+// "ANY('{1,2,3}'::bigint[])", to compare an id column against
+std::string any_id(const std::set<long long>& ids) {
+    std::ostringstream array;
+    array << "ANY('{";
+    bool first = true;
+    for (long long id : ids) {
+        if (!first) array << ",";
+        array << id;
+        first = false;
+    }
+    array << "}'::bigint[])";
+    return array.str();
+}
+
+} // namespace
+
+// One row image from region_change: 'I' for a row as inserted or updated,
+// 'D' for a row as it was before an update or delete, 'R' for a reload
+struct QuerySubscription::Change {
+    char op = 'R';
+    long long id = 0;
+    bool has_group = false;
+    long long group_id = 0;
+    bool has_point = false;
+    double x = 0.0, y = 0.0;
+};
+
+// Flags that the change log has grown; the log itself is read on refresh
+class QuerySubscription::Listener : public pqxx::notification_receiver {
+public:
+    Listener(pqxx::connection& conn, bool& notified)
+        : pqxx::notification_receiver(conn, "region_changes"), notified_(notified) {}
+
+    void operator()(const std::string&, int) override { notified_ = true; }
+
+private:
+    bool& notified_;
+};
+
+QuerySubscription::QuerySubscription(QueryEngine& engine, const json& query_json)
+    : engine_(engine), conn_(engine.connections_->connection_string()) {
+    ctx_.valid_region = parse_rectangle(query_json["valid_region"]);
+    if (is_aggregate(query_json["query"])) {
+        throw std::runtime_error("operator_count and operator_histogram cannot be subscribed to");
+    }
+    if (query_json.contains("limit") || query_json.contains("after")) {
+        throw std::runtime_error("paged queries cannot be subscribed to");
+    }
+    if (parse_approximate(query_json).enabled) {
+        throw std::runtime_error("approximate queries cannot be subscribed to");
+    }
+    plan_ = optimize_plan(parse_query(query_json["query"]), ctx_.valid_region);
+    collect_leaves(*plan_, leaves_);
+    ctx_.leaf_count = leaves_.size();
+    ctx_.strategy = ExecutionStrategy::Pipelined;
+
+    {
+        pqxx::work txn(conn_);
+        const bool logged = txn.exec("SELECT to_regclass('region_change') IS NOT NULL")[0][0].as<bool>();
+        txn.commit();
+        if (!logged) {
+            throw std::runtime_error("inspection_region has no change log; create the schema with data_loader");
+        }
+    }
+
+    // Listening starts before the first refresh reads the log, so no change
+    // falls between the two
+    listener_ = std::make_unique<Listener>(conn_, notified_);
+}
+
+QuerySubscription::~QuerySubscription() = default;
+
+ResultDelta QuerySubscription::refresh() {
+    conn_.get_notifs();
+    notified_ = false;
+
+    // The log and the rows are read from one snapshot, so the rows are
+    // exactly as the changes up to max_seq left them
+    pqxx::work txn(conn_);
+    txn.exec("SET TRANSACTION ISOLATION LEVEL REPEATABLE READ");
+    const long long max_seq = txn.exec("SELECT COALESCE(MAX(seq), 0) FROM region_change")[0][0].as<long long>();
+
+    ResultDelta delta;
+    if (last_seq_ < 0 || max_seq < last_seq_) {
+        // First refresh, or the log was recreated
+        delta = reload(txn, max_seq);
+    } else if (max_seq > last_seq_) {
+        const Quantization& quantization = engine_.quantization_;
+        std::vector<Change> changes;
+        bool replaced = false;
+        pqxx::result rows = txn.exec(
+            "SELECT op, id, group_id, coord_x, coord_y, qx, qy FROM region_change "
+            "WHERE seq > " + std::to_string(last_seq_) + " AND seq <= " + std::to_string(max_seq) + " ORDER BY seq");
+        for (const auto& row : rows) {
+            Change change;
+            change.op = row[0].as<std::string>()[0];
+            if (change.op == 'R') {
+                replaced = true;
+                break;
+            }
+            change.id = row[1].as<long long>();
+            if (!row[2].is_null()) {
+                change.has_group = true;
+                change.group_id = row[2].as<long long>();
+            }
+            if (quantization.enabled && !row[5].is_null() && !row[6].is_null()) {
+                change.has_point = true;
+                change.x = quantization.dequantize_x(row[5].as<int32_t>());
+                change.y = quantization.dequantize_y(row[6].as<int32_t>());
+            } else if (!quantization.enabled && !row[3].is_null() && !row[4].is_null()) {
+                change.has_point = true;
+                change.x = row[3].as<double>();
+                change.y = row[4].as<double>();
+            }
+            changes.push_back(change);
+        }
+        delta = replaced ? reload(txn, max_seq) : apply(txn, changes);
+        last_seq_ = max_seq;
+    }
+
+    txn.commit();
+    return delta;
+}
+
+ResultDelta QuerySubscription::wait(std::chrono::milliseconds timeout) {
+    if (!notified_) {
+        const long long ms = std::max<long long>(timeout.count(), 0);
+        conn_.await_notification(ms / 1000, (ms % 1000) * 1000);
+    }
+    if (!notified_ && last_seq_ >= 0) {
+        return ResultDelta();
+    }
+    return refresh();
+}
+
+ResultDelta QuerySubscription::reload(pqxx::work& txn, long long max_seq) {
+    // Every crop in one batch, as the Pipelined strategy sends them
+    leaf_ids_.assign(leaves_.size(), IdSet());
+    std::map<pqxx::pipeline::query_id, size_t> pending;
+    pqxx::pipeline pipe(txn);
+    for (const QueryNode* leaf : leaves_) {
+        pending[pipe.insert(engine_.crop_sql(ctx_, leaf->crop, leaf->crop.region))] = leaf->leaf_index;
+    }
+    pipe.complete();
+    while (!pipe.empty()) {
+        auto answer = pipe.retrieve();
+        leaf_ids_[pending.at(answer.first)] = engine_.read_ids(answer.second, std::pmr::get_default_resource());
+    }
+
+    result_.clear();
+    for (const auto& ids : leaf_ids_) {
+        for (long long id : ids) {
+            if (matches(*plan_, id)) {
+                result_.insert(id);
+            }
+        }
+    }
+    last_seq_ = max_seq;
+
+    ResultDelta delta;
+    delta.reloaded = true;
+    delta.added = fetch_points(txn, result_);
+    return delta;
+}
+
+ResultDelta QuerySubscription::apply(pqxx::work& txn, const std::vector<Change>& changes) {
+    // Per crop, the changed rows that may have entered or left it and the
+    // groups whose proper check may have flipped
+    std::set<long long> changed;
+    std::vector<std::set<long long>> recheck_ids(leaves_.size());
+    std::vector<std::set<long long>> recheck_groups(leaves_.size());
+    for (const Change& change : changes) {
+        changed.insert(change.id);
+        for (const QueryNode* leaf : leaves_) {
+            if (affects(*leaf, change)) {
+                recheck_ids[leaf->leaf_index].insert(change.id);
+                if (leaf->crop.proper && change.has_group) {
+                    recheck_groups[leaf->leaf_index].insert(change.group_id);
+                }
+            }
+        }
+    }
+
+    // Re-run each affected crop over its candidates only. A candidate that
+    // is not returned was deleted.
+    std::set<long long> touched = changed;
+    std::map<pqxx::pipeline::query_id, size_t> pending;
+    pqxx::pipeline pipe(txn);
+    for (const QueryNode* leaf : leaves_) {
+        const size_t index = leaf->leaf_index;
+        if (recheck_ids[index].empty()) {
+            continue;
+        }
+        std::string sql = "SELECT r.id, COALESCE((" + engine_.crop_condition(ctx_, leaf->crop, leaf->crop.region) +
+                          "), FALSE) FROM inspection_region r WHERE r.id = " + any_id(recheck_ids[index]);
+        if (!recheck_groups[index].empty()) {
+            sql += " OR r.group_id = " + any_id(recheck_groups[index]);
+        }
+        pending[pipe.insert(sql)] = index;
+    }
+    pipe.complete();
+    while (!pipe.empty()) {
+        auto answer = pipe.retrieve();
+        const size_t index = pending.at(answer.first);
+        IdSet& ids = leaf_ids_[index];
+        for (long long id : recheck_ids[index]) {
+            ids.erase(id);
+        }
+        for (const auto& row : answer.second) {
+            const long long id = row[0].as<long long>();
+            touched.insert(id);
+            if (row[1].as<bool>()) {
+                ids.insert(id);
+            } else {
+                ids.erase(id);
+            }
+        }
+    }
+
+    // Only the touched rows can have changed their place in the result
+    ResultDelta delta;
+    std::set<long long> added;
+    for (long long id : touched) {
+        const bool was = result_.count(id) > 0;
+        const bool is = matches(*plan_, id);
+        if (is && (!was || changed.count(id))) {
+            added.insert(id);
+            result_.insert(id);
+        } else if (!is && was) {
+            delta.removed.push_back(id);
+            result_.erase(id);
+        }
+    }
+    delta.added = fetch_points(txn, added);
+    return delta;
+}
+
+bool QuerySubscription::affects(const QueryNode& leaf, const Change& change) const {
+    // Any member of a group can make the others fail a proper crop
+    if (leaf.crop.proper && change.has_group) {
+        return true;
+    }
+    return change.has_point && leaf.crop.region.contains(change.x, change.y) &&
+           ctx_.valid_region.contains(change.x, change.y);
+}
+
+bool QuerySubscription::matches(const QueryNode& node, long long id) const {
+    switch (node.type) {
+    case NodeType::Crop:
+        return leaf_ids_[node.leaf_index].count(id) > 0;
+    case NodeType::And:
+        return !node.children.empty() &&
+               std::all_of(node.children.begin(), node.children.end(),
+                           [&](const std::unique_ptr<QueryNode>& child) { return matches(*child, id); });
+    case NodeType::Or:
+        return std::any_of(node.children.begin(), node.children.end(),
+                           [&](const std::unique_ptr<QueryNode>& child) { return matches(*child, id); });
+    case NodeType::Difference:
+        return !node.children.empty() && matches(*node.children.front(), id) &&
+               std::none_of(node.children.begin() + 1, node.children.end(),
+                            [&](const std::unique_ptr<QueryNode>& child) { return matches(*child, id); });
+    case NodeType::Not:
+        // Removed by optimize_plan
+        break;
+    }
+    return false;
+}
+
+std::vector<Point> QuerySubscription::fetch_points(pqxx::work& txn, const std::set<long long>& ids) const {
+    std::vector<Point> points;
+    if (ids.empty()) {
+        return points;
+    }
+    const bool quantized = engine_.quantization_.enabled;
+    pqxx::result res = txn.exec(
+        std::string(quantized ? "SELECT r.id, r.qx, r.qy, r.category, r.group_id FROM inspection_region r "
+                              : "SELECT r.id, r.coord_x, r.coord_y, r.category, r.group_id FROM inspection_region r ") +
+        "WHERE r.id = " + any_id(ids) +
+        (quantized ? " ORDER BY r.qy, r.qx, r.id" : " ORDER BY r.coord_y, r.coord_x, r.id"));
+    points.reserve(res.size());
+    for (const auto& row : res) {
+        points.push_back(engine_.read_point(row));
+    }
+    return points;
+}
@@ -0,0 +1,85 @@
+#ifndef SUBSCRIPTION_H
+#define SUBSCRIPTION_H
+
+#include <chrono>
+#include <memory>
+#include <set>
+#include <vector>
+#include <pqxx/pqxx>
+#include <nlohmann/json.hpp>
+
+#include "query_engine.h"
+
+using json = nlohmann::json;
+
+// How the result of a subscribed query changed since the previous refresh
+struct ResultDelta {
+    // Points that entered the result, or stayed in it with a changed row,
+    // in (y, x, id) order
+    std::vector<Point> added;
+    // Ids of points that left the result
+    std::vector<long long> removed;
+    // The dataset was replaced (or this is the first refresh): added is the
+    // whole result and replaces the previous one
+    bool reloaded = false;
+
+    bool empty() const { return !reloaded && added.empty() && removed.empty(); }
+};
+
+// A query kept up to date as inspection_region changes. data_loader logs
+// every changed row to region_change and notifies the region_changes
+// channel; a refresh reads the log since the last one and re-evaluates only
+// the crops whose region a changed row was or is in, for only the changed
+// rows (and, for proper crops, the rows of their groups). The operator tree
+// is then re-applied to those rows alone.
+//
+// The subscription listens on a connection of its own. It is not thread
+// safe, and the engine must outlive it. A replaced dataset is re-evaluated
+// with the engine's metadata, so a reload that changes the quantization
+// needs a new engine.
+class QuerySubscription {
+public:
+    QuerySubscription(QueryEngine& engine, const json& query_json);
+    ~QuerySubscription();
+
+    QuerySubscription(const QuerySubscription&) = delete;
+    QuerySubscription& operator=(const QuerySubscription&) = delete;
+
+    // Applies the changes logged since the previous refresh. The first
+    // refresh evaluates the whole query.
+    ResultDelta refresh();
+    // Waits up to timeout for a change notification, then refreshes; empty
+    // if none arrived
+    ResultDelta wait(std::chrono::milliseconds timeout);
+
+    // Ids in the result as of the last refresh
+    const std::set<long long>& result() const { return result_; }
+
+private:
+    class Listener;
+    struct Change;
+
+    QueryEngine& engine_;
+    QueryEngine::ExecutionContext ctx_;
+    std::unique_ptr<QueryNode> plan_;
+    std::vector<const QueryNode*> leaves_;
+
+    pqxx::connection conn_;
+    std::unique_ptr<Listener> listener_;
+    bool notified_ = false;
+
+    long long last_seq_ = -1;   // -1 until the first refresh
+    // On the default resource: they outlive any one refresh
+    std::vector<IdSet> leaf_ids_;
+    std::set<long long> result_;
+
+    ResultDelta reload(pqxx::work& txn, long long max_seq);
+    ResultDelta apply(pqxx::work& txn, const std::vector<Change>& changes);
+    // Whether a change can alter which rows leaf selects
+    bool affects(const QueryNode& leaf, const Change& change) const;
+    // Evaluates the optimized plan for one row from its leaf memberships
+    bool matches(const QueryNode& node, long long id) const;
+    std::vector<Point> fetch_points(pqxx::work& txn, const std::set<long long>& ids) const;
+};
+
+#endif // SUBSCRIPTION_H
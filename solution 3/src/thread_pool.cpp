@@ -0,0 +1,150 @@
+#include <chrono>
+
+#include "thread_pool.h"
+
+namespace {
+
+// Identifies the pool and queue owned by the current worker thread
+thread_local const ThreadPool* tls_pool = nullptr;
+thread_local std::size_t tls_queue = 0;
+
+} // namespace
+
+ThreadPool::ThreadPool(std::size_t thread_count) {
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+
+    for (std::size_t i = 0; i <= thread_count; ++i) {
+        queues_.push_back(std::make_unique<TaskQueue>());
+    }
+
+    for (std::size_t i = 0; i < thread_count; ++i) {
+        threads_.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+std::size_t ThreadPool::current_queue() const {
+    return tls_pool == this ? tls_queue : queues_.size() - 1;
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    TaskQueue& queue = *queues_[current_queue()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+
+    // Taking the wake mutex orders the push before any sleeper's re-check
+    { std::lock_guard<std::mutex> lock(wake_mutex_); }
+    wake_.notify_one();
+}
+
+bool ThreadPool::try_run_one(std::size_t home) {
+    std::function<void()> task;
+
+    // Own queue first, newest task
+    {
+        TaskQueue& queue = *queues_[home];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+    }
+
+    // Otherwise steal the oldest task of another queue
+    for (std::size_t offset = 1; !task && offset < queues_.size(); ++offset) {
+        TaskQueue& victim = *queues_[(home + offset) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+    }
+
+    if (!task) {
+        return false;
+    }
+
+    task();
+
+    // Tasks finishing may satisfy a waiter in run_until
+    { std::lock_guard<std::mutex> lock(wake_mutex_); }
+    wake_.notify_all();
+    return true;
+}
+
+void ThreadPool::worker_loop(std::size_t index) {
+    tls_pool = this;
+    tls_queue = index;
+
+    while (!stop_) {
+        if (try_run_one(index)) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        wake_.wait_for(lock, std::chrono::milliseconds(10));
+    }
+}
+
+void ThreadPool::run_until(const std::function<bool()>& done) {
+    const std::size_t home = current_queue();
+
+    while (!done()) {
+        if (try_run_one(home)) {
+            continue;
+        }
+
+        // Remaining work is running on other threads; sleep until one of them
+        // finishes a task.
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        if (done()) {
+            break;
+        }
+        wake_.wait_for(lock, std::chrono::milliseconds(1));
+    }
+}
+
+TaskGroup::~TaskGroup() {
+    // Tasks reference the group, so never leave while any is outstanding
+    if (pending_ > 0) {
+        pool_.run_until([this] { return pending_ == 0; });
+    }
+}
+
+void TaskGroup::run(std::function<void()> task) {
+    ++pending_;
+    pool_.submit([this, task = std::move(task)] {
+        try {
+            task();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex_);
+            if (!error_) {
+                error_ = std::current_exception();
+            }
+        }
+        --pending_;
+    });
+}
+
+void TaskGroup::wait() {
+    pool_.run_until([this] { return pending_ == 0; });
+
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+}
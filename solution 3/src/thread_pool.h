@@ -0,0 +1,70 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size work-stealing pool. Every worker owns a deque: it pushes and pops
+// its own tasks at the back (LIFO, cache friendly for nested subtrees) and
+// steals from the front of the other deques when it runs dry. Tasks submitted
+// from outside the pool go to a shared injection deque.
+class ThreadPool {
+public:
+    explicit ThreadPool(std::size_t thread_count);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    std::size_t size() const { return threads_.size(); }
+
+    void submit(std::function<void()> task);
+
+    // Executes queued tasks on the calling thread until done() returns true.
+    // Waiting threads help instead of blocking, so tasks may wait on subtasks
+    // without starving the pool.
+    void run_until(const std::function<bool()>& done);
+
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<TaskQueue>> queues_; // one per worker, last one is the injection queue
+    std::vector<std::thread> threads_;
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    std::atomic<bool> stop_{false};
+
+    void worker_loop(std::size_t index);
+    bool try_run_one(std::size_t home);
+    std::size_t current_queue() const;
+};
+
+// Collects tasks spawned for one operator so the caller can wait for all of
+// them and get the first exception rethrown.
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool& pool) : pool_(pool) {}
+    ~TaskGroup();
+
+    void run(std::function<void()> task);
+    void wait();
+
+private:
+    ThreadPool& pool_;
+    std::atomic<std::size_t> pending_{0};
+    std::mutex error_mutex_;
+    std::exception_ptr error_;
+};
+
+#endif // THREAD_POOL_H
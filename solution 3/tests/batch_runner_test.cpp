@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../src/batch_runner.h"
+
+namespace fs = std::filesystem;
+
+class BatchRunnerTest : public ::testing::Test {
+protected:
+    fs::path dir_ = fs::path(::testing::TempDir()) / "batch_runner_test";
+
+    void SetUp() override {
+        fs::remove_all(dir_);
+        fs::create_directories(dir_ / "queries");
+    }
+
+    void TearDown() override {
+        fs::remove_all(dir_);
+    }
+
+    void writeFile(const fs::path& path, const std::string& contents) {
+        std::ofstream out(path);
+        out << contents;
+    }
+};
+
+TEST_F(BatchRunnerTest, LoadsDirectoryInNameOrder) {
+    writeFile(dir_ / "queries" / "b.json", R"({"query": 2})");
+    writeFile(dir_ / "queries" / "a.json", R"({"query": 1})");
+    writeFile(dir_ / "queries" / "notes.txt", "ignored");
+
+    auto queries = load_batch((dir_ / "queries").string());
+
+    ASSERT_EQ(queries.size(), 2u);
+    EXPECT_EQ(queries[0].name, "a");
+    EXPECT_EQ(queries[0].query["query"], 1);
+    EXPECT_EQ(queries[1].name, "b");
+}
+
+TEST_F(BatchRunnerTest, LoadsJsonLines) {
+    writeFile(dir_ / "batch.jsonl", "{\"query\": 1}\n\n{\"query\": 2}\n");
+
+    auto queries = load_batch((dir_ / "batch.jsonl").string());
+
+    ASSERT_EQ(queries.size(), 2u);
+    EXPECT_EQ(queries[0].name, "query_000001");
+    EXPECT_EQ(queries[1].name, "query_000003");
+    EXPECT_EQ(queries[1].query["query"], 2);
+}
+
+TEST_F(BatchRunnerTest, LoadsListRelativeToListFile) {
+    writeFile(dir_ / "queries" / "q1.json", R"({"query": 1})");
+    writeFile(dir_ / "list.txt", "queries/q1.json\r\n");
+
+    auto queries = load_batch((dir_ / "list.txt").string());
+
+    ASSERT_EQ(queries.size(), 1u);
+    EXPECT_EQ(queries[0].name, "q1");
+    ASSERT_THROW(load_batch((dir_ / "missing.txt").string()), std::runtime_error);
+}
+
+TEST_F(BatchRunnerTest, MalformedLinesFailAlone) {
+    writeFile(dir_ / "batch.jsonl", "{\"query\": 1}\n{\"query\": \n{\"query\": 3}\n");
+
+    auto queries = load_batch((dir_ / "batch.jsonl").string());
+
+    ASSERT_EQ(queries.size(), 3u);
+    EXPECT_TRUE(queries[0].error.empty());
+    EXPECT_EQ(queries[1].line, 2u);
+    EXPECT_EQ(queries[1].error.rfind("line 2: ", 0), 0u) << queries[1].error;
+    EXPECT_TRUE(queries[2].error.empty());
+    EXPECT_EQ(queries[2].query["query"], 3);
+
+    // A list entry that does not exist fails the same way
+    writeFile(dir_ / "queries" / "q1.json", R"({"query": 1})");
+    writeFile(dir_ / "list.txt", "queries/missing.json\nqueries/q1.json\n");
+    queries = load_batch((dir_ / "list.txt").string());
+    ASSERT_EQ(queries.size(), 2u);
+    EXPECT_EQ(queries[0].error.rfind("line 1: Cannot open query file", 0), 0u) << queries[0].error;
+    EXPECT_EQ(queries[1].query["query"], 1);
+}
+
+TEST(BatchPercentileTest, NearestRank) {
+    std::vector<double> values = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+
+    EXPECT_EQ(percentile(values, 50), 5);
+    EXPECT_EQ(percentile(values, 90), 9);
+    EXPECT_EQ(percentile(values, 99), 10);
+    EXPECT_EQ(percentile(values, 0), 1);
+    EXPECT_EQ(percentile({}, 50), 0);
+}
@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+
+#include "../src/cost_model.h"
+#include "../src/statistics_catalog.h"
+#include "test_queries.h"
+
+namespace {
+
+// A million points over 1000 x 1000 in 4 categories and groups of 8
+TableStatistics million_points() {
+    TableStatistics stats;
+    stats.valid = true;
+    stats.rows = 1e6;
+    stats.extent = {0.0, 0.0, 1000.0, 1000.0};
+    stats.categories = 4.0;
+    stats.groups = 125000.0;
+    return stats;
+}
+
+const Rectangle kEverything{0.0, 0.0, 1000.0, 1000.0};
+
+ExecutionStrategy cheapest(const json& query, size_t threads = 1) {
+    auto plan = optimize_plan(parse_query(query), kEverything);
+    return CostModel(million_points(), threads).estimate(*plan, kEverything).front().strategy;
+}
+
+} // namespace
+
+TEST(CostModelTest, ParsesStatisticsArrays) {
+    double lo = 0.0, hi = 0.0;
+    ASSERT_TRUE(array_range("{-1.5,2,3,99.25}", lo, hi));
+    ASSERT_EQ(lo, -1.5);
+    ASSERT_EQ(hi, 99.25);
+
+    // most_common_vals are ordered by frequency, not value
+    ASSERT_TRUE(array_range("{40,5,95}", lo, hi));
+    ASSERT_EQ(lo, 5.0);
+    ASSERT_EQ(hi, 95.0);
+    ASSERT_TRUE(array_range("{7}", lo, hi));
+    ASSERT_EQ(lo, 7.0);
+    ASSERT_FALSE(array_range("{}", lo, hi));
+    ASSERT_FALSE(array_range("{a,b}", lo, hi));
+}
+
+TEST(CostModelTest, EstimatesCropRowsFromAreaAndFilters) {
+    CostModel model(million_points(), 1);
+    CropSpec spec;
+    spec.region = {0.0, 0.0, 100.0, 100.0};
+    ASSERT_DOUBLE_EQ(model.crop_rows(spec, kEverything), 1e4);
+
+    spec.has_category = true;
+    ASSERT_DOUBLE_EQ(model.crop_rows(spec, kEverything), 2500.0);
+    ASSERT_DOUBLE_EQ(model.crop_rows(spec, {0.0, 0.0, 50.0, 100.0}), 1250.0);
+}
+
+TEST(CostModelTest, CountsRowsFromTheCatalogWhenGiven) {
+    // Every point in the bottom left corner, where the uniform assumption
+    // expects a hundredth of them
+    const StatisticsCatalog catalog({{{0.0, 0.0, 100.0, 100.0}, 1e6}}, {{0, 1e6}}, {{8, 125000.0, 1.0, 1.0}});
+    CropSpec spec;
+    spec.region = {0.0, 0.0, 100.0, 100.0};
+    ASSERT_DOUBLE_EQ(CostModel(million_points(), 1).crop_rows(spec, kEverything), 1e4);
+    ASSERT_DOUBLE_EQ(CostModel(million_points(), 1, &catalog).crop_rows(spec, kEverything), 1e6);
+
+    spec.region = {500.0, 500.0, 600.0, 600.0};
+    ASSERT_DOUBLE_EQ(CostModel(million_points(), 1, &catalog).crop_rows(spec, kEverything), 0.0);
+}
+
+TEST(CostModelTest, SingleCropStaysPipelined) {
+    ASSERT_EQ(cheapest(crop(0, 0, 10, 10)), ExecutionStrategy::Pipelined);
+    ASSERT_EQ(cheapest(crop(0, 0, 1000, 1000)), ExecutionStrategy::Pipelined);
+}
+
+TEST(CostModelTest, ManyOverlappingCropsScanOnce) {
+    json crops = json::array();
+    for (int i = 0; i < 20; ++i) {
+        crops.push_back(crop(i, 0, i + 100, 100));
+    }
+    ASSERT_EQ(cheapest({{"operator_or", crops}}), ExecutionStrategy::InProcess);
+}
+
+TEST(CostModelTest, SmallCropsReadTheIndex) {
+    // Six crops of a hundred points each read their rows, not the table six
+    // times over
+    json crops = json::array();
+    for (int i = 0; i < 6; ++i) {
+        crops.push_back(crop(i * 10, 0, i * 10 + 10, 10));
+    }
+    auto plan = optimize_plan(parse_query({{"operator_or", crops}}), kEverything);
+    const double table_scan = 1e6 * 0.05;
+    for (const StrategyCost& cost : CostModel(million_points(), 1).estimate(*plan, kEverything)) {
+        ASSERT_LT(cost.cost_us, table_scan) << static_cast<int>(cost.strategy);
+    }
+
+    // A crop over most of the table still scans it
+    auto full = optimize_plan(parse_query(crop(0, 0, 1000, 900)), kEverything);
+    ASSERT_GT(CostModel(million_points(), 1).estimate(*full, kEverything).front().cost_us, table_scan);
+}
+
+TEST(CostModelTest, LargeIntersectionsArePushedDown) {
+    ASSERT_EQ(cheapest({{"operator_and", {crop(0, 0, 1000, 1000), crop(0, 0, 900, 1000)}}}),
+              ExecutionStrategy::Pushdown);
+}
+
+TEST(CostModelTest, ParallelOnlyWithThreads) {
+    auto plan = optimize_plan(parse_query({{"operator_or", {crop(0, 0, 10, 10), crop(20, 0, 30, 10)}}}), kEverything);
+    for (const StrategyCost& cost : CostModel(million_points(), 1).estimate(*plan, kEverything)) {
+        ASSERT_NE(cost.strategy, ExecutionStrategy::Parallel);
+    }
+
+    bool has_parallel = false;
+    for (const StrategyCost& cost : CostModel(million_points(), 4).estimate(*plan, kEverything)) {
+        has_parallel = has_parallel || cost.strategy == ExecutionStrategy::Parallel;
+    }
+    ASSERT_TRUE(has_parallel);
+}
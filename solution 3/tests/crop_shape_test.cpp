@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "../src/crop_shape.h"
+
+namespace {
+
+CropShape polygon(const std::vector<std::pair<double, double>>& vertices) {
+    CropShape shape;
+    shape.kind = CropShape::Kind::Polygon;
+    for (const auto& [x, y] : vertices) {
+        shape.xs.push_back(x);
+        shape.ys.push_back(y);
+    }
+    return shape;
+}
+
+size_t occurrences(const std::string& text, const std::string& word) {
+    size_t count = 0;
+    for (size_t pos = text.find(word); pos != std::string::npos; pos = text.find(word, pos + 1)) ++count;
+    return count;
+}
+
+} // namespace
+
+TEST(CropShapeTest, PolygonUsesTheEvenOddRule) {
+    const CropShape triangle = polygon({{0, 0}, {10, 0}, {0, 10}});
+    ASSERT_TRUE(triangle.contains(2, 2));
+    ASSERT_FALSE(triangle.contains(6, 6));
+    ASSERT_FALSE(triangle.contains(-1, 2));
+
+    // A bow tie: both wings are inside, the crossing point's surroundings
+    // above and below are not
+    const CropShape bow_tie = polygon({{0, 0}, {10, 10}, {10, 0}, {0, 10}});
+    ASSERT_TRUE(bow_tie.contains(1, 5));
+    ASSERT_TRUE(bow_tie.contains(9, 5));
+    ASSERT_FALSE(bow_tie.contains(5, 1));
+    ASSERT_FALSE(bow_tie.contains(5, 9));
+}
+
+TEST(CropShapeTest, BatchTestMatchesSinglePoints) {
+    const CropShape shapes[] = {polygon({{0, 0}, {8, 1}, {3, 4}, {9, 9}, {1, 7}}), [] {
+        CropShape circle;
+        circle.kind = CropShape::Kind::Circle;
+        circle.center_x = 4;
+        circle.center_y = 5;
+        circle.radius = 3;
+        return circle;
+    }()};
+
+    std::vector<double> xs, ys;
+    for (int i = 0; i <= 40; ++i) {
+        for (int j = 0; j <= 40; ++j) {
+            xs.push_back(i * 0.25);
+            ys.push_back(j * 0.25);
+        }
+    }
+    for (const CropShape& shape : shapes) {
+        std::vector<uint8_t> inside(xs.size());
+        shape.contains(xs.data(), ys.data(), xs.size(), inside.data());
+        for (size_t k = 0; k < xs.size(); ++k) {
+            ASSERT_EQ(inside[k] != 0, shape.contains(xs[k], ys[k])) << xs[k] << ", " << ys[k];
+        }
+    }
+}
+
+TEST(CropShapeTest, CircleIncludesItsBoundary) {
+    CropShape circle;
+    circle.kind = CropShape::Kind::Circle;
+    circle.center_x = 50;
+    circle.center_y = 40;
+    circle.radius = 10;
+    ASSERT_TRUE(circle.contains(50, 50));
+    ASSERT_TRUE(circle.contains(40, 40));
+    ASSERT_FALSE(circle.contains(58, 48));
+
+    const Rectangle box = circle.bounds();
+    ASSERT_EQ(box.x_min, 40.0);
+    ASSERT_EQ(box.y_max, 50.0);
+    ASSERT_NEAR(circle.coverage(), std::atan(1.0), 1e-12);
+}
+
+TEST(CropShapeTest, SqlSkipsHorizontalEdges) {
+    const CropShape triangle = polygon({{0, 0}, {10, 0}, {0, 10}});
+    const std::string sql = triangle.sql_predicate("r.coord_x", "r.coord_y");
+    ASSERT_EQ(occurrences(sql, "CASE WHEN"), 2u);
+    ASSERT_NE(sql.find("% 2 = 1"), std::string::npos);
+    ASSERT_DOUBLE_EQ(triangle.coverage(), 0.5);
+}
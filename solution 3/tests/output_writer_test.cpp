@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/output_writer.h"
+
+class OutputWriterTest : public ::testing::Test {
+protected:
+    std::string path_ = ::testing::TempDir() + "output_writer_test.out";
+
+    void TearDown() override {
+        std::remove(path_.c_str());
+    }
+
+    std::string readFile() {
+        std::ifstream in(path_, std::ios::binary);
+        std::ostringstream contents;
+        contents << in.rdbuf();
+        return contents.str();
+    }
+
+    static Point makePoint(double x, double y) {
+        Point p;
+        p.id = 0;
+        p.x = x;
+        p.y = y;
+        p.category = 0;
+        p.group_id = 0;
+        return p;
+    }
+};
+
+TEST_F(OutputWriterTest, TextMatchesStreamFormatting) {
+    std::vector<Point> points = {
+        makePoint(200, 300), makePoint(0.1, -2.5), makePoint(123.456789, 1e-7), makePoint(1234567.0, 0)
+    };
+
+    {
+        // A tiny buffer forces several intermediate writes
+        OutputWriter writer(path_, OutputFormat::Text, 6, 16);
+        writer.write(points);
+        writer.close();
+        ASSERT_EQ(writer.points_written(), points.size());
+    }
+
+    std::ostringstream expected;
+    for (const auto& point : points) {
+        expected << point.x << " " << point.y << std::endl;
+    }
+    ASSERT_EQ(readFile(), expected.str());
+}
+
+TEST_F(OutputWriterTest, CsvShortestRoundTrip) {
+    {
+        OutputWriter writer(path_, OutputFormat::Csv, 0);
+        writer.write(makePoint(0.1, 123.456789012));
+    }
+
+    ASSERT_EQ(readFile(), "x,y\n0.1,123.456789012\n");
+}
+
+TEST_F(OutputWriterTest, ClampsPrecisionToRoundTripDigits) {
+    // Far more digits than a double has, with a buffer just big enough for
+    // one point, must neither overflow it nor differ from 17 digits
+    {
+        OutputWriter writer(path_, OutputFormat::Text, 100, 1);
+        writer.write(makePoint(-1.2345678901234567e-300, 0.1));
+        writer.write(makePoint(0.1, -1.2345678901234567e-300));
+    }
+    ASSERT_EQ(readFile(), "-1.2345678901234568e-300 0.10000000000000001\n"
+                          "0.10000000000000001 -1.2345678901234568e-300\n");
+}
+
+TEST_F(OutputWriterTest, BinaryFormats) {
+    {
+        OutputWriter writer(path_, OutputFormat::Binary64);
+        writer.write(makePoint(1.5, -2.25));
+    }
+    std::string f64 = readFile();
+    ASSERT_EQ(f64.size(), 2 * sizeof(double));
+    double values64[2];
+    std::memcpy(values64, f64.data(), sizeof(values64));
+    EXPECT_EQ(values64[0], 1.5);
+    EXPECT_EQ(values64[1], -2.25);
+
+    {
+        OutputWriter writer(path_, OutputFormat::Binary32);
+        writer.write(makePoint(1.5, -2.25));
+    }
+    std::string f32 = readFile();
+    ASSERT_EQ(f32.size(), 2 * sizeof(float));
+    float values32[2];
+    std::memcpy(values32, f32.data(), sizeof(values32));
+    EXPECT_EQ(values32[0], 1.5f);
+    EXPECT_EQ(values32[1], -2.25f);
+}
+
+TEST_F(OutputWriterTest, WritesJsonFilesOrThrows) {
+    write_json_file(path_, {{"aggregate", "count"}, {"count", 3}});
+    ASSERT_EQ(nlohmann::json::parse(readFile()), (nlohmann::json{{"aggregate", "count"}, {"count", 3}}));
+
+    ASSERT_THROW(write_json_file(::testing::TempDir() + "no_such_directory/summary.json", nlohmann::json::object()),
+                 std::runtime_error);
+}
+
+TEST_F(OutputWriterTest, RejectsUnknownFormat) {
+    ASSERT_EQ(parse_output_format("csv"), OutputFormat::Csv);
+    ASSERT_THROW(parse_output_format("xml"), std::runtime_error);
+}
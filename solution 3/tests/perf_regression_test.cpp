@@ -0,0 +1,301 @@
+#include <gtest/gtest.h>
+#include <pqxx/pqxx>
+#include <nlohmann/json.hpp>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "../src/profile.h"
+#include "../src/query_engine.h"
+#include "test_queries.h"
+
+using json = nlohmann::json;
+
+// Every heap allocation made through operator new in this test binary,
+// including those of the engine's worker threads.
+static std::atomic<size_t> g_allocations{0};
+
+void* operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+// Performance regression checks that do not depend on wall-clock time: the
+// number of SQL statements and round-trips a query costs, which must not
+// grow with the data, and heap allocations per row.
+class PerfRegressionTest : public ::testing::Test {
+protected:
+    const std::string conn_string_ = "dbname=inspection_test_db user=postgres password=postgres host=localhost port=5432";
+    pqxx::connection conn_{conn_string_};
+
+    // Cursor statements around the evaluation: DECLARE, CLOSE and the
+    // final empty FETCH, plus one FETCH per chunk of 10000 rows
+    static constexpr size_t kFetchOverhead = 3;
+    static constexpr size_t kFetchChunk = 10000;
+    // Budget for parsing, the cursor statement text and libpqxx bookkeeping
+    static constexpr size_t kFixedAllocations = 2000;
+    // Id sets and snapshots come from the query's arena, whose blocks grow
+    // geometrically, as do the result vector and the cursor statement that
+    // are left on the heap. Allow at most one allocation per this many leaf
+    // and result rows.
+    static constexpr size_t kRowsPerAllocation = 16;
+
+    void SetUp() override {
+        pqxx::work txn(conn_);
+        txn.exec("DROP TABLE IF EXISTS inspection_region CASCADE");
+        txn.exec("DROP TABLE IF EXISTS inspection_group CASCADE");
+        txn.exec("DROP TABLE IF EXISTS dataset_metadata");
+        txn.exec("DROP TABLE IF EXISTS statistics_cell, statistics_category, statistics_group");
+        txn.exec("DROP TABLE IF EXISTS group_posting");
+        txn.exec("CREATE TABLE inspection_group (id BIGINT NOT NULL, PRIMARY KEY (id))");
+        txn.exec(R"(
+            CREATE TABLE inspection_region (
+                id BIGINT NOT NULL,
+                group_id BIGINT,
+                coord_x FLOAT,
+                coord_y FLOAT,
+                category INTEGER,
+                PRIMARY KEY (id),
+                FOREIGN KEY (group_id) REFERENCES inspection_group(id)
+            )
+        )");
+        txn.exec("CREATE INDEX idx_inspection_region_group ON inspection_region (group_id)");
+        txn.commit();
+    }
+
+    void TearDown() override {
+        pqxx::work txn(conn_);
+        txn.exec("DROP TABLE IF EXISTS inspection_region");
+        txn.exec("DROP TABLE IF EXISTS inspection_group");
+        txn.exec("DROP TABLE IF EXISTS dataset_metadata");
+        txn.exec("DROP TABLE IF EXISTS statistics_cell, statistics_category, statistics_group");
+        txn.exec("DROP TABLE IF EXISTS group_posting");
+        txn.commit();
+    }
+
+    // n points on a 100 x 100 grid cycling through 4 categories, in groups of
+    // 4 horizontal neighbours
+    void loadGrid(size_t n) {
+        pqxx::work txn(conn_);
+        txn.exec("DELETE FROM inspection_region");
+        txn.exec("DELETE FROM inspection_group");
+        const std::string count = std::to_string(n);
+        txn.exec("INSERT INTO inspection_group (id) SELECT g FROM generate_series(0, (" + count + " - 1) / 4) g");
+        txn.exec(
+            "INSERT INTO inspection_region (id, group_id, coord_x, coord_y, category) "
+            "SELECT i, i / 4, (i % 100) + 0.5, ((i / 100) % 100) + 0.5, i % 4 "
+            "FROM generate_series(0, " + count + " - 1) i");
+        txn.commit();
+    }
+
+    struct Cost {
+        size_t statements = 0;
+        size_t round_trips = 0;
+        size_t leaf_rows = 0;
+        size_t result_rows = 0;
+        size_t allocations = 0;
+    };
+
+    static size_t leafRows(const ProfileNode& node) {
+        if (node.name == "crop") {
+            return node.rows_out;
+        }
+        size_t rows = 0;
+        for (const auto& child : node.children) {
+            rows += leafRows(*child);
+        }
+        return rows;
+    }
+
+    // Runs the query once with profiling for the statement counts and once
+    // without it for the allocation count
+    Cost measure(QueryEngine& engine, const json& query) {
+        Cost cost;
+        ProfileNode profile;
+        cost.result_rows = engine.execute_query(query, &profile).size();
+        cost.statements = profile.total_sql_statements();
+        cost.round_trips = profile.total_sql_round_trips();
+        cost.leaf_rows = leafRows(profile);
+
+        const size_t before = g_allocations.load();
+        size_t rows = engine.execute_query(query).size();
+        cost.allocations = g_allocations.load() - before;
+
+        EXPECT_EQ(rows, cost.result_rows);
+        return cost;
+    }
+
+    // The tests pin the strategy, so the cost model cannot change it when
+    // autovacuum analyzes the table in between
+    static EngineOptions withStrategy(ExecutionStrategy strategy) {
+        EngineOptions options;
+        options.strategy = strategy;
+        return options;
+    }
+
+    static size_t fetchStatements(size_t rows) {
+        return kFetchOverhead + (rows + kFetchChunk - 1) / kFetchChunk;
+    }
+
+    void expectAllocationBound(const Cost& cost) {
+        EXPECT_LE(cost.allocations, kFixedAllocations + (cost.leaf_rows + cost.result_rows) / kRowsPerAllocation)
+            << cost.allocations << " allocations for " << cost.leaf_rows << " leaf rows and "
+            << cost.result_rows << " result rows";
+    }
+
+    static std::vector<std::pair<std::string, json>> representativeQueries() {
+        return {
+            {"crop", query(crop(0, 0, 100, 100))},
+            {"filtered_crop", query(crop(0, 0, 60, 60, {{"category", 1}, {"one_of_groups", {1, 2, 3, 50, 51, 52}}}))},
+            {"proper_crop", query(crop(10, 0, 90, 100, {{"proper", true}}))},
+            {"and", query({{"operator_and", {crop(0, 0, 60, 100), crop(40, 0, 100, 100)}}})},
+            {"nested", query({{"operator_or", {
+                {{"operator_and", {crop(0, 0, 50, 50), crop(25, 25, 75, 75, {{"proper", true}})}}},
+                {{"operator_and", {crop(50, 50, 100, 100), crop(0, 0, 100, 100, {{"category", 2}})}}},
+                crop(0, 90, 100, 100)
+            }}})}
+        };
+    }
+
+    static size_t leafCount(const json& node) {
+        if (node.contains("operator_crop")) {
+            return 1;
+        }
+        size_t leaves = 0;
+        for (const auto& operand : node.begin().value()) {
+            leaves += leafCount(operand);
+        }
+        return leaves;
+    }
+};
+
+TEST_F(PerfRegressionTest, PipelinedQueriesCostOneRoundTripPlusFetch) {
+    loadGrid(4000);
+    QueryEngine engine(conn_string_, withStrategy(ExecutionStrategy::Pipelined));
+
+    for (const auto& [name, q] : representativeQueries()) {
+        SCOPED_TRACE(name);
+        const Cost cost = measure(engine, q);
+        const size_t leaves = leafCount(q["query"]);
+
+        ASSERT_GT(cost.result_rows, 0u);
+        EXPECT_LE(cost.statements, leaves + fetchStatements(cost.result_rows));
+        EXPECT_LE(cost.round_trips, 1 + fetchStatements(cost.result_rows));
+        expectAllocationBound(cost);
+    }
+}
+
+TEST_F(PerfRegressionTest, ParallelQueriesCostOneStatementPerLeaf) {
+    loadGrid(4000);
+    EngineOptions options = withStrategy(ExecutionStrategy::Parallel);
+    options.threads = 4;
+    QueryEngine engine(conn_string_, options);
+
+    for (const auto& [name, q] : representativeQueries()) {
+        SCOPED_TRACE(name);
+        const Cost cost = measure(engine, q);
+        const size_t leaves = leafCount(q["query"]);
+
+        EXPECT_LE(cost.statements, leaves + fetchStatements(cost.result_rows));
+        EXPECT_LE(cost.round_trips, leaves + fetchStatements(cost.result_rows));
+        expectAllocationBound(cost);
+    }
+}
+
+TEST_F(PerfRegressionTest, SingleStatementStrategiesCostOneRoundTripPlusFetch) {
+    loadGrid(4000);
+
+    // Pushdown sends one statement; InProcess one, plus the group bounds for
+    // proper crops in the same round-trip
+    for (ExecutionStrategy strategy : {ExecutionStrategy::Pushdown, ExecutionStrategy::InProcess}) {
+        QueryEngine engine(conn_string_, withStrategy(strategy));
+        for (const auto& [name, q] : representativeQueries()) {
+            SCOPED_TRACE(std::string(strategy_name(strategy)) + " " + name);
+            const Cost cost = measure(engine, q);
+
+            EXPECT_LE(cost.statements, 2 + fetchStatements(cost.result_rows));
+            EXPECT_LE(cost.round_trips, 1 + fetchStatements(cost.result_rows));
+            expectAllocationBound(cost);
+        }
+    }
+}
+
+TEST_F(PerfRegressionTest, StatementCountDoesNotGrowWithTheData) {
+    // Both sizes stay within one fetch chunk, so any difference would come
+    // from per-row statements
+    for (ExecutionStrategy strategy : all_strategies()) {
+        SCOPED_TRACE(strategy_name(strategy));
+        std::vector<std::vector<size_t>> statements(2);
+        const size_t sizes[] = {1000, 8000};
+
+        for (size_t s = 0; s < 2; ++s) {
+            loadGrid(sizes[s]);
+            QueryEngine engine(conn_string_, withStrategy(strategy));
+            for (const auto& [name, q] : representativeQueries()) {
+                statements[s].push_back(measure(engine, q).statements);
+            }
+        }
+
+        ASSERT_EQ(statements[0], statements[1]);
+    }
+}
+
+TEST_F(PerfRegressionTest, HeapAllocationsDoNotGrowWithTheRows) {
+    // Id sets, snapshots and bitmaps come from the query's arena; growing
+    // the data 8x may add arena blocks but not an allocation per row
+    for (ExecutionStrategy strategy : all_strategies()) {
+        SCOPED_TRACE(strategy_name(strategy));
+        std::vector<std::vector<Cost>> costs(2);
+        const size_t sizes[] = {1000, 8000};
+
+        for (size_t s = 0; s < 2; ++s) {
+            loadGrid(sizes[s]);
+            QueryEngine engine(conn_string_, withStrategy(strategy));
+            for (const auto& [name, q] : representativeQueries()) {
+                costs[s].push_back(measure(engine, q));
+            }
+        }
+
+        const auto queries = representativeQueries();
+        for (size_t i = 0; i < queries.size(); ++i) {
+            SCOPED_TRACE(queries[i].first);
+            const Cost& small = costs[0][i];
+            const Cost& large = costs[1][i];
+            const size_t added_rows = (large.leaf_rows + large.result_rows) - (small.leaf_rows + small.result_rows);
+            EXPECT_LE(large.allocations, small.allocations + kFixedAllocations / 10 + added_rows / kRowsPerAllocation)
+                << small.allocations << " allocations at " << sizes[0] << " points, "
+                << large.allocations << " at " << sizes[1];
+        }
+    }
+}
+
+TEST_F(PerfRegressionTest, PageCostIsIndependentOfTheAnswerSize) {
+    // A page is one cursor statement; nothing is held per matching point
+    loadGrid(8000);
+    QueryEngine engine(conn_string_);
+
+    for (const auto& [name, q] : representativeQueries()) {
+        SCOPED_TRACE(name);
+        json page = q;
+        page["limit"] = 10;
+        page["after"] = {{"y", 5.5}, {"x", 0.5}};
+        const Cost cost = measure(engine, page);
+
+        EXPECT_LE(cost.result_rows, 10u);
+        EXPECT_EQ(cost.statements, fetchStatements(cost.result_rows));
+        EXPECT_LE(cost.allocations, kFixedAllocations);
+    }
+}
@@ -4,9 +4,17 @@
 #include <iostream>
 #include <vector>
 #include <set>
+#include <algorithm>
+#include <thread>
+#include <chrono>
 
 // Include the newly created header file for the QueryEngine
 #include "../src/query_engine.h"
+#include "../src/profile.h"
+#include "../src/random_query.h"
+#include "../src/subscription.h"
+#include "data_loader.h"
+#include "test_queries.h"
 
 using json = nlohmann::json;
 
@@ -20,6 +28,10 @@ protected:
         // Clean up and create schema
         txn.exec("DROP TABLE IF EXISTS inspection_region CASCADE");
         txn.exec("DROP TABLE IF EXISTS inspection_group CASCADE");
+        txn.exec("DROP TABLE IF EXISTS dataset_metadata");
+        txn.exec("DROP TABLE IF EXISTS statistics_cell, statistics_category, statistics_group");
+        txn.exec("DROP TABLE IF EXISTS group_posting");
+        txn.exec("DROP TABLE IF EXISTS region_change");
 
         txn.exec(R"(
             CREATE TABLE inspection_group (
@@ -60,6 +72,10 @@ protected:
         pqxx::work txn(conn_);
         txn.exec("DROP TABLE IF EXISTS inspection_region");
         txn.exec("DROP TABLE IF EXISTS inspection_group");
+        txn.exec("DROP TABLE IF EXISTS dataset_metadata");
+        txn.exec("DROP TABLE IF EXISTS statistics_cell, statistics_category, statistics_group");
+        txn.exec("DROP TABLE IF EXISTS group_posting");
+        txn.exec("DROP TABLE IF EXISTS region_change");
         txn.commit();
     }
 
@@ -71,6 +87,21 @@ protected:
         }
         return ids;
     }
+
+    // Operator trees over [0, 100]^2 and the ids each must return
+    using ExpectedIds = std::vector<std::pair<json, std::set<long long>>>;
+
+    // Runs every case under every strategy, with options otherwise as given
+    void expectAgreesAcrossStrategies(const ExpectedIds& cases, EngineOptions options = EngineOptions()) {
+        for (ExecutionStrategy strategy : all_strategies()) {
+            options.strategy = strategy;
+            QueryEngine engine(conn_string_, options);
+            for (const auto& [tree, expected] : cases) {
+                SCOPED_TRACE(std::string(strategy_name(strategy)) + " " + tree.dump());
+                EXPECT_EQ(getIds(engine.execute_query(query(tree))), expected);
+            }
+        }
+    }
 };
 
 TEST_F(QueryEngineTest, BasicCrop) {
@@ -240,3 +271,744 @@ TEST_F(QueryEngineTest, ComplexNestedQuery) {
     std::set<long long> expected_ids = {2, 5};
     ASSERT_EQ(result_ids, expected_ids);
 }
+
+TEST_F(QueryEngineTest, QuantizedCoordinates) {
+    // Re-encode the fixture as int32 fixed-point (scale 0.5, offset 0) and
+    // drop the FLOAT columns, like data_loader --quantize_scale does.
+    {
+        pqxx::work txn(conn_);
+        txn.exec("ALTER TABLE inspection_region ADD COLUMN qx INTEGER, ADD COLUMN qy INTEGER");
+        txn.exec("UPDATE inspection_region SET qx = coord_x * 2, qy = coord_y * 2, coord_x = NULL, coord_y = NULL");
+        txn.exec("CREATE TABLE dataset_metadata (key TEXT NOT NULL, value TEXT NOT NULL, PRIMARY KEY (key))");
+        txn.exec("INSERT INTO dataset_metadata VALUES ('quantization.scale', '0.5'), "
+                 "('quantization.offset_x', '0'), ('quantization.offset_y', '0')");
+        txn.commit();
+    }
+
+    QueryEngine engine(conn_string_);
+    // Crop bounds that are not on the quantization grid must be rounded
+    // inwards without losing the points at 20 and 30.
+    json query = R"(
+    {
+      "valid_region": { "p_min": { "x": 0, "y": 0 }, "p_max": { "x": 100, "y": 100 } },
+      "query": {
+        "operator_or": [
+          { "operator_crop": { "region": { "p_min": { "x": 19.9, "y": 19.9 }, "p_max": { "x": 30.2, "y": 30.2 } } } },
+          { "operator_crop": { "region": { "p_min": { "x": 0, "y": 0 }, "p_max": { "x": 100, "y": 100 } }, "proper": true, "category": 1 } }
+        ]
+      }
+    }
+    )"_json;
+
+    auto results = engine.execute_query(query);
+    auto result_ids = getIds(results);
+
+    std::set<long long> expected_ids = {1, 2, 3, 5, 6};
+    ASSERT_EQ(result_ids, expected_ids);
+
+    for (const auto& p : results) {
+        if (p.id == 3) {
+            EXPECT_DOUBLE_EQ(p.x, 30.0);
+            EXPECT_DOUBLE_EQ(p.y, 30.0);
+        }
+    }
+}
+
+TEST_F(QueryEngineTest, ParallelMatchesSequential) {
+    EngineOptions options;
+    options.threads = 4;
+    options.crop_tiles = 3;
+    QueryEngine parallel_engine(conn_string_, options);
+    QueryEngine sequential_engine(conn_string_);
+    json query = R"(
+    {
+      "valid_region": { "p_min": { "x": 0, "y": 0 }, "p_max": { "x": 100, "y": 100 } },
+      "query": {
+        "operator_or": [
+          { "operator_crop": { "region": { "p_min": { "x": 5, "y": 5 }, "p_max": { "x": 15, "y": 15 } } } },
+          {
+            "operator_and": [
+              { "operator_crop": { "region": { "p_min": { "x": 0, "y": 0 }, "p_max": { "x": 100, "y": 100 } }, "proper": true } },
+              { "operator_crop": { "region": { "p_min": { "x": 15, "y": 15 }, "p_max": { "x": 55, "y": 55 } } } }
+            ]
+          },
+          { "operator_crop": { "region": { "p_min": { "x": 25, "y": 25 }, "p_max": { "x": 35, "y": 35 } }, "category": 1 } }
+        ]
+      }
+    }
+    )"_json;
+    // OR-1: {1}, OR-2: {1, 2, 5, 6} AND {2, 3, 5, 6} = {2, 5, 6}, OR-3: {3}
+
+    auto result_ids = getIds(parallel_engine.execute_query(query));
+
+    std::set<long long> expected_ids = {1, 2, 3, 5, 6};
+    ASSERT_EQ(result_ids, expected_ids);
+    ASSERT_EQ(result_ids, getIds(sequential_engine.execute_query(query)));
+}
+
+TEST_F(QueryEngineTest, SharedConnectionPool) {
+    ConnectionPoolOptions pool_options;
+    pool_options.min_connections = 2;
+    pool_options.max_connections = 2;
+    auto pool = std::make_shared<ConnectionPool>(conn_string_, pool_options);
+    ASSERT_EQ(pool->open_connections(), 2u);
+
+    QueryEngine first_engine(pool);
+    QueryEngine second_engine(pool);
+    json query = R"(
+    {
+      "valid_region": { "p_min": { "x": 0, "y": 0 }, "p_max": { "x": 100, "y": 100 } },
+      "query": {
+        "operator_crop": {
+          "region": { "p_min": { "x": 15, "y": 15 }, "p_max": { "x": 35, "y": 35 } }
+        }
+      }
+    }
+    )"_json;
+
+    // Concurrent callers on both engines never open more than the pool's cap
+    std::vector<std::set<long long>> results(8);
+    std::vector<std::thread> callers;
+    for (size_t i = 0; i < results.size(); ++i) {
+        QueryEngine& engine = (i % 2 == 0) ? first_engine : second_engine;
+        callers.emplace_back([&engine, &query, &results, i, this] {
+            results[i] = getIds(engine.execute_query(query));
+        });
+    }
+    for (auto& caller : callers) {
+        caller.join();
+    }
+
+    std::set<long long> expected_ids = {2, 3};
+    for (const auto& result_ids : results) {
+        ASSERT_EQ(result_ids, expected_ids);
+    }
+    ASSERT_EQ(pool->open_connections(), 2u);
+    ASSERT_EQ(pool->idle_connections(), 2u);
+}
+
+TEST_F(QueryEngineTest, ConnectionPoolBoundedWait) {
+    ConnectionPoolOptions pool_options;
+    pool_options.max_connections = 1;
+    pool_options.acquire_timeout = std::chrono::milliseconds(50);
+    ConnectionPool pool(conn_string_, pool_options);
+
+    ConnectionPool::Lease held = pool.acquire();
+    ASSERT_TRUE(held);
+    ASSERT_FALSE(pool.try_acquire());
+    ASSERT_THROW(pool.acquire(), std::runtime_error);
+
+    // Returning the connection makes it available again
+    held = ConnectionPool::Lease();
+    ASSERT_TRUE(pool.try_acquire());
+}
+
+TEST_F(QueryEngineTest, StreamedChunksInYXOrder) {
+    QueryEngine engine(conn_string_);
+    json query = R"(
+    {
+      "valid_region": { "p_min": { "x": 0, "y": 0 }, "p_max": { "x": 100, "y": 100 } },
+      "query": {
+        "operator_crop": {
+          "region": { "p_min": { "x": 0, "y": 0 }, "p_max": { "x": 100, "y": 100 } }
+        }
+      }
+    }
+    )"_json;
+
+    std::vector<size_t> chunk_sizes;
+    std::vector<long long> streamed_ids;
+    engine.execute_query_stream(query, [&](const std::vector<Point>& chunk) {
+        chunk_sizes.push_back(chunk.size());
+        for (const auto& p : chunk) {
+            streamed_ids.push_back(p.id);
+        }
+    }, 2);
+
+    // Five valid points in chunks of at most two, ordered by (y, x)
+    std::vector<size_t> expected_chunks = {2, 2, 1};
+    std::vector<long long> expected_ids = {1, 2, 3, 5, 6};
+    ASSERT_EQ(chunk_sizes, expected_chunks);
+    ASSERT_EQ(streamed_ids, expected_ids);
+}
+
+TEST_F(QueryEngineTest, ProfileCountsStatementsPerOperator) {
+    EngineOptions options;
+    options.strategy = ExecutionStrategy::Pipelined;
+    QueryEngine engine(conn_string_, options);
+    json query = R"(
+    {
+      "valid_region": { "p_min": { "x": 0, "y": 0 }, "p_max": { "x": 100, "y": 100 } },
+      "query": {
+        "operator_and": [
+          { "operator_crop": { "region": { "p_min": { "x": 0, "y": 0 }, "p_max": { "x": 35, "y": 35 } } } },
+          { "operator_crop": { "region": { "p_min": { "x": 15, "y": 15 }, "p_max": { "x": 55, "y": 55 } } } }
+        ]
+      }
+    }
+    )"_json;
+
+    ProfileNode profile;
+    auto results = engine.execute_query(query, &profile);
+    ASSERT_EQ(getIds(results), (std::set<long long>{2, 3}));
+
+    // query -> parse, acquire_connection, and, fetch
+    ASSERT_EQ(profile.name, "query");
+    ASSERT_EQ(profile.rows_out, 2u);
+    ASSERT_EQ(profile.children.size(), 4u);
+
+    const ProfileNode& and_node = *profile.children[2];
+    ASSERT_EQ(and_node.name, "and");
+    ASSERT_EQ(and_node.rows_in, 7u);
+    ASSERT_EQ(and_node.rows_out, 2u);
+    ASSERT_EQ(and_node.sql_round_trips, 1u);
+    ASSERT_EQ(and_node.children.size(), 2u);
+    ASSERT_EQ(and_node.children[0]->rows_out, 3u);
+    ASSERT_EQ(and_node.children[1]->rows_out, 4u);
+
+    // Two pipelined crops, then DECLARE, one FETCH with rows, the empty
+    // FETCH and CLOSE
+    const ProfileNode& fetch_node = *profile.children[3];
+    ASSERT_EQ(fetch_node.name, "fetch");
+    ASSERT_EQ(fetch_node.sql_statements, 4u);
+    ASSERT_EQ(profile.total_sql_statements(), 6u);
+    ASSERT_EQ(profile.total_sql_round_trips(), 5u);
+}
+
+TEST_F(QueryEngineTest, ExplainAnalyzeReportsEstimatesAndActualRows) {
+    EngineOptions options;
+    options.strategy = ExecutionStrategy::Pipelined;
+    QueryEngine engine(conn_string_, options);
+    json query = R"(
+    {
+      "valid_region": { "p_min": { "x": 0, "y": 0 }, "p_max": { "x": 100, "y": 100 } },
+      "query": {
+        "operator_and": [
+          { "operator_crop": { "region": { "p_min": { "x": 0, "y": 0 }, "p_max": { "x": 35, "y": 35 } } } },
+          { "operator_and": [
+            { "operator_crop": { "region": { "p_min": { "x": 15, "y": 15 }, "p_max": { "x": 55, "y": 55 } } } }
+          ] }
+        ]
+      }
+    }
+    )"_json;
+
+    json plan = engine.explain(query);
+    ASSERT_FALSE(plan["analyze"].get<bool>());
+    ASSERT_FALSE(plan["plan"].contains("actual_rows"));
+
+    // The inner single-operand AND is optimized away
+    json analyzed = engine.explain(query, true);
+    const json& root = analyzed["plan"];
+    ASSERT_EQ(root["operator"], "and");
+    ASSERT_EQ(root["actual_rows"], 2);
+    ASSERT_EQ(root["children"].size(), 2u);
+    ASSERT_EQ(root["children"][0]["operator"], "crop");
+    ASSERT_EQ(root["children"][0]["actual_rows"], 3);
+    ASSERT_EQ(root["children"][1]["operator"], "crop");
+    ASSERT_EQ(root["children"][1]["actual_rows"], 4);
+    ASSERT_TRUE(root["children"][1]["sql"].get<std::string>().find("SELECT id FROM inspection_region") == 0);
+    ASSERT_TRUE(root["children"][1].contains("buffers"));
+    ASSERT_FALSE(root["children"][1]["scans"].empty());
+}
+
+TEST_F(QueryEngineTest, RandomQueriesAgreeAcrossStrategies) {
+    // A denser dataset than the fixture: a 20 x 20 grid in groups of three
+    // horizontal neighbours, some of which straddle crop edges
+    {
+        pqxx::work txn(conn_);
+        txn.exec("INSERT INTO inspection_group (id) SELECT g FROM generate_series(10, 150) g");
+        txn.exec("INSERT INTO inspection_region (id, group_id, coord_x, coord_y, category) "
+                 "SELECT 100 + i, 10 + i / 3, (i % 20) * 5, (i / 20) * 5, i % 4 FROM generate_series(0, 399) i");
+        txn.commit();
+    }
+
+    std::vector<Point> points;
+    {
+        pqxx::work txn(conn_);
+        for (const auto& row : txn.exec("SELECT id, coord_x, coord_y, category, group_id FROM inspection_region")) {
+            Point p;
+            p.id = row[0].as<long long>();
+            p.x = row[1].as<double>();
+            p.y = row[2].as<double>();
+            p.category = row[3].as<int>();
+            p.group_id = row[4].as<int>();
+            points.push_back(p);
+        }
+        txn.commit();
+    }
+
+    std::vector<std::unique_ptr<QueryEngine>> engines;
+    for (ExecutionStrategy strategy : all_strategies()) {
+        EngineOptions options;
+        options.strategy = strategy;
+        options.threads = 3;
+        options.crop_tiles = 2;
+        engines.push_back(std::make_unique<QueryEngine>(conn_string_, options));
+    }
+
+    RandomQueryOptions query_options;
+    query_options.groups = 150;
+    std::mt19937_64 rng(2024);
+    for (int i = 0; i < 50; ++i) {
+        json query = random_query(rng, query_options);
+        const std::set<long long> expected = reference_evaluate(points, query);
+        for (size_t e = 0; e < engines.size(); ++e) {
+            ASSERT_EQ(getIds(engines[e]->execute_query(query)), expected)
+                << strategy_name(all_strategies()[e]) << " on " << query.dump();
+        }
+    }
+}
+
+TEST_F(QueryEngineTest, AutoChoosesStrategyFromTableStatistics) {
+    {
+        pqxx::nontransaction txn(conn_);
+        txn.exec("ANALYZE inspection_region");
+    }
+    json query = R"(
+    {
+      "valid_region": { "p_min": { "x": 0, "y": 0 }, "p_max": { "x": 100, "y": 100 } },
+      "query": {
+        "operator_or": [
+          { "operator_crop": { "region": { "p_min": { "x": 0, "y": 0 }, "p_max": { "x": 15, "y": 15 } } } },
+          { "operator_crop": { "region": { "p_min": { "x": 35, "y": 35 }, "p_max": { "x": 45, "y": 45 } }, "proper": true } }
+        ]
+      }
+    }
+    )"_json;
+
+    QueryEngine engine(conn_string_);
+    ProfileNode profile;
+    ASSERT_EQ(getIds(engine.execute_query(query, &profile)), (std::set<long long>{1}));
+    ASSERT_EQ(profile.detail["strategy_source"], "cost_model");
+    const json& costs = profile.detail["estimated_cost_us"];
+    for (const char* name : {"sequential", "pipelined", "pushdown", "in_process"}) {
+        ASSERT_TRUE(costs.contains(name)) << name;
+    }
+    ASSERT_EQ(engine.explain(query)["strategy_source"], "cost_model");
+
+    // A fixed strategy overrides the cost model
+    EngineOptions options;
+    options.strategy = ExecutionStrategy::InProcess;
+    QueryEngine fixed(conn_string_, options);
+    ASSERT_EQ(getIds(fixed.execute_query(query, &profile)), (std::set<long long>{1}));
+    ASSERT_EQ(profile.detail["strategy"], "in_process");
+    ASSERT_EQ(profile.detail["strategy_source"], "fixed");
+}
+
+TEST_F(QueryEngineTest, CountAndHistogramsAggregateOnTheServer) {
+    QueryEngine engine(conn_string_);
+    json query = R"(
+    {
+      "valid_region": { "p_min": { "x": 0, "y": 0 }, "p_max": { "x": 100, "y": 100 } },
+      "query": {
+        "operator_count": { "operator_crop": { "region": { "p_min": { "x": 0, "y": 0 }, "p_max": { "x": 200, "y": 200 } } } }
+      }
+    }
+    )"_json;
+
+    ProfileNode profile;
+    ASSERT_EQ(engine.execute_aggregate(query, &profile)["count"], 5);
+    ASSERT_EQ(profile.total_sql_statements(), 1u);
+    ASSERT_THROW(engine.execute_query(query), std::runtime_error);
+
+    query["query"] = {{"operator_histogram", {{"by", "category"}, {"query", query["query"]["operator_count"]}}}};
+    json by_category = engine.execute_aggregate(query);
+    ASSERT_EQ(by_category["total"], 5);
+    ASSERT_EQ(by_category["buckets"], R"([{"key": 1, "count": 4}, {"key": 2, "count": 1}])"_json);
+
+    query["query"]["operator_histogram"]["by"] = "group";
+    ASSERT_EQ(engine.execute_aggregate(query)["buckets"],
+              R"([{"key": 0, "count": 2}, {"key": 1, "count": 1}, {"key": 2, "count": 2}])"_json);
+
+    query["query"]["operator_histogram"]["by"] = "grid";
+    query["query"]["operator_histogram"]["cell_size"] = 25;
+    json by_cell = engine.execute_aggregate(query);
+    ASSERT_EQ(by_cell["buckets"].size(), 3u);
+    ASSERT_EQ(by_cell["buckets"][0]["cell"], R"([0, 0])"_json);
+    ASSERT_EQ(by_cell["buckets"][0]["count"], 2);
+    ASSERT_EQ(by_cell["buckets"][1]["region"], R"([25.0, 25.0, 50.0, 50.0])"_json);
+    ASSERT_EQ(by_cell["buckets"][1]["count"], 2);
+    ASSERT_EQ(by_cell["buckets"][2]["count"], 1);
+}
+
+TEST_F(QueryEngineTest, PagesFollowTheCursor) {
+    auto page_ids = [](QueryEngine& engine, const json& query) {
+        std::vector<long long> ids;
+        for (const Point& p : engine.execute_query(query)) ids.push_back(p.id);
+        return ids;
+    };
+    json query = R"(
+    {
+      "valid_region": { "p_min": { "x": 0, "y": 0 }, "p_max": { "x": 100, "y": 100 } },
+      "query": { "operator_crop": { "region": { "p_min": { "x": 0, "y": 0 }, "p_max": { "x": 200, "y": 200 } } } },
+      "limit": 2
+    }
+    )"_json;
+
+    QueryEngine engine(conn_string_);
+    ASSERT_EQ(page_ids(engine, query), (std::vector<long long>{1, 2}));
+    query["after"] = {{"y", 20}, {"x", 20}, {"id", 2}};
+    ASSERT_EQ(page_ids(engine, query), (std::vector<long long>{3, 5}));
+    query["after"] = {{"y", 40}, {"x", 40}};
+    ASSERT_EQ(page_ids(engine, query), (std::vector<long long>{6}));
+
+    // Operator trees page the same way
+    query["query"] = R"({ "operator_or": [
+        { "operator_crop": { "region": { "p_min": { "x": 0, "y": 0 }, "p_max": { "x": 25, "y": 25 } } } },
+        { "operator_crop": { "region": { "p_min": { "x": 45, "y": 45 }, "p_max": { "x": 55, "y": 55 } } } }
+    ] })"_json;
+    query["after"] = {{"y", 10}, {"x", 10}, {"id", 1}};
+    ASSERT_EQ(page_ids(engine, query), (std::vector<long long>{2, 6}));
+
+    // On quantized data the cursor falls between and on grid values
+    {
+        pqxx::work txn(conn_);
+        txn.exec("ALTER TABLE inspection_region ADD COLUMN qx INTEGER, ADD COLUMN qy INTEGER");
+        txn.exec("UPDATE inspection_region SET qx = coord_x * 2, qy = coord_y * 2, coord_x = NULL, coord_y = NULL");
+        txn.exec("CREATE TABLE dataset_metadata (key TEXT NOT NULL, value TEXT NOT NULL, PRIMARY KEY (key))");
+        txn.exec("INSERT INTO dataset_metadata VALUES ('quantization.scale', '0.5'), "
+                 "('quantization.offset_x', '0'), ('quantization.offset_y', '0')");
+        txn.commit();
+    }
+    QueryEngine quantized(conn_string_);
+    query["after"] = {{"y", 20}, {"x", 20}, {"id", 2}};
+    ASSERT_EQ(page_ids(quantized, query), (std::vector<long long>{6}));
+    query["after"] = {{"y", 9.8}, {"x", 99}};
+    ASSERT_EQ(page_ids(quantized, query), (std::vector<long long>{1, 2}));
+    query["after"] = {{"y", 10}, {"x", 10.2}};
+    ASSERT_EQ(page_ids(quantized, query), (std::vector<long long>{2, 6}));
+}
+
+TEST_F(QueryEngineTest, PolygonAndCircleCropsAgreeAcrossStrategies) {
+    const json triangle = {{"operator_crop_polygon", {{"points", {
+        {{"x", 0}, {"y", 0}}, {{"x", 50}, {"y", 0}}, {{"x", 0}, {"y", 50}}}}}}};
+    const json small_circle = {{"operator_crop_circle", {{"center", {{"x", 45}, {"y", 40}}}, {"radius", 6}}}};
+    json proper_circle = small_circle;
+    proper_circle["operator_crop_circle"]["proper"] = true;
+    json large_circle = {{"operator_crop_circle", {{"center", {{"x", 45}, {"y", 45}}}, {"radius", 10}, {"proper", true}}}};
+
+    const ExpectedIds cases = {
+        {triangle, {1, 2}},
+        {small_circle, {5}},
+        {proper_circle, {}},
+        {large_circle, {5, 6}},
+        {{{"operator_or", {triangle, large_circle}}}, {1, 2, 5, 6}},
+        {{{"operator_and", {triangle, crop(0, 0, 100, 100, {{"category", 2}})}}}, {2}},
+    };
+
+    EngineOptions options;
+    options.threads = 2;
+    expectAgreesAcrossStrategies(cases, options);
+}
+
+TEST_F(QueryEngineTest, ExclusionsAgreeAcrossStrategies) {
+    const ExpectedIds cases = {
+        {{{"operator_difference", {crop(0, 0, 45, 45), crop(0, 0, 25, 25)}}}, {3, 5}},
+        {{{"operator_and", {crop(0, 0, 200, 200), {{"operator_not", crop(0, 0, 200, 200, {{"category", 1}})}}}}}, {2}},
+        // Point 4 is outside the valid region, so the complement leaves it out
+        {{{"operator_not", crop(0, 0, 35, 35)}}, {5, 6}},
+        {{{"operator_or", {crop(0, 0, 15, 15), {{"operator_not", crop(0, 0, 45, 45)}}}}}, {1, 6}},
+        {{{"operator_difference", {{{"operator_or", {crop(0, 0, 15, 15), crop(0, 0, 200, 200, {{"proper", true}})}}}, crop(0, 0, 25, 25)}}}, {5, 6}},
+        {{{"operator_difference", {crop(0, 0, 200, 200), {{"operator_not", crop(0, 0, 25, 25)}}}}}, {1, 2}},
+    };
+
+    EngineOptions options;
+    options.threads = 2;
+    expectAgreesAcrossStrategies(cases, options);
+
+    // A page of a difference is one anti-join over the crop
+    QueryEngine engine(conn_string_);
+    json page = query(cases[0].first);
+    page["limit"] = 1;
+    ASSERT_EQ(getIds(engine.execute_query(page)), (std::set<long long>{3}));
+    const json plan = engine.explain(query(cases[0].first));
+    ASSERT_EQ(plan["plan"]["operator"], "difference");
+    json count = query({{"operator_count", cases[2].first}});
+    ASSERT_EQ(engine.execute_aggregate(count)["count"], 2);
+}
+
+TEST_F(QueryEngineTest, SpatiallyPartitionedTablesPruneTiles) {
+    // The fixture rows in the tiles data_loader --partition=tiles would
+    // create: two bands of y, each split in two on x
+    {
+        pqxx::work txn(conn_);
+        txn.exec("CREATE TABLE fixture_rows AS SELECT * FROM inspection_region");
+        txn.exec("DROP TABLE inspection_region");
+        txn.exec("CREATE TABLE inspection_region (id BIGINT NOT NULL, group_id BIGINT, coord_x FLOAT, coord_y FLOAT, "
+                 "category INTEGER, PRIMARY KEY (id, coord_y, coord_x)) PARTITION BY RANGE (coord_y)");
+        const char* bands[] = {"FROM (MINVALUE) TO (35)", "FROM (35) TO (MAXVALUE)"};
+        for (int b = 0; b < 2; ++b) {
+            const std::string band = "inspection_region_b" + std::to_string(b);
+            txn.exec("CREATE TABLE " + band + " PARTITION OF inspection_region FOR VALUES " + bands[b] +
+                     " PARTITION BY RANGE (coord_x)");
+            txn.exec("CREATE TABLE " + band + "_t0 PARTITION OF " + band + " FOR VALUES FROM (MINVALUE) TO (35)");
+            txn.exec("CREATE TABLE " + band + "_t1 PARTITION OF " + band + " FOR VALUES FROM (35) TO (MAXVALUE)");
+        }
+        txn.exec("CREATE INDEX idx_inspection_region_group ON inspection_region (group_id)");
+        txn.exec("INSERT INTO inspection_region SELECT * FROM fixture_rows");
+        txn.exec("DROP TABLE fixture_rows");
+        txn.commit();
+    }
+
+    expectAgreesAcrossStrategies({
+        {crop(0, 0, 25, 25), {1, 2}},
+        {crop(0, 0, 100, 100, {{"proper", true}}), {1, 2, 5, 6}},
+        {{{"operator_difference", {crop(0, 0, 45, 45), crop(0, 0, 25, 25)}}}, {3, 5}},
+    });
+
+    // A crop inside one tile only scans that tile
+    QueryEngine engine(conn_string_);
+    const json plan = engine.explain(query(crop(0, 0, 25, 25)));
+    ASSERT_TRUE(plan["partitioned"].get<bool>());
+    std::set<std::string> relations;
+    for (const auto& scan : plan["plan"]["scans"]) relations.insert(scan["relation"].get<std::string>());
+    ASSERT_EQ(relations, std::set<std::string>{"inspection_region_b0_t0"});
+}
+
+TEST_F(QueryEngineTest, EstimatesFromTheLoadersCatalog) {
+    const json valid = {{"p_min", {{"x", 0}, {"y", 0}}}, {"p_max", {{"x", 100}, {"y", 100}}}};
+    const json region = {{"p_min", {{"x", 0}, {"y", 0}}}, {"p_max", {{"x", 35}, {"y", 35}}}};
+    const json query = {{"valid_region", valid}, {"query", {{"operator_crop", {{"region", region}}}}}};
+
+    // Without a catalog or planner statistics there is nothing to go by
+    EngineOptions options;
+    options.strategy = ExecutionStrategy::Pipelined;
+    ASSERT_THROW(QueryEngine(conn_string_, options).estimate_rows(query), std::runtime_error);
+
+    // The catalog data_loader would store for the fixture, on a coarse grid
+    {
+        pqxx::work txn(conn_);
+        txn.exec("CREATE TABLE statistics_cell (x_min FLOAT NOT NULL, y_min FLOAT NOT NULL, x_max FLOAT NOT NULL, "
+                 "y_max FLOAT NOT NULL, points BIGINT NOT NULL)");
+        txn.exec("CREATE TABLE statistics_category (category INTEGER NOT NULL, points BIGINT NOT NULL, PRIMARY KEY (category))");
+        txn.exec("CREATE TABLE statistics_group (size INTEGER NOT NULL, group_count BIGINT NOT NULL, "
+                 "mean_width FLOAT NOT NULL, mean_height FLOAT NOT NULL, PRIMARY KEY (size))");
+        txn.exec("INSERT INTO statistics_cell VALUES (10, 10, 30, 30, 3), (40, 40, 50, 50, 2), (150, 150, 150, 150, 1)");
+        txn.exec("INSERT INTO statistics_category VALUES (1, 4), (2, 2)");
+        txn.exec("INSERT INTO statistics_group VALUES (2, 3, 46.67, 46.67)");
+        txn.commit();
+    }
+
+    ASSERT_DOUBLE_EQ(QueryEngine(conn_string_, options).estimate_rows(query), 3.0);
+    ASSERT_EQ(getIds(QueryEngine(conn_string_, options).execute_query(query)), (std::set<long long>{1, 2, 3}));
+
+    // Auto costs the strategies from the catalog, without an ANALYZE
+    QueryEngine engine(conn_string_);
+    const json plan = engine.explain(query);
+    ASSERT_EQ(plan["strategy_source"], "cost_model");
+    ASSERT_EQ(plan["statistics_source"], "catalog");
+    ASSERT_DOUBLE_EQ(plan["plan"]["catalog_rows"].get<double>(), 3.0);
+}
+
+TEST_F(QueryEngineTest, GroupPostingsAgreeWithGroupIds) {
+    // Group 0 gets a second run of ids, far from its other points. The
+    // postings are what data_loader would build for these rows.
+    {
+        pqxx::work txn(conn_);
+        txn.exec("INSERT INTO inspection_region VALUES (7, 0, 60, 60, 2)");
+        txn.exec("CREATE TABLE group_posting (group_id BIGINT NOT NULL, first_id BIGINT NOT NULL, "
+                 "last_id BIGINT NOT NULL, PRIMARY KEY (group_id, first_id))");
+        txn.exec("INSERT INTO group_posting VALUES (0, 1, 2), (0, 7, 7), (1, 3, 4), (2, 5, 6)");
+        txn.exec("CREATE TABLE dataset_metadata (key TEXT NOT NULL, value TEXT NOT NULL, PRIMARY KEY (key))");
+        txn.exec("INSERT INTO dataset_metadata VALUES ('group_postings', 'id_ranges')");
+        txn.commit();
+    }
+
+    const ExpectedIds cases = {
+        {crop(0, 0, 100, 100, {{"one_of_groups", {0}}}), {1, 2, 7}},
+        {crop(0, 0, 100, 100, {{"one_of_groups", {1, 1}}}), {3}},
+        {crop(0, 0, 55, 55, {{"proper", true}}), {5, 6}},
+        {crop(0, 0, 70, 70, {{"proper", true}}), {1, 2, 5, 6, 7}},
+        {crop(0, 0, 100, 100, {{"one_of_groups", {2, 0}}, {"proper", true}, {"category", 1}}), {1, 5, 6}},
+        {{{"operator_and", {crop(0, 0, 100, 100, {{"one_of_groups", {0, 2}}}), crop(0, 0, 45, 45)}}}, {1, 2, 5}},
+    };
+
+    for (bool postings : {true, false}) {
+        SCOPED_TRACE(postings ? "postings" : "group ids");
+        EngineOptions options;
+        options.group_postings = postings;
+        expectAgreesAcrossStrategies(cases, options);
+    }
+
+    // The group filter and the proper check read the postings
+    EngineOptions options;
+    options.strategy = ExecutionStrategy::Pipelined;
+    const json grouped = query(crop(0, 0, 100, 100, {{"one_of_groups", {0}}, {"proper", true}}));
+    const std::string sql = QueryEngine(conn_string_, options).explain(grouped)["plan"]["sql"];
+    ASSERT_NE(sql.find("FROM group_posting p WHERE p.group_id IN (0)"), std::string::npos);
+    ASSERT_NE(sql.find("group_posting gp JOIN inspection_region g"), std::string::npos);
+
+    options.group_postings = false;
+    const std::string plain = QueryEngine(conn_string_, options).explain(grouped)["plan"]["sql"];
+    ASSERT_EQ(plain.find("group_posting"), std::string::npos);
+}
+
+TEST_F(QueryEngineTest, SampledQueriesAgreeAcrossStrategies) {
+    // Whole groups in the lower left, or category 1 from (35, 35) up
+    json query = R"(
+    {
+      "valid_region": { "p_min": { "x": 0, "y": 0 }, "p_max": { "x": 100, "y": 100 } },
+      "query": {
+        "operator_or": [
+          { "operator_crop": { "region": { "p_min": { "x": 0, "y": 0 }, "p_max": { "x": 35, "y": 35 } }, "proper": true } },
+          { "operator_crop": { "region": { "p_min": { "x": 35, "y": 35 }, "p_max": { "x": 100, "y": 100 } }, "category": 1 } }
+        ]
+      }
+    }
+    )"_json;
+    const std::set<long long> exact = {1, 2, 5, 6};
+
+    // Without sample keys the sample is a hash of the id, the same in every
+    // statement
+    json sampled_query = query;
+    sampled_query["approximate"] = {{"fraction", 0.5}};
+    json capped_query = query;
+    capped_query["approximate"] = {{"fraction", 1.0}, {"max_points", 2}};
+
+    std::set<long long> sampled, capped;
+    for (ExecutionStrategy strategy : all_strategies()) {
+        SCOPED_TRACE(strategy_name(strategy));
+        EngineOptions options;
+        options.strategy = strategy;
+        QueryEngine engine(conn_string_, options);
+        ASSERT_EQ(getIds(engine.execute_query(query)), exact);
+
+        const std::set<long long> ids = getIds(engine.execute_query(sampled_query));
+        ASSERT_TRUE(std::includes(exact.begin(), exact.end(), ids.begin(), ids.end()));
+        if (strategy == all_strategies().front()) sampled = ids;
+        ASSERT_EQ(ids, sampled);
+
+        const std::set<long long> few = getIds(engine.execute_query(capped_query));
+        ASSERT_EQ(few.size(), 2u);
+        ASSERT_TRUE(std::includes(exact.begin(), exact.end(), few.begin(), few.end()));
+        if (strategy == all_strategies().front()) capped = few;
+        ASSERT_EQ(few, capped);
+    }
+
+    // The count scales the sampled points back up
+    QueryEngine engine(conn_string_);
+    json count_query = {{"valid_region", query["valid_region"]}, {"query", {{"operator_count", query["query"]}}},
+                        {"approximate", {{"fraction", 0.5}}}};
+    const json count = engine.execute_aggregate(count_query);
+    ASSERT_EQ(count["approximate"]["sampled"].get<size_t>(), sampled.size());
+    ASSERT_EQ(count["count"].get<size_t>(), sampled.size() * 2);
+    ASSERT_GE(count["approximate"]["low"].get<double>(), static_cast<double>(sampled.size()));
+    ASSERT_GE(count["approximate"]["high"].get<double>(), count["count"].get<double>());
+
+    const std::string sql = engine.explain(sampled_query)["plan"]["children"][0]["sql"];
+    ASSERT_NE(sql.find("hashint8(r.id)"), std::string::npos);
+}
+
+TEST_F(QueryEngineTest, SubscriptionFollowsChanges) {
+    // The loader's schema adds the change log to the fixture's tables
+    loader::create_schema(conn_);
+
+    QueryEngine engine(conn_string_, [] {
+        EngineOptions options;
+        options.strategy = ExecutionStrategy::Pipelined;
+        return options;
+    }());
+    // Whole groups inside the lower left, or category 1 in the upper right,
+    // except around (20, 20)
+    json query = R"(
+    {
+      "valid_region": { "p_min": { "x": 0, "y": 0 }, "p_max": { "x": 100, "y": 100 } },
+      "query": {
+        "operator_difference": [
+          { "operator_or": [
+            { "operator_crop": { "region": { "p_min": { "x": 0, "y": 0 }, "p_max": { "x": 45, "y": 45 } }, "proper": true } },
+            { "operator_crop": { "region": { "p_min": { "x": 45, "y": 45 }, "p_max": { "x": 100, "y": 100 } }, "category": 1 } }
+          ] },
+          { "operator_crop": { "region": { "p_min": { "x": 15, "y": 15 }, "p_max": { "x": 25, "y": 25 } } } }
+        ]
+      }
+    }
+    )"_json;
+
+    QuerySubscription subscription(engine, query);
+    ResultDelta delta = subscription.refresh();
+    ASSERT_TRUE(delta.reloaded);
+    ASSERT_EQ(getIds(delta.added), (std::set<long long>{1, 6}));
+    ASSERT_EQ(subscription.result(), getIds(engine.execute_query(query)));
+    ASSERT_TRUE(subscription.wait(std::chrono::milliseconds(10)).empty());
+
+    // A new point of group 2 in the upper right
+    const long long id = loader::append_data(conn_, {{{60.0, 60.0}, 1, 2}});
+    ASSERT_EQ(id, 7);
+    delta = subscription.wait(std::chrono::milliseconds(5000));
+    ASSERT_EQ(getIds(delta.added), (std::set<long long>{7}));
+    ASSERT_TRUE(delta.removed.empty());
+
+    // Moving point 2 out of the lower left makes group 0 improper there
+    {
+        pqxx::work txn(conn_);
+        txn.exec("UPDATE inspection_region SET coord_x = 80, coord_y = 80 WHERE id = 2");
+        txn.commit();
+    }
+    delta = subscription.wait(std::chrono::milliseconds(5000));
+    ASSERT_TRUE(delta.added.empty());
+    ASSERT_EQ(delta.removed, (std::vector<long long>{1}));
+    ASSERT_EQ(subscription.result(), getIds(engine.execute_query(query)));
+
+    // A changed row that stays in the result is reported again
+    {
+        pqxx::work txn(conn_);
+        txn.exec("UPDATE inspection_region SET coord_x = 55 WHERE id = 6");
+        txn.commit();
+    }
+    delta = subscription.refresh();
+    ASSERT_EQ(delta.added.size(), 1u);
+    ASSERT_DOUBLE_EQ(delta.added[0].x, 55.0);
+
+    loader::delete_regions(conn_, {7, 3});
+    delta = subscription.refresh();
+    ASSERT_EQ(delta.removed, (std::vector<long long>{7}));
+    ASSERT_EQ(subscription.result(), getIds(engine.execute_query(query)));
+
+    // Replacing the dataset re-evaluates the whole query
+    loader::load_data(conn_, {{{10.0, 10.0}, 1, 5}, {{60.0, 60.0}, 1, 6}, {{20.0, 20.0}, 1, 7}},
+                      loader::Quantization());
+    delta = subscription.refresh();
+    ASSERT_TRUE(delta.reloaded);
+    ASSERT_EQ(getIds(delta.added), (std::set<long long>{0, 1}));
+    ASSERT_EQ(subscription.result(), getIds(engine.execute_query(query)));
+}
+
+TEST_F(QueryEngineTest, ConcurrentAppendsTakeTurns) {
+    loader::create_schema(conn_);
+
+    // Each append reads the largest id and inserts after it
+    const size_t kRegions = 50;
+    std::vector<loader::RegionData> regions(kRegions, {{60.0, 60.0}, 1, 2});
+    std::vector<long long> first_ids(2, -1);
+    std::vector<std::thread> appenders;
+    for (size_t a = 0; a < 2; ++a) {
+        appenders.emplace_back([this, &regions, &first_ids, a] {
+            pqxx::connection conn(conn_string_);
+            first_ids[a] = loader::append_data(conn, regions);
+        });
+    }
+    for (auto& appender : appenders) {
+        appender.join();
+    }
+
+    std::sort(first_ids.begin(), first_ids.end());
+    ASSERT_EQ(first_ids, (std::vector<long long>{7, 7 + static_cast<long long>(kRegions)}));
+    pqxx::work txn(conn_);
+    ASSERT_EQ(txn.exec("SELECT COUNT(*) FROM inspection_region")[0][0].as<size_t>(), 6 + 2 * kRegions);
+}
+
+TEST_F(QueryEngineTest, AppendsMustFitTheQuantization) {
+    loader::create_schema(conn_);
+    const std::vector<loader::RegionData> regions = {{{10.0, 10.0}, 1, 0}, {{90.0, 90.0}, 2, 1}};
+    loader::load_data(conn_, regions, loader::compute_quantization(regions, 0.001));
+
+    ASSERT_EQ(loader::append_data(conn_, {{{-1000.0, 95.0}, 1, 1}}), 2);
+    // 1e7 / 0.001 steps is far beyond int32, and would have wrapped around
+    ASSERT_THROW(loader::append_data(conn_, {{{50.0, 50.0}, 1, 1}, {{1e7, 50.0}, 1, 1}}), std::runtime_error);
+
+    QueryEngine engine(conn_string_);
+    ASSERT_EQ(getIds(engine.execute_query(query(crop(-2000, 0, 2000, 2000), region(-2000, 0, 2000, 2000)))),
+              (std::set<long long>{0, 1, 2}));
+}
@@ -0,0 +1,263 @@
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+#include <limits>
+
+#include "../src/query_plan.h"
+#include "test_queries.h"
+
+namespace {
+
+const Rectangle kValidRegion{0.0, 0.0, 100.0, 100.0};
+
+std::unique_ptr<QueryNode> optimized(const json& query) {
+    return optimize_plan(parse_query(query), kValidRegion);
+}
+
+} // namespace
+
+TEST(QueryPlanTest, FlattensNestedOperatorsOfTheSameKind) {
+    auto plan = optimized({{"operator_and", {crop(0, 0, 1, 10), {{"operator_and", {crop(0, 0, 2, 10), crop(0, 0, 3, 10)}}}}}});
+
+    ASSERT_EQ(plan->type, NodeType::And);
+    ASSERT_EQ(plan->children.size(), 3u);
+    for (size_t i = 0; i < 3; ++i) {
+        ASSERT_EQ(plan->children[i]->type, NodeType::Crop);
+        ASSERT_EQ(plan->children[i]->leaf_index, i);
+        ASSERT_EQ(plan->children[i]->crop.region.x_max, static_cast<double>(i + 1));
+    }
+}
+
+TEST(QueryPlanTest, KeepsMixedOperatorsNested) {
+    auto plan = optimized({{"operator_and", {crop(0, 0, 1, 10), {{"operator_or", {crop(0, 0, 2, 10), crop(0, 0, 3, 10)}}}}}});
+
+    ASSERT_EQ(plan->type, NodeType::And);
+    ASSERT_EQ(plan->children.size(), 2u);
+    ASSERT_EQ(plan->children[1]->type, NodeType::Or);
+    ASSERT_EQ(plan->children[1]->children.size(), 2u);
+}
+
+TEST(QueryPlanTest, ReplacesSingleOperandOperators) {
+    auto plan = optimized({{"operator_or", {{{"operator_and", {crop(0, 0, 5, 10)}}}}}});
+
+    ASSERT_EQ(plan->type, NodeType::Crop);
+    ASSERT_EQ(plan->leaf_index, 0u);
+    ASSERT_EQ(plan->crop.region.x_max, 5.0);
+}
+
+TEST(QueryPlanTest, DropsEmptyOperandsAndRenumbersLeaves) {
+    // The unknown operator matches nothing: it disappears from the OR and
+    // empties the AND around it
+    auto plan = optimized({{"operator_or", {
+        {{"operator_and", {crop(0, 0, 1, 10), {{"operator_unknown", json::object()}}}}},
+        crop(0, 0, 2, 10),
+        crop(0, 0, 3, 10)
+    }}});
+
+    ASSERT_EQ(plan->type, NodeType::Or);
+    ASSERT_EQ(plan->children.size(), 2u);
+    ASSERT_EQ(plan->children[0]->leaf_index, 0u);
+    ASSERT_EQ(plan->children[0]->crop.region.x_max, 2.0);
+    ASSERT_EQ(plan->children[1]->leaf_index, 1u);
+
+    auto empty = optimized({{"operator_and", {crop(0, 0, 1, 10), {{"operator_or", json::array()}}}}});
+    ASSERT_EQ(empty->type, NodeType::Or);
+    ASSERT_TRUE(empty->children.empty());
+}
+
+TEST(QueryPlanTest, ParsesAggregates) {
+    const json* operand = nullptr;
+    json count = {{"operator_count", crop(0, 0, 5, 10)}};
+    ASSERT_TRUE(is_aggregate(count));
+    ASSERT_FALSE(is_aggregate(crop(0, 0, 5, 10)));
+    ASSERT_EQ(parse_aggregate(count, operand).kind, AggregateKind::Count);
+    ASSERT_EQ(operand, &count["operator_count"]);
+
+    json grid = {{"operator_histogram", {{"by", "grid"}, {"cell_size", {{"x", 2}, {"y", 4}}}, {"query", crop(0, 0, 5, 10)}}}};
+    AggregateSpec spec = parse_aggregate(grid, operand);
+    ASSERT_EQ(spec.kind, AggregateKind::Histogram);
+    ASSERT_EQ(spec.by, HistogramKey::Grid);
+    ASSERT_EQ(spec.cell_width, 2.0);
+    ASSERT_EQ(spec.cell_height, 4.0);
+
+    ASSERT_EQ(parse_aggregate({{"operator_histogram", {{"query", crop(0, 0, 5, 10)}}}}, operand).by, HistogramKey::Category);
+    ASSERT_THROW(parse_aggregate({{"operator_histogram", {{"by", "color"}, {"query", crop(0, 0, 5, 10)}}}}, operand), std::runtime_error);
+    ASSERT_THROW(parse_aggregate({{"operator_histogram", {{"by", "grid"}, {"cell_size", 0}, {"query", crop(0, 0, 5, 10)}}}}, operand),
+                 std::runtime_error);
+}
+
+TEST(QueryPlanTest, TurnsNegationsIntoDifferences) {
+    // a AND NOT b AND NOT c is a - b - c
+    auto plan = optimized({{"operator_and", {crop(0, 0, 1, 10), {{"operator_not", crop(0, 0, 2, 10)}}, {{"operator_not", crop(0, 0, 3, 10)}}}}});
+    ASSERT_EQ(plan->type, NodeType::Difference);
+    ASSERT_EQ(plan->children.size(), 3u);
+    for (size_t i = 0; i < 3; ++i) {
+        ASSERT_EQ(plan->children[i]->type, NodeType::Crop);
+        ASSERT_EQ(plan->children[i]->leaf_index, i);
+    }
+
+    // The positive operands stay together
+    plan = optimized({{"operator_and", {crop(0, 0, 1, 10), crop(0, 0, 2, 10), {{"operator_not", crop(0, 0, 3, 10)}}}}});
+    ASSERT_EQ(plan->type, NodeType::Difference);
+    ASSERT_EQ(plan->children[0]->type, NodeType::And);
+    ASSERT_EQ(plan->children[1]->crop.region.x_max, 3.0);
+
+    // Excluding an OR excludes each of its operands; excluding a negation
+    // is an intersection
+    plan = optimized({{"operator_difference", {crop(0, 0, 1, 10), {{"operator_or", {crop(0, 0, 2, 10), crop(0, 0, 3, 10)}}}}}});
+    ASSERT_EQ(plan->type, NodeType::Difference);
+    ASSERT_EQ(plan->children.size(), 3u);
+    plan = optimized({{"operator_difference", {crop(0, 0, 1, 10), {{"operator_not", crop(0, 0, 2, 10)}}}}});
+    ASSERT_EQ(plan->type, NodeType::And);
+
+    plan = optimized({{"operator_not", {{"operator_not", crop(0, 0, 4, 10)}}}});
+    ASSERT_EQ(plan->type, NodeType::Crop);
+    ASSERT_EQ(plan->crop.region.x_max, 4.0);
+}
+
+TEST(QueryPlanTest, ComplementsOnlyAtTheRoot) {
+    // A NOT at the root is the valid region minus its operand
+    auto plan = optimized({{"operator_not", crop(0, 0, 1, 10)}});
+    ASSERT_EQ(plan->type, NodeType::Difference);
+    ASSERT_EQ(plan->children.size(), 2u);
+    ASSERT_EQ(plan->children[0]->type, NodeType::Crop);
+    ASSERT_EQ(plan->children[0]->crop.region.x_max, kValidRegion.x_max);
+    ASSERT_EQ(plan->children[1]->crop.region.x_max, 1.0);
+
+    // a OR NOT b is NOT (b - a)
+    plan = optimized({{"operator_or", {crop(0, 0, 1, 10), {{"operator_not", crop(0, 0, 2, 10)}}}}});
+    ASSERT_EQ(plan->type, NodeType::Difference);
+    ASSERT_EQ(plan->children[0]->crop.region.x_max, kValidRegion.x_max);
+    ASSERT_EQ(plan->children[1]->type, NodeType::Difference);
+    ASSERT_EQ(plan->children[1]->children[0]->crop.region.x_max, 2.0);
+
+    // NOT a - b is NOT (a OR b)
+    plan = optimized({{"operator_difference", {{{"operator_not", crop(0, 0, 1, 10)}}, crop(0, 0, 2, 10)}}});
+    ASSERT_EQ(plan->type, NodeType::Difference);
+    ASSERT_EQ(plan->children.size(), 3u);
+
+    // Everything but nothing
+    plan = optimized({{"operator_not", {{"operator_or", json::array()}}}});
+    ASSERT_EQ(plan->type, NodeType::Crop);
+}
+
+TEST(QueryPlanTest, CombinesDifferences) {
+    IdSets operands = {{1, 2, 3, 4, 5}, {2, 9}, {1, 3, 4, 6, 7, 8, 10}};
+    ASSERT_EQ(combine_results(NodeType::Difference, operands), (IdSet{5}));
+
+    Rectangle bounds;
+    auto plan = optimized({{"operator_difference", {crop(0, 0, 1, 10), crop(0, 0, 50, 10)}}});
+    ASSERT_TRUE(plan_bounds(*plan, bounds));
+    ASSERT_EQ(bounds.x_max, 1.0);
+}
+
+TEST(QueryPlanTest, CombinesWithinTheOperandsArena) {
+    QueryArena arena(false);
+    IdSets operands(&arena);
+    operands.push_back({1, 2, 3});
+    operands.push_back({2, 3, 4});
+    operands.push_back({3, 5});
+    const size_t operand_bytes = arena.bytes_allocated();
+    ASSERT_GT(operand_bytes, 0u);
+
+    IdSet result = combine_results(NodeType::And, operands);
+    ASSERT_EQ(result, (IdSet{3}));
+    ASSERT_EQ(result.get_allocator().resource(), &arena);
+    ASSERT_GT(arena.bytes_allocated(), operand_bytes);
+
+    IdSets more(&arena);
+    more.push_back({1});
+    more.push_back({2});
+    ASSERT_EQ(combine_results(NodeType::Or, more), (IdSet{1, 2}));
+}
+
+TEST(QueryPlanTest, RejectsDegenerateShapes) {
+    auto polygon = [](size_t vertices) {
+        json points = json::array();
+        for (size_t i = 0; i < vertices; ++i) {
+            points.push_back({{"x", i % 2 ? 10.0 : 0.0}, {"y", i / 2 ? 10.0 : 0.0}});
+        }
+        return json{{"operator_crop_polygon", {{"points", points}}}};
+    };
+    auto circle = [](double radius, double center_x = 5.0) {
+        return json{{"operator_crop_circle", {{"center", {{"x", center_x}, {"y", 5}}}, {"radius", radius}}}};
+    };
+
+    ASSERT_NO_THROW(parse_query(polygon(3)));
+    for (size_t vertices : {0, 1, 2}) {
+        SCOPED_TRACE(vertices);
+        ASSERT_THROW(parse_query(polygon(vertices)), std::runtime_error);
+    }
+    json infinite = polygon(3);
+    infinite["operator_crop_polygon"]["points"][1]["x"] = std::numeric_limits<double>::infinity();
+    ASSERT_THROW(parse_query(infinite), std::runtime_error);
+
+    ASSERT_NO_THROW(parse_query(circle(1.0)));
+    ASSERT_THROW(parse_query(circle(0.0)), std::runtime_error);
+    ASSERT_THROW(parse_query(circle(-1.0)), std::runtime_error);
+    ASSERT_THROW(parse_query(circle(std::numeric_limits<double>::infinity())), std::runtime_error);
+    ASSERT_THROW(parse_query(circle(std::numeric_limits<double>::quiet_NaN())), std::runtime_error);
+    ASSERT_THROW(parse_query(circle(1.0, std::numeric_limits<double>::infinity())), std::runtime_error);
+    // Nested operands are checked too
+    ASSERT_THROW(parse_query({{"operator_or", {crop(0, 0, 5, 10), circle(-2.0)}}}), std::runtime_error);
+}
+
+TEST(QueryPlanTest, ParsesApproximateOptions) {
+    ASSERT_FALSE(parse_approximate(json::object()).enabled);
+    ASSERT_FALSE(parse_approximate({{"approximate", false}}).enabled);
+
+    const ApproximateSpec defaults = parse_approximate({{"approximate", true}});
+    ASSERT_TRUE(defaults.enabled);
+    ASSERT_DOUBLE_EQ(defaults.fraction, 0.01);
+    ASSERT_EQ(defaults.max_points, 0u);
+
+    const ApproximateSpec spec = parse_approximate({{"approximate", {{"fraction", 0.1}, {"max_points", 500}}}});
+    ASSERT_DOUBLE_EQ(spec.fraction, 0.1);
+    ASSERT_DOUBLE_EQ(spec.confidence, 0.95);
+    ASSERT_EQ(spec.max_points, 500u);
+
+    ASSERT_THROW(parse_approximate({{"approximate", {{"fraction", 0}}}}), std::runtime_error);
+    ASSERT_THROW(parse_approximate({{"approximate", {{"fraction", 1.5}}}}), std::runtime_error);
+    ASSERT_THROW(parse_approximate({{"approximate", {{"confidence", 1}}}}), std::runtime_error);
+}
+
+TEST(QueryPlanTest, ParsesPageOptions) {
+    ASSERT_FALSE(parse_page(json::object()).paged());
+
+    const PageSpec page = parse_page({{"limit", 10}, {"after", {{"y", 5.5}, {"x", 1}, {"id", 42}}}});
+    ASSERT_TRUE(page.paged());
+    ASSERT_EQ(page.limit, 10u);
+    ASSERT_DOUBLE_EQ(page.after_y, 5.5);
+    ASSERT_DOUBLE_EQ(page.after_x, 1.0);
+    ASSERT_TRUE(page.has_after_id);
+    ASSERT_EQ(page.after_id, 42);
+    ASSERT_FALSE(parse_page({{"after", {{"y", 0}, {"x", 0}}}}).has_after_id);
+    ASSERT_EQ(parse_page({{"limit", 0}}).limit, 0u);
+
+    ASSERT_THROW(parse_page({{"limit", -1}}), std::runtime_error);
+    ASSERT_THROW(parse_page({{"limit", 2.5}}), std::runtime_error);
+    ASSERT_THROW(parse_page({{"limit", "10"}}), std::runtime_error);
+    ASSERT_THROW(parse_page({{"after", {{"y", 0}}}}), std::runtime_error);
+    ASSERT_THROW(parse_page({{"after", {{"y", "0"}, {"x", 0}}}}), std::runtime_error);
+    ASSERT_THROW(parse_page({{"after", {{"y", 0}, {"x", 0}, {"id", 1.5}}}}), std::runtime_error);
+}
+
+TEST(QueryPlanTest, EstimatesCountsFromSamples) {
+    // 400 of a 10% sample: 4000, give or take 1.96 * sqrt(400 * 0.9) / 0.1
+    const SampledCount count = estimate_count(400, 0.1, 0.95);
+    ASSERT_DOUBLE_EQ(count.estimate, 4000.0);
+    ASSERT_NEAR(count.high - count.estimate, 371.87, 0.01);
+    ASSERT_NEAR(count.estimate - count.low, 371.87, 0.01);
+
+    // A sample of everything is exact
+    const SampledCount exact = estimate_count(400, 1.0, 0.95);
+    ASSERT_DOUBLE_EQ(exact.low, 400.0);
+    ASSERT_DOUBLE_EQ(exact.high, 400.0);
+
+    // Nothing sampled still bounds the count from above
+    const SampledCount none = estimate_count(0, 0.01, 0.95);
+    ASSERT_DOUBLE_EQ(none.low, 0.0);
+    ASSERT_NEAR(none.high, 299.57, 0.01);
+
+    // Never below what was actually seen
+    ASSERT_DOUBLE_EQ(estimate_count(1, 0.5, 0.99).low, 1.0);
+}
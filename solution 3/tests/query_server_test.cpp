@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../src/query_server.h"
+
+// The server is exercised with an in-process handler, so no database is
+// needed.
+class QueryServerTest : public ::testing::Test {
+protected:
+    ServerOptions options_;
+    std::atomic<int> in_flight_{0};
+    std::atomic<int> max_in_flight_{0};
+
+    void SetUp() override {
+        options_.socket_path = ::testing::TempDir() + "query_server_test_" + std::to_string(::getpid()) + ".sock";
+        options_.max_connections = 2;
+    }
+
+    // Echoes the request; "sleep_ms" delays the answer, "fail" throws
+    json handle(const json& request) {
+        int now = ++in_flight_;
+        int seen = max_in_flight_;
+        while (now > seen && !max_in_flight_.compare_exchange_weak(seen, now)) {}
+
+        if (request.contains("sleep_ms")) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(request["sleep_ms"].get<int>()));
+        }
+        --in_flight_;
+
+        if (request.contains("fail")) {
+            throw std::runtime_error("handler failed");
+        }
+        return {{"echo", request}};
+    }
+};
+
+TEST_F(QueryServerTest, AnswersRequestsAndShutsDown) {
+    QueryServer server(options_, [this](const json& request) { return handle(request); });
+    server.start();
+    std::thread serving([&server] { server.serve(); });
+
+    {
+        QueryClient client(options_.socket_path);
+        EXPECT_EQ(client.request({{"command", "ping"}})["ok"], true);
+
+        json response = client.request({{"id", 7}, {"value", "abc"}});
+        EXPECT_EQ(response["id"], 7);
+        EXPECT_EQ(response["echo"]["value"], "abc");
+
+        // Handler errors are reported without dropping the connection
+        json failed = client.request({{"id", 8}, {"fail", true}});
+        EXPECT_EQ(failed["error"], "handler failed");
+        EXPECT_EQ(failed["id"], 8);
+        EXPECT_EQ(client.request({{"value", 1}})["echo"]["value"], 1);
+    }
+
+    server.stop();
+    serving.join();
+    EXPECT_NE(::access(options_.socket_path.c_str(), F_OK), 0);
+}
+
+TEST_F(QueryServerTest, AggregateAnswersRoundTrip) {
+    // Answers like query_engine --serve: a summary for aggregates, points
+    // otherwise
+    QueryServer server(options_, [](const json& request) -> json {
+        if (request["query"].contains("operator_count")) {
+            return {{"aggregate", "count"}, {"count", 42}};
+        }
+        return {{"count", 1}, {"points", {{1.5, 2.5}}}};
+    });
+    server.start();
+    std::thread serving([&server] { server.serve(); });
+
+    {
+        QueryClient client(options_.socket_path);
+        json summary = client.request({{"query", {{"operator_count", json::object()}}}});
+        EXPECT_TRUE(is_aggregate_response(summary));
+        EXPECT_EQ(summary["aggregate"], "count");
+        EXPECT_EQ(summary["count"], 42);
+
+        json points = client.request({{"query", {{"operator_crop", json::object()}}}});
+        EXPECT_FALSE(is_aggregate_response(points));
+        EXPECT_EQ(points["points"].size(), 1u);
+    }
+
+    server.stop();
+    serving.join();
+}
+
+TEST_F(QueryServerTest, ConcurrentClientsAreBoundedByMaxConnections) {
+    QueryServer server(options_, [this](const json& request) { return handle(request); });
+    server.start();
+    std::thread serving([&server] { server.serve(); });
+
+    std::vector<std::thread> clients;
+    std::atomic<int> answered{0};
+    for (int i = 0; i < 6; ++i) {
+        clients.emplace_back([this, i, &answered] {
+            QueryClient client(options_.socket_path);
+            json response = client.request({{"id", i}, {"sleep_ms", 50}});
+            if (response["id"] == i) ++answered;
+        });
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+
+    EXPECT_EQ(answered.load(), 6);
+    EXPECT_GE(max_in_flight_.load(), 1);
+    EXPECT_LE(max_in_flight_.load(), 2);
+
+    server.stop();
+    serving.join();
+}
+
+TEST_F(QueryServerTest, InFlightRequestFinishesOnShutdown) {
+    QueryServer server(options_, [this](const json& request) { return handle(request); });
+    server.start();
+    std::thread serving([&server] { server.serve(); });
+
+    QueryClient client(options_.socket_path);
+    std::thread stopper([&server] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        server.stop();
+    });
+
+    json response = client.request({{"sleep_ms", 100}});
+    EXPECT_EQ(response["echo"]["sleep_ms"], 100);
+
+    stopper.join();
+    serving.join();
+}
+
+TEST(QueryServerFrameTest, RejectsOversizedFrames) {
+    int fds[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    write_frame(fds[1], std::string(100, 'x'));
+    std::string payload;
+    EXPECT_THROW(read_frame(fds[0], payload, 10), std::runtime_error);
+
+    write_frame(fds[1], "{}");
+    ::close(fds[1]);
+    // Drain the rest of the oversized frame, then read the next one
+    char skip[100];
+    ASSERT_EQ(::read(fds[0], skip, sizeof(skip)), 100);
+    ASSERT_TRUE(read_frame(fds[0], payload));
+    EXPECT_EQ(payload, "{}");
+    EXPECT_FALSE(read_frame(fds[0], payload));
+    ::close(fds[0]);
+}
@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+#include <functional>
+#include <random>
+#include <set>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "../src/random_query.h"
+
+using json = nlohmann::json;
+
+namespace {
+
+// Same points as the QueryEngineTest fixture
+std::vector<Point> fixturePoints() {
+    auto point = [](long long id, int group, double x, double y, int category) {
+        Point p;
+        p.id = id;
+        p.x = x;
+        p.y = y;
+        p.category = category;
+        p.group_id = group;
+        return p;
+    };
+    return {point(1, 0, 10, 10, 1), point(2, 0, 20, 20, 2), point(3, 1, 30, 30, 1),
+            point(4, 1, 150, 150, 2), point(5, 2, 40, 40, 1), point(6, 2, 50, 50, 1)};
+}
+
+json rect(double x_min, double y_min, double x_max, double y_max) {
+    return {{"p_min", {{"x", x_min}, {"y", y_min}}}, {"p_max", {{"x", x_max}, {"y", y_max}}}};
+}
+
+} // namespace
+
+TEST(RandomQueryTest, ReferenceMatchesDocumentedSemantics) {
+    const std::vector<Point> points = fixturePoints();
+
+    json proper = {{"valid_region", rect(0, 0, 100, 100)},
+                   {"query", {{"operator_crop", {{"region", rect(0, 0, 100, 100)}, {"proper", true}}}}}};
+    ASSERT_EQ(reference_evaluate(points, proper), (std::set<long long>{1, 2, 5, 6}));
+
+    json filtered = {{"valid_region", rect(0, 0, 100, 100)},
+                     {"query", {{"operator_or", {
+                         {{"operator_crop", {{"region", rect(0, 0, 100, 100)}, {"category", 2}}}},
+                         {{"operator_and", {
+                             {{"operator_crop", {{"region", rect(0, 0, 35, 35)}}}},
+                             {{"operator_crop", {{"region", rect(15, 15, 55, 55)}, {"one_of_groups", {1}}}}}
+                         }}}
+                     }}}}};
+    ASSERT_EQ(reference_evaluate(points, filtered), (std::set<long long>{2, 3}));
+}
+
+TEST(RandomQueryTest, ReferenceComplementsWithinTheValidRegion) {
+    const std::vector<Point> points = fixturePoints();
+    const json low = {{"operator_crop", {{"region", rect(0, 0, 25, 25)}}}};
+    const json category_2 = {{"operator_crop", {{"region", rect(0, 0, 200, 200)}, {"category", 2}}}};
+
+    // Point 4 lies outside the valid region, so no complement contains it
+    json query = {{"valid_region", rect(0, 0, 100, 100)}, {"query", {{"operator_not", low}}}};
+    ASSERT_EQ(reference_evaluate(points, query), (std::set<long long>{3, 5, 6}));
+
+    query["query"] = {{"operator_difference", {{{"operator_not", category_2}}, low}}};
+    ASSERT_EQ(reference_evaluate(points, query), (std::set<long long>{3, 5, 6}));
+
+    query["query"] = {{"operator_or", {low, {{"operator_not", {{"operator_or", {low, category_2}}}}}}}};
+    ASSERT_EQ(reference_evaluate(points, query), (std::set<long long>{1, 2, 3, 5, 6}));
+}
+
+TEST(RandomQueryTest, SameSeedSameQueries) {
+    RandomQueryOptions options;
+    std::mt19937_64 a(7), b(7);
+    for (int i = 0; i < 20; ++i) {
+        ASSERT_EQ(random_query(a, options), random_query(b, options));
+    }
+}
+
+TEST(RandomQueryTest, QueriesStayWithinTheGrammar) {
+    RandomQueryOptions options;
+    options.max_depth = 2;
+    std::mt19937_64 rng(3);
+
+    std::function<int(const json&)> depth = [&](const json& node) {
+        if (node.contains("operator_crop")) {
+            EXPECT_TRUE(node["operator_crop"].contains("region"));
+            return 0;
+        }
+        if (node.contains("operator_crop_polygon")) {
+            EXPECT_GE(node["operator_crop_polygon"]["points"].size(), 3u);
+            return 0;
+        }
+        if (node.contains("operator_crop_circle")) {
+            EXPECT_GT(node["operator_crop_circle"]["radius"].get<double>(), 0.0);
+            return 0;
+        }
+        if (node.contains("operator_not")) {
+            return depth(node["operator_not"]) + 1;
+        }
+        const json& operands = node.contains("operator_and") ? node["operator_and"]
+                             : node.contains("operator_difference") ? node["operator_difference"]
+                             : node["operator_or"];
+        EXPECT_FALSE(operands.empty());
+        int deepest = 0;
+        for (const auto& operand : operands) {
+            deepest = std::max(deepest, depth(operand));
+        }
+        return deepest + 1;
+    };
+
+    for (int i = 0; i < 100; ++i) {
+        json q = random_query(rng, options);
+        ASSERT_TRUE(q.contains("valid_region"));
+        ASSERT_LE(depth(q["query"]), options.max_depth);
+    }
+}
+
+TEST(RandomQueryTest, ReferenceTestsPolygonsAndCircles) {
+    const std::vector<Point> points = fixturePoints();
+
+    // A triangle over points 1, 2 and 3 that leaves out 3 by its slanted edge
+    json triangle = {{"valid_region", rect(0, 0, 100, 100)},
+                     {"query", {{"operator_crop_polygon", {{"points", {
+                         {{"x", 0}, {"y", 0}}, {{"x", 60}, {"y", 0}}, {{"x", 0}, {"y", 60}}}}}}}}};
+    ASSERT_EQ(reference_evaluate(points, triangle), (std::set<long long>{1, 2}));
+
+    // Point 6 lies exactly on the circle
+    json circle = {{"valid_region", rect(0, 0, 100, 100)},
+                   {"query", {{"operator_crop_circle", {{"center", {{"x", 50}, {"y", 40}}}, {"radius", 10}}}}}};
+    ASSERT_EQ(reference_evaluate(points, circle), (std::set<long long>{5, 6}));
+
+    circle["query"]["operator_crop_circle"]["proper"] = true;
+    ASSERT_EQ(reference_evaluate(points, circle), (std::set<long long>{5, 6}));
+
+    // A smaller circle holds point 5 but not its group partner 6
+    circle["query"]["operator_crop_circle"] = {{"center", {{"x", 45}, {"y", 40}}}, {"radius", 6}};
+    ASSERT_EQ(reference_evaluate(points, circle), (std::set<long long>{5}));
+    circle["query"]["operator_crop_circle"]["proper"] = true;
+    ASSERT_EQ(reference_evaluate(points, circle), std::set<long long>{});
+}
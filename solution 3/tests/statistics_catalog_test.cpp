@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+
+#include "../src/statistics_catalog.h"
+#include "test_queries.h"
+
+namespace {
+
+const Rectangle kEverything{0.0, 0.0, 100.0, 100.0};
+
+// 10 x 10 cells of 10 x 10 over [0, 100]^2, points_in(x, y) in each;
+// categories 0 and 1 at 3:1, and 2500 groups of 4 spanning 10 x 10
+StatisticsCatalog grid_catalog(double (*points_in)(int, int)) {
+    std::vector<StatisticsCatalog::Cell> cells;
+    double rows = 0.0;
+    for (int y = 0; y < 10; ++y) {
+        for (int x = 0; x < 10; ++x) {
+            cells.push_back({{x * 10.0, y * 10.0, x * 10.0 + 10.0, y * 10.0 + 10.0}, points_in(x, y)});
+            rows += points_in(x, y);
+        }
+    }
+    return StatisticsCatalog(std::move(cells), {{0, rows * 0.75}, {1, rows * 0.25}},
+                             {{4, rows / 4.0, 10.0, 10.0}});
+}
+
+double uniform(int, int) { return 100.0; }
+// Nearly everything in the bottom left cell
+double clustered(int x, int y) { return (x == 0 && y == 0) ? 9901.0 : 1.0; }
+
+double estimate(const StatisticsCatalog& catalog, const json& query) {
+    return catalog.result_rows(*optimize_plan(parse_query(query), kEverything), kEverything);
+}
+
+} // namespace
+
+TEST(StatisticsCatalogTest, EstimatesCropsFromTheCellsTheyCover) {
+    const StatisticsCatalog catalog = grid_catalog(uniform);
+    ASSERT_DOUBLE_EQ(catalog.rows(), 10000.0);
+    ASSERT_DOUBLE_EQ(estimate(catalog, crop(0, 0, 50, 50)), 2500.0);
+    ASSERT_DOUBLE_EQ(estimate(catalog, crop(5, 0, 15, 10)), 100.0);
+    // Clipped to the valid region
+    ASSERT_DOUBLE_EQ(estimate(catalog, crop(50, 50, 200, 200)), 2500.0);
+
+    // The same crop over clustered data
+    const StatisticsCatalog skewed = grid_catalog(clustered);
+    ASSERT_DOUBLE_EQ(estimate(skewed, crop(0, 0, 10, 10)), 9901.0);
+    ASSERT_DOUBLE_EQ(estimate(skewed, crop(50, 50, 100, 100)), 25.0);
+}
+
+TEST(StatisticsCatalogTest, CombinesOperandsCellByCell) {
+    const StatisticsCatalog catalog = grid_catalog(uniform);
+    const json left = crop(0, 0, 50, 100);
+    const json bottom = crop(0, 0, 100, 50);
+
+    ASSERT_DOUBLE_EQ(estimate(catalog, {{"operator_and", {left, bottom}}}), 2500.0);
+    ASSERT_DOUBLE_EQ(estimate(catalog, {{"operator_or", {left, bottom}}}), 7500.0);
+    ASSERT_DOUBLE_EQ(estimate(catalog, {{"operator_difference", {left, bottom}}}), 2500.0);
+    // Disjoint crops share no cell
+    ASSERT_DOUBLE_EQ(estimate(catalog, {{"operator_and", {crop(0, 0, 20, 20), crop(60, 60, 80, 80)}}}), 0.0);
+    ASSERT_DOUBLE_EQ(estimate(catalog, {{"operator_not", bottom}}), 5000.0);
+}
+
+TEST(StatisticsCatalogTest, FiltersScaleByTheirShare) {
+    const StatisticsCatalog catalog = grid_catalog(uniform);
+    ASSERT_DOUBLE_EQ(estimate(catalog, crop(0, 0, 100, 100, {{"category", 1}})), 2500.0);
+    ASSERT_DOUBLE_EQ(estimate(catalog, crop(0, 0, 100, 100, {{"category", 7}})), 0.0);
+    ASSERT_DOUBLE_EQ(estimate(catalog, crop(0, 0, 100, 100, {{"one_of_groups", {1, 2}}})), 8.0);
+}
+
+TEST(StatisticsCatalogTest, ProperCropsCountTheGroupsThatFit) {
+    const StatisticsCatalog catalog = grid_catalog(uniform);
+    // A 10 x 10 group fits a 100 x 100 crop with chance 0.9 * 0.9
+    ASSERT_NEAR(estimate(catalog, crop(0, 0, 100, 100, {{"proper", true}})), 8100.0, 1e-6);
+    ASSERT_DOUBLE_EQ(estimate(catalog, crop(0, 0, 5, 100, {{"proper", true}})), 0.0);
+}
+
+TEST(StatisticsCatalogTest, SummarizesAsTableStatistics) {
+    ASSERT_FALSE(StatisticsCatalog().table_statistics().valid);
+
+    const TableStatistics stats = grid_catalog(uniform).table_statistics();
+    ASSERT_TRUE(stats.valid);
+    ASSERT_DOUBLE_EQ(stats.rows, 10000.0);
+    ASSERT_DOUBLE_EQ(stats.extent.x_min, 0.0);
+    ASSERT_DOUBLE_EQ(stats.extent.y_max, 100.0);
+    ASSERT_DOUBLE_EQ(stats.categories, 2.0);
+    ASSERT_DOUBLE_EQ(stats.mean_group_size(), 4.0);
+}
@@ -0,0 +1,28 @@
+#ifndef TEST_QUERIES_H
+#define TEST_QUERIES_H
+
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+// Builders for the query documents the tests evaluate
+
+// {"p_min": {"x", "y"}, "p_max": {"x", "y"}}
+inline json region(double x_min, double y_min, double x_max, double y_max) {
+    return {{"p_min", {{"x", x_min}, {"y", y_min}}}, {"p_max", {{"x", x_max}, {"y", y_max}}}};
+}
+
+// An operator_crop of the rectangle, with extra fields such as "category"
+// or "proper"
+inline json crop(double x_min, double y_min, double x_max, double y_max, const json& extra = json::object()) {
+    json op = extra;
+    op["region"] = region(x_min, y_min, x_max, y_max);
+    return {{"operator_crop", op}};
+}
+
+// A query document for an operator tree, over [0, 100]^2 unless given
+inline json query(const json& tree, const json& valid_region = region(0, 0, 100, 100)) {
+    return {{"valid_region", valid_region}, {"query", tree}};
+}
+
+#endif // TEST_QUERIES_H
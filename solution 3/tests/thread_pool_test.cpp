@@ -0,0 +1,54 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include "../src/thread_pool.h"
+
+// Sums a range by recursive splitting, so tasks wait on their own subtasks
+static long long parallel_sum(ThreadPool& pool, int lo, int hi) {
+    if (hi - lo <= 8) {
+        long long sum = 0;
+        for (int i = lo; i < hi; ++i) sum += i;
+        return sum;
+    }
+
+    int mid = lo + (hi - lo) / 2;
+    long long left = 0;
+    TaskGroup group(pool);
+    group.run([&] { left = parallel_sum(pool, lo, mid); });
+    long long right = parallel_sum(pool, mid, hi);
+    group.wait();
+    return left + right;
+}
+
+TEST(ThreadPoolTest, RunsAllTasks) {
+    ThreadPool pool(4);
+    std::atomic<int> counter{0};
+
+    TaskGroup group(pool);
+    for (int i = 0; i < 1000; ++i) {
+        group.run([&counter] { ++counter; });
+    }
+    group.wait();
+
+    ASSERT_EQ(counter.load(), 1000);
+}
+
+TEST(ThreadPoolTest, NestedTasksDoNotDeadlock) {
+    // A single worker must still finish because waiting threads run tasks
+    ThreadPool pool(1);
+    ASSERT_EQ(parallel_sum(pool, 0, 10000), 49995000LL);
+
+    ThreadPool wide_pool(8);
+    ASSERT_EQ(parallel_sum(wide_pool, 0, 10000), 49995000LL);
+}
+
+TEST(ThreadPoolTest, PropagatesFirstException) {
+    ThreadPool pool(2);
+    TaskGroup group(pool);
+    group.run([] { throw std::runtime_error("task failed"); });
+    group.run([] {});
+
+    ASSERT_THROW(group.wait(), std::runtime_error);
+}